@@ -0,0 +1,482 @@
+// Offline texture cooker: turns source images into the pre-decoded .ctex container FinalProject
+// maps and uploads without decoding (see FinalProject/texturefile.h for the layout)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../FinalProject/texturefile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// One decoded RGBA8 image level
+/// </summary>
+struct Image
+{
+	uint32_t width = 0, height = 0;
+	std::vector<unsigned char> pixels; // RGBA8, rows tightly packed
+
+	const unsigned char* texel(int x, int y) const
+	{
+		// clamp to the edge, used by the mip filter and for partial 4x4 blocks
+		x = std::min(std::max(x, 0), (int)width - 1);
+		y = std::min(std::max(y, 0), (int)height - 1);
+		return &pixels[((size_t)y * width + x) * 4];
+	}
+};
+
+bool parseFormat(const std::string& name, uint32_t& format);
+bool loadImage(const std::string& path, Image& image);
+Image downsample(const Image& source);
+void encodeLevel(const Image& image, uint32_t format, std::vector<unsigned char>& out);
+void encodeBC1(const unsigned char block[16][4], unsigned char out[8]);
+void encodeBC7(const unsigned char block[16][4], unsigned char out[16]);
+
+int main(int argc, char* argv[])
+{
+	uint32_t format = TEXTURE_FORMAT_BC7;
+	bool mips = true;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc)
+		{
+			if (!parseFormat(argv[++i], format)) return 1;
+		}
+		else if (arg == "--no-mips") mips = false;
+		else paths.push_back(arg);
+	}
+	if (paths.size() != 2 && paths.size() != 7)
+	{
+		std::cout << "Usage: Cooker [--format rgba8|bc1|bc7] [--no-mips] OUTPUT.ctex IMAGE\n"
+			<< "       Cooker [--format rgba8|bc1|bc7] [--no-mips] OUTPUT.ctex +X -X +Y -Y +Z -Z" << std::endl;
+		return 1;
+	}
+	std::string outputPath = paths[0];
+	paths.erase(paths.begin());
+
+	// every face, with its full mip chain
+	std::vector<std::vector<Image>> faces(paths.size());
+	for (size_t face = 0; face < paths.size(); face++)
+	{
+		Image image;
+		if (!loadImage(paths[face], image)) return 1;
+		if (face > 0 && (image.width != faces[0][0].width || image.height != faces[0][0].height))
+		{
+			std::cout << "ERROR::COOKER::IMAGE_SIZE_MISMATCH " << paths[face] << std::endl;
+			return 1;
+		}
+		faces[face].push_back(image);
+		while (mips && (faces[face].back().width > 1 || faces[face].back().height > 1))
+		{
+			faces[face].push_back(downsample(faces[face].back()));
+		}
+	}
+
+	TextureFileHeader header = {};
+	header.magic = TEXTURE_FILE_MAGIC;
+	header.version = TEXTURE_FILE_VERSION;
+	header.format = format;
+	header.width = faces[0][0].width;
+	header.height = faces[0][0].height;
+	header.faces = (uint32_t)faces.size();
+	header.mipCount = (uint32_t)faces[0].size();
+
+	// level table first, the data follows in the same face-major order
+	std::vector<TextureFileLevel> levels(header.faces * header.mipCount);
+	std::vector<std::vector<unsigned char>> data(levels.size());
+	uint64_t offset = sizeof(TextureFileHeader) + levels.size() * sizeof(TextureFileLevel);
+	for (uint32_t face = 0; face < header.faces; face++)
+	{
+		for (uint32_t mip = 0; mip < header.mipCount; mip++)
+		{
+			size_t index = face * header.mipCount + mip;
+			encodeLevel(faces[face][mip], format, data[index]);
+			offset = (offset + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+			levels[index].offset = offset;
+			levels[index].size = data[index].size();
+			offset += data[index].size();
+		}
+	}
+
+	std::ofstream out(outputPath, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "ERROR::COOKER::FILE_NOT_WRITABLE " << outputPath << std::endl;
+		return 1;
+	}
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)levels.data(), levels.size() * sizeof(TextureFileLevel));
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		static const char padding[TEXTURE_FILE_ALIGNMENT] = {};
+		out.write(padding, (std::streamsize)(levels[i].offset - (uint64_t)out.tellp()));
+		out.write((const char*)data[i].data(), data[i].size());
+	}
+	if (!out)
+	{
+		std::cout << "ERROR::COOKER::FILE_NOT_WRITABLE " << outputPath << std::endl;
+		return 1;
+	}
+
+	static const char* formatNames[TEXTURE_FORMAT_COUNT] = { "rgba8", "bc1", "bc7" };
+	std::cout << "Cooked " << outputPath << ": " << header.width << "x" << header.height << ", " << header.faces
+		<< (header.faces == 1 ? " face, " : " faces, ") << header.mipCount << " mips, " << formatNames[format]
+		<< ", " << offset << " bytes" << std::endl;
+	return 0;
+}
+
+bool parseFormat(const std::string& name, uint32_t& format)
+{
+	if (name == "rgba8") format = TEXTURE_FORMAT_RGBA8;
+	else if (name == "bc1") format = TEXTURE_FORMAT_BC1;
+	else if (name == "bc7") format = TEXTURE_FORMAT_BC7;
+	else
+	{
+		std::cout << "Unknown texture format: " << name << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool loadImage(const std::string& path, Image& image)
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (!pixels)
+	{
+		std::cout << "ERROR::COOKER::IMAGE_NOT_LOADED " << path << ": " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+	image.width = (uint32_t)width;
+	image.height = (uint32_t)height;
+	image.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+	return true;
+}
+
+// sRGB <-> linear, colors are averaged in linear light so mips don't darken
+float toLinear(unsigned char value)
+{
+	float c = value / 255.0f;
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+unsigned char toSRGB(float linear)
+{
+	float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+	return (unsigned char)std::min(std::max(c * 255.0f + 0.5f, 0.0f), 255.0f);
+}
+
+// next mip level, 2x2 box filter
+Image downsample(const Image& source)
+{
+	static float linear[256];
+	static bool tableReady = false;
+	if (!tableReady)
+	{
+		for (int i = 0; i < 256; i++) linear[i] = toLinear((unsigned char)i);
+		tableReady = true;
+	}
+
+	Image result;
+	result.width = std::max(1u, source.width / 2);
+	result.height = std::max(1u, source.height / 2);
+	result.pixels.resize((size_t)result.width * result.height * 4);
+	for (uint32_t y = 0; y < result.height; y++)
+	{
+		for (uint32_t x = 0; x < result.width; x++)
+		{
+			const unsigned char* texels[4] = {
+				source.texel(2 * x, 2 * y), source.texel(2 * x + 1, 2 * y),
+				source.texel(2 * x, 2 * y + 1), source.texel(2 * x + 1, 2 * y + 1)
+			};
+			unsigned char* out = &result.pixels[((size_t)y * result.width + x) * 4];
+			for (int c = 0; c < 3; c++)
+			{
+				float sum = 0.0f;
+				for (const unsigned char* texel : texels) sum += linear[texel[c]];
+				out[c] = toSRGB(sum * 0.25f);
+			}
+			int alpha = 0;
+			for (const unsigned char* texel : texels) alpha += texel[3];
+			out[3] = (unsigned char)((alpha + 2) / 4);
+		}
+	}
+	return result;
+}
+
+void encodeLevel(const Image& image, uint32_t format, std::vector<unsigned char>& out)
+{
+	out.resize((size_t)textureLevelSize(format, image.width, image.height));
+	if (format == TEXTURE_FORMAT_RGBA8)
+	{
+		std::memcpy(out.data(), image.pixels.data(), out.size());
+		return;
+	}
+
+	size_t blockBytes = format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+	unsigned char* block = out.data();
+	for (uint32_t by = 0; by < image.height; by += 4)
+	{
+		for (uint32_t bx = 0; bx < image.width; bx += 4)
+		{
+			unsigned char texels[16][4];
+			for (int i = 0; i < 16; i++) std::memcpy(texels[i], image.texel(bx + i % 4, by + i / 4), 4);
+			if (format == TEXTURE_FORMAT_BC1) encodeBC1(texels, block);
+			else encodeBC7(texels, block);
+			block += blockBytes;
+		}
+	}
+}
+
+// principal axis of the block's colors through their mean, the line both encoders fit endpoints to
+void fitLine(const unsigned char block[16][4], int channels, float mean[4], float axis[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		mean[c] = 0.0f;
+		for (int i = 0; i < 16; i++) mean[c] += block[i][c];
+		mean[c] /= 16.0f;
+	}
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++) covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+		}
+	}
+	// power iteration from the diagonal of the bounding box
+	for (int c = 0; c < 4; c++) axis[c] = c < channels ? 1.0f : 0.0f;
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+		}
+		float length = 0.0f;
+		for (int c = 0; c < channels; c++) length = std::max(length, std::fabs(next[c]));
+		if (length == 0.0f) break; // flat block, any axis works
+		for (int c = 0; c < channels; c++) axis[c] = next[c] / length;
+	}
+}
+
+// the colors at the two ends of the block's extent along the fitted line
+void fitEndpoints(const unsigned char block[16][4], int channels, float low[4], float high[4])
+{
+	float mean[4], axis[4];
+	fitLine(block, channels, mean, axis);
+	float minT = 0.0f, maxT = 0.0f, lengthSquared = 0.0f;
+	for (int c = 0; c < channels; c++) lengthSquared += axis[c] * axis[c];
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++) t += (block[i][c] - mean[c]) * axis[c];
+		t = lengthSquared > 0.0f ? t / lengthSquared : 0.0f;
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	for (int c = 0; c < 4; c++)
+	{
+		low[c] = std::min(std::max(mean[c] + minT * axis[c], 0.0f), 255.0f);
+		high[c] = std::min(std::max(mean[c] + maxT * axis[c], 0.0f), 255.0f);
+	}
+}
+
+// picks the closest palette entry for every texel, returns the total squared error
+int assignIndices(const unsigned char block[16][4], const int palette[][4], int paletteSize, int channels, int indices[16])
+{
+	int total = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int bestError = 1 << 30;
+		for (int p = 0; p < paletteSize; p++)
+		{
+			int error = 0;
+			for (int c = 0; c < channels; c++)
+			{
+				int d = block[i][c] - palette[p][c];
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+		total += bestError;
+	}
+	return total;
+}
+
+// least-squares endpoints for fixed indices; weights[p] is how far palette entry p lies from low to high
+bool refineEndpoints(const unsigned char block[16][4], const int indices[16], const float weights[], float low[4], float high[4])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float t = weights[indices[i]], s = 1.0f - t;
+		aa += s * s; ab += s * t; bb += t * t;
+		for (int c = 0; c < 4; c++)
+		{
+			ax[c] += s * block[i][c];
+			bx[c] += t * block[i][c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f) return false; // every texel uses the same entry
+	for (int c = 0; c < 4; c++)
+	{
+		low[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		high[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+// BC1: two RGB565 endpoints and a 2-bit index per texel, always in 4-color mode
+void encodeBC1(const unsigned char block[16][4], unsigned char out[8])
+{
+	static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	auto to565 = [](const float color[4])
+	{
+		int r = (int)(color[0] * 31.0f / 255.0f + 0.5f), g = (int)(color[1] * 63.0f / 255.0f + 0.5f), b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	};
+
+	float endpoint0[4], endpoint1[4];
+	fitEndpoints(block, 3, endpoint1, endpoint0);
+	int bestError = 1 << 30;
+	uint16_t bestColors[2] = {};
+	uint32_t bestBits = 0;
+	// fit a line, then refine the endpoints against the indices the first fit produced
+	for (int pass = 0; pass < 2; pass++)
+	{
+		uint16_t colors[2] = { to565(endpoint0), to565(endpoint1) };
+		if (colors[0] < colors[1]) std::swap(colors[0], colors[1]); // color0 > color1 selects the 4-color palette
+
+		int palette[4][4] = {};
+		for (int e = 0; e < 2; e++)
+		{
+			int r = (colors[e] >> 11) & 31, g = (colors[e] >> 5) & 63, b = colors[e] & 31;
+			palette[e][0] = (r << 3) | (r >> 2);
+			palette[e][1] = (g << 2) | (g >> 4);
+			palette[e][2] = (b << 3) | (b >> 2);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		int indices[16];
+		int error = assignIndices(block, palette, 4, 3, indices);
+		// equal endpoints would switch the decoder to 3-color mode; index 0 is right for every texel then
+		if (colors[0] == colors[1]) std::fill(indices, indices + 16, 0);
+		if (error < bestError)
+		{
+			bestError = error;
+			bestColors[0] = colors[0];
+			bestColors[1] = colors[1];
+			bestBits = 0;
+			for (int i = 0; i < 16; i++) bestBits |= (uint32_t)indices[i] << (2 * i);
+		}
+		if (!refineEndpoints(block, indices, weights, endpoint0, endpoint1)) break;
+	}
+	out[0] = bestColors[0] & 0xFF; out[1] = bestColors[0] >> 8;
+	out[2] = bestColors[1] & 0xFF; out[3] = bestColors[1] >> 8;
+	for (int i = 0; i < 4; i++) out[4 + i] = (bestBits >> (8 * i)) & 0xFF;
+}
+
+// BC7 mode 6: one subset, RGBA 7-bit endpoints with a p-bit each, 4-bit indices
+void encodeBC7(const unsigned char block[16][4], unsigned char out[16])
+{
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	static float refineWeights[16];
+	for (int i = 0; i < 16; i++) refineWeights[i] = weights[i] / 64.0f;
+
+	float targets[2][4];
+	fitEndpoints(block, 4, targets[0], targets[1]);
+	int bestError = 1 << 30;
+	int endpoints[2][4], pbits[2], indices[16];
+	// fit a line, then refine the endpoints against the indices the first fit produced
+	for (int pass = 0; pass < 2; pass++)
+	{
+		// quantize each endpoint to 7 bits plus the shared p-bit that fits it best
+		int passEndpoints[2][4], passPbits[2] = {};
+		for (int e = 0; e < 2; e++)
+		{
+			float bestEndpointError = 1e30f;
+			for (int p = 0; p < 2; p++)
+			{
+				int quantized[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					quantized[c] = std::min(std::max((int)std::floor((targets[e][c] - p) / 2.0f + 0.5f), 0), 127);
+					float d = targets[e][c] - ((quantized[c] << 1) | p);
+					error += d * d;
+				}
+				if (error < bestEndpointError)
+				{
+					bestEndpointError = error;
+					passPbits[e] = p;
+					std::memcpy(passEndpoints[e], quantized, sizeof(quantized));
+				}
+			}
+		}
+
+		int palette[16][4];
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = (passEndpoints[0][c] << 1) | passPbits[0], e1 = (passEndpoints[1][c] << 1) | passPbits[1];
+			for (int i = 0; i < 16; i++) palette[i][c] = ((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6;
+		}
+		int passIndices[16];
+		int error = assignIndices(block, palette, 16, 4, passIndices);
+		if (error < bestError)
+		{
+			bestError = error;
+			std::memcpy(endpoints, passEndpoints, sizeof(endpoints));
+			std::memcpy(pbits, passPbits, sizeof(pbits));
+			std::memcpy(indices, passIndices, sizeof(indices));
+		}
+		if (!refineEndpoints(block, passIndices, refineWeights, targets[0], targets[1])) break;
+	}
+
+	// the first texel's index is stored without its top bit, so it must be below 8
+	if (indices[0] >= 8)
+	{
+		std::swap(endpoints[0], endpoints[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+	}
+
+	std::memset(out, 0, 16);
+	unsigned int position = 0;
+	auto write = [&](uint32_t value, unsigned int bits)
+	{
+		for (unsigned int b = 0; b < bits; b++, position++)
+		{
+			if (value & (1u << b)) out[position / 8] |= (unsigned char)(1u << (position % 8));
+		}
+	};
+	write(1u << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++)
+	{
+		write(endpoints[0][c], 7);
+		write(endpoints[1][c], 7);
+	}
+	write(pbits[0], 1);
+	write(pbits[1], 1);
+	write(indices[0], 3);
+	for (int i = 1; i < 16; i++) write(indices[i], 4);
+}
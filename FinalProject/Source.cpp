@@ -1,46 +1,170 @@
-#include <glad/glad.h>
+﻿#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "shaderreload.h"
+#include "mesh.h"
+#include "geometry.h"
+#include "lod.h"
+#include "meshimport.h"
+#include "benchmark.h"
+#include "camerapath.h"
+#include "uniforms.h"
+#include "transforms.h"
+#include "instancing.h"
+#include "threadpool.h"
+#include "assets.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "shadows.h"
+#include "permutations.h"
+#include "clusters.h"
+#include "renderqueue.h"
+#include "profiler.h"
+#include "streambuffer.h"
+#include "framepacing.h"
 
 #include <iostream>
 #include <cmath>
 #include <math.h>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 #define STB_IMAGE_IMPLEMENTATION // turns .h file to .cpp file
+#define STBI_THREAD_LOCAL thread_local // images are decoded on several workers at once, each needs its own failure reason
 #include <stb_image.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 // functions
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void updateCameraFront();
 
 // structs
 /// <summary>
-/// Struct containing data about a vertex
+/// Command line options
 /// </summary>
-struct Vertex
+struct Options
 {
-	GLfloat x, y, z;	// Position
-	GLubyte r, g, b;	// Color
-	GLfloat nx, ny, nz;	// normal vectors
+	bool headless = false;					// --headless: offscreen context, no window or input
+	unsigned int frames = 500;				// --frames N: frames to render in headless mode
+	unsigned int warmupFrames = 10;			// --warmup N: frames excluded from the report
+	std::string reportPath = "benchmark.json";	// --report PATH
+	std::string recordPath;					// --record PATH: save the camera path on exit
+	std::string replayPath;					// --replay PATH: play a recorded camera path back
+	float timestep = 1.0f / 60.0f;			// --timestep S: fixed frame time for headless and replay runs
+	std::string compareBase, compareCandidate;	// --compare BASE NEW: diff two benchmark reports and exit
+	double regressionThreshold = 5.0;		// --threshold PCT: slowdown that counts as a regression
+	bool instancing = false;				// --instancing: one instanced draw per mesh per pass
+	unsigned int extraCubes = 0;			// --cubes N: add a grid of N small cubes to the scene
+	VertexFormat vertexFormat = VERTEX_FORMAT_PACKED;	// --vertex-format float|packed|half
+	std::string shaderCacheDirectory = "shadercache";	// --shader-cache DIR|none: linked program binaries
+	bool culling = true;					// --no-culling: draw every object in every pass
+	bool hotReload = true;					// --no-hot-reload: don't watch shader sources (always off headless and on replay)
+	unsigned int shadowCascades = 3;		// --cascades N: shadow map cascades, 1 to MAX_SHADOW_CASCADES
+	float cascadeSplitLambda = 0.75f;		// --cascade-split L: 0 = uniform splits, 1 = logarithmic
+	unsigned int shadowMapSize = 1024;		// --shadow-size N: resolution of each cascade
+	float shadowDistance = 50.0f;			// --shadow-distance D: how far from the camera shadows reach
+	bool shadowCache = true;				// --no-shadow-cache: re-render every cascade every frame
+	ShadowFilter shadowFilter = SHADOW_FILTER_PCF;	// --shadow-filter pcf|poisson|vsm|esm
+	unsigned int shadowKernel = 3;			// --shadow-kernel N: taps per side (PCF, Poisson) or blur radius (VSM, ESM)
+	bool shadows = true;					// --no-shadows
+	bool pointLight = true;					// --no-point-light
+	bool directionalLight = true;			// --no-directional-light, also turns shadows off
+	bool specular = true;					// --no-specular
+	bool prewarmShaders = true;				// --lazy-shaders: build shader variants on first use instead of at startup
+	unsigned int movingCubes = 0;			// --moving-cubes N: the first N extra cubes bob up and down
+	unsigned int pointLights = 1;			// --lights N: point lights, the first is the scene's original one
+	bool depthPrepass = false;				// --depth-prepass: lay down depth first so every pixel is shaded once
+	bool profile = false;					// --profile: time every pass on the GPU
+	std::string tracePath = "trace.json";	// --trace PATH: capture frames after warm-up into a Chrome trace, F12 captures in a window
+	bool trace = false;
+	unsigned int traceFrames = 60;			// --trace-frames N: frames per capture
+	unsigned int workers = 0;				// --workers N: job system threads, 0 = one per hardware thread but this one
+	bool pipeline = true;					// --no-pipeline: prepare every frame before drawing it instead of during the previous one
+	bool workerSweep = false;				// --worker-sweep: time frame preparation with 1, 2, 4 and 8 workers after the run
+	unsigned int streamFrames = 3;			// --stream-frames N: frames the stream buffer keeps in flight, 2 to MAX_STREAM_FRAMES
+	bool persistentMapping = true;			// --no-persistent-map: stream through unsynchronized mapping even with buffer storage
+	bool multiDraw = true;					// --no-multi-draw: a base-vertex draw per packet even where multi-draw indirect is available
+	std::string modelPath;					// --model PATH: an OBJ or glTF model on the floor, cached next to it as PATH.cmesh
+	unsigned int importBenchmark = 0;		// --import-benchmark N: time importing a synthetic N-triangle OBJ, cold and from its cache
+	bool lod = true;						// --no-lod: always draw imported models at full detail
+	float lodPixels = 1.0f;					// --lod-error PX: how far a level of detail may stray on screen or in the shadow map
+	OcclusionMode occlusion = OCCLUSION_RASTER;	// --occlusion off|hiz|raster: what hides objects from the camera besides its frustum
+	int swapInterval = 1;					// --swap-interval N: vertical blanks per swap, 0 = no vsync, -1 = adaptive where the driver has it
+	double fpsCap = 0.0;					// --fps-cap N: frames per second to hold to, 0 = uncapped
+	bool lowLatency = false;				// --low-latency: every frame is prepared right after its input is read and drawn before the next is read
 };
 
+/// <summary>
+/// Drawable object: a transform in the TransformStore plus the mesh drawn with it
+/// </summary>
+struct SceneObject
+{
+	unsigned int transform;	// index into the transform store
+	const Mesh* mesh;
+	unsigned int batch;		// instance batch drawing this object in instanced mode
+	bool dynamic;			// moves after the first frame, kept out of the cached static shadows
+	const OccluderMesh* occluder = NULL;	// drawn into the occlusion buffer in raster mode
+};
+
+/// <summary>
+/// Everything one frame is drawn from, prepared on the job system while the render thread draws the
+/// frame before; there are two, taking turns
+/// </summary>
+struct FrameState
+{
+	// set by the render thread before the frame is prepared
+	unsigned int number = 0;
+	float sceneTime = 0.0f;
+	glm::vec3 cameraPos, cameraFront, cameraUp;
+	unsigned int width = 0, height = 0;
+	Shader* receiverShader = NULL;	// scene variants with and without shadow lookups
+	Shader* plainShader = NULL;
+	Shader* depthShader = NULL;		// depth pre-pass, if there is one
+
+	// prepared
+	FrameUniforms uniforms = {};
+	ShadowUniforms shadows = {};
+	std::vector<glm::mat4> world;			// transform store snapshot, indexed like it
+	std::vector<glm::mat3> normal;
+	std::vector<unsigned int> rebuilt;		// transforms that moved since the frame before
+	std::vector<unsigned int> mainVisible, shadowVisible[MAX_SHADOW_CASCADES];
+	std::vector<uint8_t> mainLod, shadowLod[MAX_SHADOW_CASCADES];	// level of detail of every scene object, for the camera and each cascade
+	CullStats mainCull, shadowCull;
+	FrameClock::Clock::time_point inputTime;	// when the input the camera comes from was read
+	std::vector<float> depthHistory;		// hiz occlusion: the newest depths read back and the camera they were rendered with
+	unsigned int depthHistoryWidth = 0, depthHistoryHeight = 0;
+	glm::mat4 depthHistoryViewProjection = glm::mat4(1.0f);
+	std::vector<AABB> depthHistoryDynamic;	// where the moving objects were in it
+	unsigned int occluders = 0;				// raster occlusion: occluders drawn
+	double occlusionMs = 0.0;
+	LightClusterLists lightClusters;
+	RenderQueue sceneQueue;					// the camera's packets
+	double prepareMs = 0.0;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options);
+
 // window size variables
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+unsigned int scrWidth = SCR_WIDTH;		// overridable with --width / --height
+unsigned int scrHeight = SCR_HEIGHT;
 
 // camera movement variables
 glm::vec3 cameraPos = glm::vec3(0.0f, 1.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 float deltaTime = 0.0f; // for creating uniform speed across different machines
-float lastFrame = 0.0f;
 
 float pitch = 0.0f;
 float yaw = -90.0f;
@@ -48,16 +172,46 @@ float mouseLastXPos = 400.0f;
 float mouseLastYPos = 300.0f;
 bool firstMouseEnter = true;
 
-int main()
+int main(int argc, char* argv[])
 {
+	Options options;
+	if (!parseOptions(argc, argv, options)) return -1;
+
+	// report comparison doesn't need a context
+	if (!options.compareBase.empty())
+	{
+		return Benchmark::compareReports(options.compareBase, options.compareCandidate, options.regressionThreshold) ? 0 : 1;
+	}
+
+	// camera path recording / replay
+	CameraPath cameraPath;
+	bool recording = !options.recordPath.empty();
+	bool replaying = !options.replayPath.empty();
+	if (replaying && !cameraPath.load(options.replayPath)) return -1;
+	// headless and replay runs advance time by a fixed step so every run renders the same frames
+	bool fixedTimestep = options.headless || replaying;
+	float sceneTime = 0.0f; // drives the animation and time uniforms, from the frame clock or the fixed step
+
 	// glfw: initialize and configure
+	if (options.headless)
+	{
+#ifdef GLFW_PLATFORM_NULL
+		// no display server needed; the null platform only supports OSMesa contexts (Mesa llvmpipe)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+	}
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (options.headless)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
 
 	// glfw window creation
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Programming Exercise 1", NULL, NULL);
+	GLFWwindow* window = glfwCreateWindow(scrWidth, scrHeight, "Programming Exercise 1", NULL, NULL);
 	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window" << std::endl;
@@ -65,11 +219,14 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback); // set cursor to mouse calculatios
+	if (!options.headless)
+	{
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback); // set cursor to mouse calculatios
 
-	// configuring mouse input for camera 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // hides bouse and keeps at center
+		// configuring mouse input for camera 
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // hides bouse and keeps at center
+	}
 
 	// glad: load all OpenGL function pointers
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -78,13 +235,71 @@ int main()
 		return -1;
 	}
 
+	// vsync; adaptive swaps right away when a frame misses its vertical blank instead of waiting for the next
+	if (!options.headless)
+	{
+		int swapInterval = options.swapInterval;
+		if (swapInterval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			std::cout << "ERROR::SWAP::ADAPTIVE_VSYNC_NOT_SUPPORTED using a swap interval of 1" << std::endl;
+			swapInterval = 1;
+		}
+		glfwSwapInterval(swapInterval);
+	}
+
 	// enabling depth test to avoid drawing overlaps
 	glEnable(GL_DEPTH_TEST);
+	// filter across cube map face edges, visible on the skybox's smaller mips
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	// every run of draws sharing their state goes out as one multi-draw where the driver has it;
+	// the per-object matrices then come in as instance attributes, which the INSTANCED variants read
+	MultiDrawElementsIndirectProc multiDrawIndirect = options.multiDraw ? loadMultiDrawIndirect((StreamBuffer::LoadProc)glfwGetProcAddress) : NULL;
+	bool instancedShaders = options.instancing || multiDrawIndirect;
+
+	// images are decoded on the job system and uploaded on this thread, frames are prepared on it too
+	ThreadPool threadPool(options.workers);
+	AssetLoader assets(threadPool);
 
 	// creating shader program
-	Shader ourShader("source.vsh", "source.fsh");
-	Shader shadowShader("shadowMapper.vsh", "shadowMapper.fsh");
+	Shader::cacheDirectory = options.shaderCacheDirectory;
+	Shader::initBinaryCache((Shader::LoadProc)glfwGetProcAddress);
+	Benchmark::Clock::time_point shaderStart = Benchmark::Clock::now();
 	Shader skyboxShader("skybox.vsh", "skybox.fsh");
+	Shader shadowMomentsShader("fullscreen.vsh", "shadowMoments.fsh");
+	Shader shadowBlurShader("fullscreen.vsh", "shadowBlur.fsh");
+	Shader occlusionDepthShader("fullscreen.vsh", "occlusionDepth.fsh");
+
+	// the scene and shadow programs are specialised per feature set; the options pick the full set,
+	// objects beyond the reach of the shadows drop the shadow lookups
+	ShaderPermutations mainShaders("source.vsh", "source.fsh");
+	ShaderPermutations shadowShaders("shadowMapper.vsh", "shadowMapper.fsh");
+	// the depth pre-pass runs the scene's vertex shader, so its depths match exactly, with the empty shadow fragment shader
+	ShaderPermutations depthShaders("source.vsh", "shadowMapper.fsh");
+	uint32_t mainFeatures = shadowFilterFeatures(options.shadowFilter, options.shadowKernel);
+	if (options.pointLight) mainFeatures |= FEATURE_POINT_LIGHT;
+	if (options.directionalLight) mainFeatures |= FEATURE_DIRECTIONAL_LIGHT;
+	if (options.directionalLight && options.shadows) mainFeatures |= FEATURE_SHADOWS;
+	if (options.specular) mainFeatures |= FEATURE_SPECULAR;
+	if (instancedShaders) mainFeatures |= FEATURE_INSTANCED;
+	uint32_t shadowFeatures = instancedShaders ? (uint32_t)FEATURE_INSTANCED : 0u;
+	if (options.prewarmShaders)
+	{
+		mainShaders.prewarm({ mainFeatures, mainFeatures & ~(uint32_t)FEATURE_SHADOWS });
+		if (mainFeatures & FEATURE_SHADOWS) shadowShaders.prewarm({ shadowFeatures });
+		if (options.depthPrepass) depthShaders.prewarm({ shadowFeatures });
+	}
+	double shaderStartupMs = std::chrono::duration<double, std::milli>(Benchmark::Clock::now() - shaderStart).count();
+	if (Shader::cacheEnabled())
+	{
+		std::cout << "Shader programs ready in " << shaderStartupMs << " ms (" << Shader::cacheHits << " from cache, "
+			<< Shader::cacheMisses << " compiled)" << std::endl;
+	}
+	else
+	{
+		std::cout << "Shader programs ready in " << shaderStartupMs << " ms (cache "
+			<< (Shader::cacheAvailable ? "disabled" : "unavailable") << ")" << std::endl;
+	}
 
 	Vertex cubeVertices[36];
 	// data points
@@ -197,60 +412,25 @@ int main()
 		 0.5f, -0.5f,  0.5f
 	};
 
-	// creating cubeVAO, cubeVBO
-	unsigned int cubeVAO, cubeVBO;
-	glGenVertexArrays(1, &cubeVAO); // creating vertex array object
-	glGenBuffers(1, &cubeVBO); // creating vertex buffer object
-	glBindVertexArray(cubeVAO); // VAO must be binded before VBO
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-	// defining how OpenGL should interpret the data
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x)); // position
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offsetof(Vertex, r))); // color
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, nx))); // normal
-	// unbind cubeVBO
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	// creating planeVAO, planeVBO
-	unsigned int planeVAO, planeVBO;
-	glGenVertexArrays(1, &planeVAO); // creating vertex array object
-	glGenBuffers(1, &planeVBO); // creating vertex buffer object
-	glBindVertexArray(planeVAO); // VAO must be binded before VBO
-	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-	// defining how OpenGL should interpret the data
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x)); // position
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offsetof(Vertex, r))); // color
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, nx))); // normal
-	// unbind planeVBO
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	// creating skyboxVAO, skyboxVBO
-	unsigned int skyboxVAO, skyboxVBO;
-	glGenVertexArrays(1, &skyboxVAO); // creating vertex array object
-	glGenBuffers(1, &skyboxVBO); // creating vertex buffer object
-	glBindVertexArray(skyboxVAO); // VAO must be binded here before VBO
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
-	// defining how OpenGL should interpret the data
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0); // position
-	// unbind planeVBO
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	// deduplicated into indexed meshes, triangles reordered for the vertex cache, all in one vertex and
+	// index buffer; the cube and the plane share a layout and so a vertex array
+	GeometryArena geometry;
+	geometry.create(256 * 1024, 64 * 1024);
+	Mesh cubeMesh = createMesh(geometry, "cube", buildIndexedMesh(cubeVertices, 36), 36, sizeof(Vertex), options.vertexFormat);
+	Mesh planeMesh = createMesh(geometry, "plane", buildIndexedMesh(planeVertices, 6), 6, sizeof(Vertex), options.vertexFormat);
+	Mesh skyboxMesh = createMesh(geometry, "skybox", buildIndexedMesh(skyboxVertices, 36), 36, 3 * sizeof(GLfloat), options.vertexFormat);
+	// the cube and the plane occlude in raster mode, models don't: their levels of detail aren't conservative
+	OccluderMesh cubeOccluder = occluderMesh(buildIndexedMesh(cubeVertices, 36));
+	OccluderMesh planeOccluder = occluderMesh(buildIndexedMesh(planeVertices, 6));
+	// an imported model goes through its cooked cache when that's current
+	Mesh modelMesh;
+	MeshImportStats modelImport;
+	bool hasModel = !options.modelPath.empty() && loadModel(geometry, options.modelPath, options.vertexFormat, modelMesh, modelImport);
+	std::cout << "Geometry arena: " << geometry.bytesUsed() << " of " << geometry.vertexBufferSize() + geometry.indexBufferSize()
+		<< " bytes used, " << geometry.vertexArrayCount() << " vertex arrays, "
+		<< (multiDrawIndirect ? "multi-draw indirect" : "base-vertex draws") << std::endl;
 
 	// SKYBOX
-	unsigned int skyboxTexture;
-	int skyboxImageWidth, skyboxImageHeight, nrChannels;
-	
 	//std::vector<std::string> skyboxFaces
 	std::string skyboxFaces[6]
 	{
@@ -262,364 +442,1240 @@ int main()
 		"back.jpg"
 	};
 
-	glGenTextures(1, &skyboxTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-	for (unsigned int i = 0; i < (sizeof(skyboxFaces)/sizeof(*skyboxFaces)); i++)
+	// the cooked skybox (built by the Cooker project) maps in with its mips and needs no decoding;
+	// without it the faces are decoded on the thread pool and the skybox is a flat sky color until they're uploaded
+	unsigned int skyboxTexture = assets.loadCookedTexture("skybox.ctex");
+	if (!skyboxTexture)
 	{
-		unsigned char* data = stbi_load(skyboxFaces[i].c_str(), &skyboxImageWidth, &skyboxImageHeight, &nrChannels, 0);
-		if (data)
-		{
-			glTexImage2D(
-				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, //cubemap has 6 faces and can be incremented like enum 
-				0, GL_RGB, skyboxImageWidth, skyboxImageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-			);
-		}
-		else
-		{
-			std::cout << "Cubemap failed to load." << std::endl;
-		}
-		stbi_image_free(data);
+		const unsigned char skyPlaceholder[3] = { 135, 170, 210 };
+		skyboxTexture = assets.loadCubemap(skyboxFaces, skyPlaceholder);
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
 
 	// SHADOWS
-	// generating framebuffer for depth map
-	unsigned int shadowMapFBO;
-	glGenFramebuffers(1, &shadowMapFBO);
+	// one depth layer per cascade, each covering a slice of the camera's view
+	CascadedShadowMap shadowMap;
+	shadowMap.splitLambda = options.cascadeSplitLambda;
+	shadowMap.shadowDistance = options.shadowDistance;
+	shadowMap.caching = options.shadowCache;
+	shadowMap.filter = options.shadowFilter;
+	shadowMap.kernel = options.shadowKernel;
+	shadowMap.create(options.shadowCascades, options.shadowMapSize);
+
+	// OFFSCREEN TARGET
+	// headless runs render the main and skybox passes into this instead of the default framebuffer
+	unsigned int mainFBO = 0, mainColorRBO = 0, mainDepthRBO = 0;
+	if (options.headless)
+	{
+		glGenFramebuffers(1, &mainFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, mainFBO);
 
-	// creating 2D texture for the fbo shadow/depth buffer
-	const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-	unsigned int shadowMap;
-	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glGenRenderbuffers(1, &mainColorRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, mainColorRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, scrWidth, scrHeight);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mainColorRBO);
 
-	// attach shadow texture to fbo depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGenRenderbuffers(1, &mainDepthRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, mainDepthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, scrWidth, scrHeight);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mainDepthRBO);
 
-	// check if fbo is okay
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Error! Offscreen framebuffer not complete!" << std::endl;
+		}
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// frame-time benchmark; each pass ends with glFinish so its GPU work lands in its own bucket
+	Benchmark benchmark;
+	benchmark.enabled = options.headless;
+	benchmark.warmupFrames = options.warmupFrames;
+	benchmark.addMetric("shader_startup_ms", shaderStartupMs);
+	// hits only mean something with the cache on; without it every program was compiled
+	benchmark.addMetric("shader_cache_available", Shader::cacheAvailable ? 1.0 : 0.0);
+	if (Shader::cacheEnabled()) benchmark.addMetric("shader_cache_hits", Shader::cacheHits);
+	benchmark.label = std::string(options.instancing ? "instanced" : "per-draw") + ", " + std::to_string(options.extraCubes) + " extra cubes"
+		+ (options.culling ? "" : ", no culling") + ", " + std::to_string(shadowMap.cascadeCount) + " cascades"
+		+ " " + shadowFilterNames[shadowMap.filter] + " " + std::to_string(shadowMap.kernel)
+		+ (options.shadowCache ? "" : ", no shadow cache") + ", features " + std::to_string(mainFeatures) + (options.movingCubes ? ", " + std::to_string(options.movingCubes) + " moving" : "")
+		+ ", " + std::to_string(options.pointLights) + " point lights" + (options.depthPrepass ? ", depth pre-pass" : "")
+		+ ", " + std::to_string(threadPool.size()) + " workers" + (options.pipeline ? "" : ", not pipelined")
+		+ (multiDrawIndirect ? ", multi-draw indirect" : "")
+		+ (options.culling && options.occlusion != OCCLUSION_OFF ? std::string(", ") + occlusionModeNames[options.occlusion] + " occlusion" : "");
+	unsigned int framesRendered = 0;
+
+	// mesh import throughput on a synthetic model: parsed cold, then loaded again from the cache that left
+	if (options.importBenchmark)
+	{
+		std::string importPath = "import_benchmark.obj";
+		std::remove((importPath + ".cmesh").c_str());
+		Mesh imported;
+		MeshImportStats cold, cached;
+		if (writeSyntheticObj(importPath, options.importBenchmark) && loadModel(geometry, importPath, options.vertexFormat, imported, cold))
+		{
+			geometry.remove(imported);
+			if (loadModel(geometry, importPath, options.vertexFormat, imported, cached)) geometry.remove(imported);
+			benchmark.addMetric("import_mb_per_s", cold.sourceBytes / (1024.0 * 1024.0) / (cold.parseMs / 1000.0));
+			benchmark.addMetric("import_triangles_per_s", cold.triangles / (cold.parseMs / 1000.0));
+			benchmark.addMetric("import_peak_mb", cold.peakBytes / (1024.0 * 1024.0));
+			benchmark.addMetric("import_optimize_ms", cold.optimizeMs);
+			if (cached.fromCache) benchmark.addMetric("mesh_cache_load_ms", cached.uploadMs);
+			std::cout << "Import benchmark: " << cold.triangles << " triangles, " << cold.parseMs + cold.optimizeMs + cold.cacheWriteMs + cold.uploadMs
+				<< " ms cold, " << (cached.fromCache ? std::to_string(cached.uploadMs) + " ms" : std::string("no cache")) << " cached" << std::endl;
+		}
+		std::remove(importPath.c_str());
+		std::remove((importPath + ".cmesh").c_str());
+	}
+
+	// binds samplers and uniform blocks of one program; runs again whenever a program is hot-reloaded
+	auto configureProgram = [&](Shader& shader)
+	{
+		// samplers read from texture unit 0, except the shadow moments which sit next to the shadow map
+		// and the light cluster buffers after them
+		shader.use();
+		shader.setInt("skyboxTex", 0);
+		shader.setInt("shadowMapTexture", 0);
+		shader.setInt("shadowMomentsTexture", 1);
+		shader.setInt("pointLightTexture", 2);
+		shader.setInt("lightClusterTexture", 3);
+		shader.setInt("lightIndexTexture", 4);
+
+		// uniform blocks shared by all programs
+		shader.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+		shader.bindUniformBlock("LightData", LIGHT_BLOCK_BINDING);
+		shader.bindUniformBlock("ShadowData", SHADOW_BLOCK_BINDING);
+		shader.bindUniformBlock("ClusterData", CLUSTER_BLOCK_BINDING);
+		shader.bindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+	};
+	auto allPrograms = [&]()
+	{
+		std::vector<Shader*> programs = { &skyboxShader, &shadowMomentsShader, &shadowBlurShader, &occlusionDepthShader };
+		for (Shader* variant : mainShaders.all()) programs.push_back(variant);
+		for (Shader* variant : shadowShaders.all()) programs.push_back(variant);
+		for (Shader* variant : depthShaders.all()) programs.push_back(variant);
+		return programs;
+	};
+	auto configurePrograms = [&]()
+	{
+		for (Shader* shader : allPrograms()) configureProgram(*shader);
+	};
+	configurePrograms();
+	UniformBuffer frameUBO(FRAME_BLOCK_BINDING, sizeof(FrameUniforms));
+	UniformBuffer lightUBO(LIGHT_BLOCK_BINDING, sizeof(LightUniforms));
+	UniformBuffer shadowUBO(SHADOW_BLOCK_BINDING, sizeof(ShadowUniforms));
+	UniformBuffer clusterUBO(CLUSTER_BLOCK_BINDING, sizeof(ClusterUniforms));
+
+	// per-object uniforms and instance data are written into a ring the GPU reads from directly;
+	// it starts at 4 MB per frame and grows to fit
+	StreamBuffer streamBuffer;
+	streamBuffer.create(options.streamFrames, 4 * 1024 * 1024, options.persistentMapping, (StreamBuffer::LoadProc)glfwGetProcAddress);
+	benchmark.label += std::string(", ") + (streamBuffer.persistent ? "persistent" : "unsynchronized") + " stream buffer";
+
+	// edits to the shader sources are picked up while the program runs
+	ShaderReloader shaderReloader((ShaderReloader::LoadProc)glfwGetProcAddress);
+	bool watchShaders = options.hotReload && !options.headless && !replaying;
+	if (watchShaders)
 	{
-		std::cout << "Error! Framebuffer not complete!" << std::endl;
+		for (Shader* shader : allPrograms()) shaderReloader.watch(shader);
+		shaderReloader.start();
 	}
 
-	// activate skybox shader
-	skyboxShader.use();
-	glUniform1i(glGetUniformLocation(skyboxShader.ID, "skyboxTex"), 0);
+	// draws go through sorted queues; the state cache drops GL calls that wouldn't change anything
+	GLStateCache glState;
+	RenderQueue shadowQueue;
+	shadowQueue.multiDraw = multiDrawIndirect;
 
-	// activate main shader
-	ourShader.use();
+	// variants built later, on first use, get the same treatment
+	auto onVariantCreated = [&](Shader& shader)
+	{
+		configureProgram(shader);
+		glState.invalidate();
+		if (watchShaders) shaderReloader.watch(&shader);
+	};
+	mainShaders.onCreate = onVariantCreated;
+	shadowShaders.onCreate = onVariantCreated;
+	depthShaders.onCreate = onVariantCreated;
 
 	//===================
 	// LIGHTING UNIFORMS
 	//===================
+	// lights are static, so the block is uploaded once here instead of every frame
+	LightUniforms lights = {};
 	// light color
-		glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-		int lightColorLoc = glGetUniformLocation(ourShader.ID, "lightColor");
-		glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-
-	// point light uniforms
-		// point light position
-		glm::vec3 pointLightPos(4.0f, 4.0f, 2.0f);
-		int pointLightPosLoc = glGetUniformLocation(ourShader.ID, "pointLightPos");
-		glUniform3fv(pointLightPosLoc, 1, glm::value_ptr(pointLightPos));
-
-		// point light ambient intensity
-		glm::vec3 pointLightAmbientIntensity(0.2f, 0.2f, 0.2f);
-		int pointLightAmbientIntensityLoc = glGetUniformLocation(ourShader.ID, "pointLightAmbientIntensity");
-		glUniform3fv(pointLightAmbientIntensityLoc, 1, glm::value_ptr(pointLightAmbientIntensity));
-
-		// point light diffuse intensity
-		glm::vec3 pointLightDiffuseIntensity(1.0f, 1.0f, 1.0f);
-		int pointLightDiffuseIntensityLoc = glGetUniformLocation(ourShader.ID, "pointLightDiffuseIntensity");
-		glUniform3fv(pointLightDiffuseIntensityLoc, 1, glm::value_ptr(pointLightDiffuseIntensity));
-
-		// point light specular intensity
-		glm::vec3 pointLightSpecularIntensity(1.0f, 1.0f, 1.0f);
-		int pointLightSpecularIntensityLoc = glGetUniformLocation(ourShader.ID, "pointLightDiffuseIntensity");
-		glUniform3fv(pointLightSpecularIntensityLoc, 1, glm::value_ptr(pointLightSpecularIntensity));
-
-		// attenuation values
-			// constant
-			float pointLightConstant = 1.0f;
-			int pointLightConstantLoc = glGetUniformLocation(ourShader.ID, "pointLightConstant");
-			glUniform1f(pointLightConstantLoc, pointLightConstant);
-
-			// linear
-			float pointLightLinear = 0.7f;
-			int pointLightLinearLoc = glGetUniformLocation(ourShader.ID, "pointLightLinear");
-			glUniform1f(pointLightLinearLoc, pointLightLinear);
-
-			// quadratic
-			float pointLightQuadratic = 1.8f;
-			int pointLightQuadraticLoc = glGetUniformLocation(ourShader.ID, "pointLightQuadratic");
-			glUniform1f(pointLightQuadraticLoc, pointLightQuadratic);
-
-			// distance
-			float pointLightDistance = 7.0f;
-			int pointLightDistanceLoc = glGetUniformLocation(ourShader.ID, "pointLightDistance");
-			glUniform1f(pointLightDistanceLoc, pointLightDistance);
+		lights.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+
+	// point lights, binned into view clusters every frame
+		lights.pointLightAmbientIntensity = glm::vec3(0.2f, 0.2f, 0.2f);
+		ClusteredLights pointLights;
+		// the original light, with a range that covers the whole scene
+		pointLights.lights.push_back({ glm::vec3(4.0f, 4.0f, 2.0f), 30.0f, glm::vec3(1.0f, 1.0f, 1.0f), 1.0f });
+		// the rest are small coloured lights scattered over the floor, placed the same way every run
+		uint32_t lightSeed = 12345u;
+		auto nextRandom = [&lightSeed]()
+		{
+			lightSeed = lightSeed * 1664525u + 1013904223u;
+			return (lightSeed >> 8) / 16777216.0f;
+		};
+		for (unsigned int i = 1; i < options.pointLights; i++)
+		{
+			glm::vec3 position(nextRandom() * 20.0f - 10.0f, 0.3f + nextRandom() * 2.0f, nextRandom() * 20.0f - 10.0f);
+			float hue = nextRandom() * 6.0f;
+			glm::vec3 color = glm::clamp(glm::vec3(std::fabs(hue - 3.0f) - 1.0f, 2.0f - std::fabs(hue - 2.0f), 2.0f - std::fabs(hue - 4.0f)), glm::vec3(0.0f), glm::vec3(1.0f));
+			pointLights.lights.push_back({ position, 1.5f + nextRandom() * 2.5f, color, 0.5f });
+		}
+		pointLights.create();
 
 	// directional light uniforms
-		// directional light position
 		glm::vec3 directionalLightPos(-5.5f, 2.0f, -6.5f);
-		int directionalLightPosLoc = glGetUniformLocation(ourShader.ID, "directionalLightPos");
-		glUniform3fv(directionalLightPosLoc, 1, glm::value_ptr(directionalLightPos));
-
-		// directional light ambient intensity
-		glm::vec3 directionalLightAmbientIntensity(0.2f, 0.2f, 0.2f);
-		int directionalLightAmbientIntensityLoc = glGetUniformLocation(ourShader.ID, "directionalLightAmbientIntensity");
-		glUniform3fv(directionalLightAmbientIntensityLoc, 1, glm::value_ptr(directionalLightAmbientIntensity));
+		lights.directionalLightPos = directionalLightPos;
+		lights.directionalLightAmbientIntensity = glm::vec3(0.2f, 0.2f, 0.2f);
+		lights.directionalLightDiffuseIntensity = glm::vec3(1.0f, 1.0f, 1.0f);
+		lights.directionalLightSpecularIntensity = glm::vec3(1.0f, 1.0f, 1.0f);
 
-		// directional light diffuse intensity
-		glm::vec3 directionalLightDiffuseIntensity(1.0f, 1.0f, 1.0f);
-		int directionalLightDiffuseIntensityLoc = glGetUniformLocation(ourShader.ID, "directionalLightDiffuseIntensity");
-		glUniform3fv(directionalLightDiffuseIntensityLoc, 1, glm::value_ptr(directionalLightDiffuseIntensity));
+	lightUBO.update(&lights);
 
-		// directional light specular intensity
-		glm::vec3 directionalLightSpecularIntensity(1.0f, 1.0f, 1.0f);
-		int directionalLightSpecularIntensityLoc = glGetUniformLocation(ourShader.ID, "directionalLightSpecularIntensity");
-		glUniform3fv(directionalLightSpecularIntensityLoc, 1, glm::value_ptr(directionalLightSpecularIntensity));
+	//===================
+	//		SCENE
+	//===================
+	// matrices are rebuilt once per frame for objects that changed and read by both passes
+	TransformStore transforms;
+	std::vector<SceneObject> sceneObjects;
+	const glm::vec3 xAxis(1.0f, 0.0f, 0.0f), yAxis(0.0f, 1.0f, 0.0f);
+
+	// plane
+	sceneObjects.push_back({ transforms.add(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(20.0f, 0.0f, 20.0f)), &planeMesh, 0, false, &planeOccluder });
+	// cube 1
+	sceneObjects.push_back({ transforms.add(glm::vec3(0.0f, 2.0f, -2.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.5f)), &cubeMesh, 0, false, &cubeOccluder });
+	// cube 2
+	sceneObjects.push_back({ transforms.add(glm::vec3(-3.0f, 0.25f, 1.0f),
+		glm::angleAxis(glm::radians(50.0f), yAxis) * glm::angleAxis(glm::radians(180.0f), xAxis), glm::vec3(0.5f)), &cubeMesh, 0, false, &cubeOccluder });
+	// cube 3
+	sceneObjects.push_back({ transforms.add(glm::vec3(-4.5f, 0.5f, -4.5f), glm::angleAxis(glm::radians(-90.0f), yAxis), glm::vec3(1.0f)), &cubeMesh, 0, false, &cubeOccluder });
+	// imported model, scaled to about three units across and standing on the floor
+	if (hasModel)
+	{
+		glm::vec3 extent = modelMesh.boundsMax - modelMesh.boundsMin;
+		float scale = 3.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+		glm::vec3 base(0.5f * (modelMesh.boundsMin.x + modelMesh.boundsMax.x), modelMesh.boundsMin.y, 0.5f * (modelMesh.boundsMin.z + modelMesh.boundsMax.z));
+		sceneObjects.push_back({ transforms.add(glm::vec3(3.0f, 0.0f, 3.0f) - scale * base, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(scale)), &modelMesh, 0, false, NULL });
+	}
 
-	// The Rendering Loop
-	while (!glfwWindowShouldClose(window))
+	// extra cubes for stress testing, laid out on a square grid centered on the origin
+	unsigned int gridSize = (unsigned int)std::ceil(std::sqrt((float)options.extraCubes));
+	std::vector<glm::vec3> movingCubeRest;	// where each moving cube bobs around, they're the first extra cubes
+	unsigned int firstMovingCube = (unsigned int)sceneObjects.size();
+	for (unsigned int i = 0; i < options.extraCubes; i++)
 	{
-		// camera calculations
-		float currentFrame = glfwGetTime(); // movement speed calculations
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-		int eyePosLoc = glGetUniformLocation(ourShader.ID, "eyePos");
-		glUniformMatrix3fv(eyePosLoc, 1, GL_FALSE, glm::value_ptr(cameraPos));
+		glm::vec3 position((i % gridSize) - gridSize * 0.5f, 0.2f, (i / gridSize) - gridSize * 0.5f);
+		glm::quat rotation = glm::angleAxis(glm::radians((float)(i * 37 % 360)), yAxis);
+		bool moving = i < options.movingCubes;
+		sceneObjects.push_back({ transforms.add(position, rotation, glm::vec3(0.4f)), &cubeMesh, 0, moving, &cubeOccluder });
+		if (moving) movingCubeRest.push_back(position);
+	}
 
-		// input
-		processInput(window);
+	// instanced mode groups objects by mesh, with a batch for each of its levels of detail
+	std::vector<InstanceBatch> instanceBatches;
+	if (options.instancing)
+	{
+		for (SceneObject& object : sceneObjects)
+		{
+			object.batch = (unsigned int)instanceBatches.size();
+			for (unsigned int i = 0; i < instanceBatches.size(); i++)
+			{
+				if (instanceBatches[i].mesh == object.mesh) object.batch = i;
+			}
+			if (object.batch < instanceBatches.size()) continue;
+			for (unsigned int lod = 0; lod < object.mesh->levelCount(); lod++) instanceBatches.push_back(InstanceBatch(&object.mesh->level(lod)));
+		}
+	}
+	std::vector<std::vector<unsigned int>> batchInstances(instanceBatches.size());
+
+	// visibility: object boxes live in a BVH that follows the transforms, culled against the camera and every cascade
+	BVH sceneBVH;
+	// what the camera's frustum let through is then tested against an occlusion buffer, filled from the
+	// GPU's depths a frame or two old or by rasterizing the biggest occluders; only ever used by the
+	// preparing job, and frames are prepared one at a time
+	OcclusionBuffer occlusionBuffer;
+	DepthReadback depthReadback;
+	std::vector<AABB> dynamicBounds;
+	std::vector<std::pair<float, unsigned int>> occluderCandidates;
+	std::vector<uint8_t> occludedObjects;
+	bool occlusion = options.culling && options.occlusion != OCCLUSION_OFF;
+
+	// shadow caching: cascades are skipped while their projection and casters stay put
+	std::vector<unsigned int> staticCasters, dynamicCasters, lastDynamicCasters[MAX_SHADOW_CASCADES];
+	unsigned int dynamicObjects = (unsigned int)movingCubeRest.size();
+	double cascadesRenderedTotal = 0.0;
+	double mainDrawnTotal = 0.0, mainCulledTotal = 0.0, mainTestedTotal = 0.0, mainOccludedTotal = 0.0;
+	double occlusionTotal = 0.0, occludersTotal = 0.0;
+	double shadowDrawnTotal = 0.0, shadowCulledTotal = 0.0, shadowTestedTotal = 0.0;
+	double lightReferencesTotal = 0.0, lightBinningTotal = 0.0;
+	double drawsTotal = 0.0, drawCommandsTotal = 0.0, stateChangesTotal = 0.0, redundantChangesTotal = 0.0;
+	double mainTrianglesTotal = 0.0, shadowTrianglesTotal = 0.0;
+	double prepareTotal = 0.0, prepareWaitTotal = 0.0;
+	ClusterUniforms clusterGrid = {};
+	std::vector<unsigned int> transformObject(transforms.size());
+	for (unsigned int i = 0; i < sceneObjects.size(); i++) transformObject[sceneObjects[i].transform] = i;
+	auto objectBounds = [&](unsigned int object, const std::vector<glm::mat4>& world)
+	{
+		const SceneObject& sceneObject = sceneObjects[object];
+		return transformBounds(sceneObject.mesh->boundsMin, sceneObject.mesh->boundsMax, world[sceneObject.transform]);
+	};
 
-		// rendering
-		glClear(GL_DEPTH_BUFFER_BIT);
-		
-		// -------------------
-		//		  SHADOWS
-		// -------------------
-		// activate shadow map shader
-		shadowShader.use();
+	// instanced mode: hands each batch the visible objects that use its mesh at its level of detail
+	auto setBatchInstances = [&](const std::vector<unsigned int>& visible, const std::vector<uint8_t>& lods, const FrameState& state)
+	{
+		for (std::vector<unsigned int>& instances : batchInstances) instances.clear();
+		for (unsigned int object : visible) batchInstances[sceneObjects[object].batch + lods[object]].push_back(sceneObjects[object].transform);
+		for (unsigned int i = 0; i < instanceBatches.size(); i++) instanceBatches[i].setInstances(state.world, state.normal, batchInstances[i]);
+	};
 
-		// uniform locations
-		// projection from light pov for shadow map
-		int lightProjectionLoc = glGetUniformLocation(shadowShader.ID, "lightProjection");
-		int lightModelLoc = glGetUniformLocation(shadowShader.ID, "lightModel");
-		int lightViewLoc = glGetUniformLocation(shadowShader.ID, "lightView");
+	// one object's packet at a level of detail, drawn with the frame's matrices; only the scene pass needs the normal matrix
+	auto objectPacket = [&](RenderPass pass, Shader& shader, unsigned int object, unsigned int lod, float depth, const FrameState& state)
+	{
+		const SceneObject& sceneObject = sceneObjects[object];
+		const glm::mat3* normalMatrix = pass == RENDER_PASS_OPAQUE ? &state.normal[sceneObject.transform] : NULL;
+		return DrawPacket{ makeSortKey(pass, shader.ID, sceneObject.mesh->vao, 0, depth), &shader, &sceneObject.mesh->level(lod), GL_TEXTURE_2D, 0,
+			&state.world[sceneObject.transform], normalMatrix, 0, NULL };
+	};
+	// queues one instanced draw per batch, instances have to be set first
+	auto submitBatches = [&](RenderQueue& queue, RenderPass pass, Shader& shader)
+	{
+		for (const InstanceBatch& batch : instanceBatches)
+		{
+			if (batch.instanceCount() == 0) continue;
+			queue.submit({ makeSortKey(pass, shader.ID, batch.mesh->vao, 0, 0.0f), &shader, batch.mesh, GL_TEXTURE_2D, 0, NULL, NULL,
+				batch.instanceCount(), batch.instances.data() });
+		}
+	};
 
-		// lightmvp transformation for the shadow map
-		glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 1.0f, 30.f); // left, right, up, down, near, far
-		glUniformMatrix4fv(lightProjectionLoc, 1, GL_FALSE, glm::value_ptr(lightProjection));
+	// draws a set of objects into the bound cascade, nearest to the light first
+	auto drawShadowCasters = [&](unsigned int cascade, const std::vector<unsigned int>& casters, const FrameState& state)
+	{
+		// activate shadow map shader; the queue keeps it bound, so the cascade's matrix is set once
+		Shader& shader = shadowShaders.get(shadowFeatures);
+		glState.useProgram(shader.ID);
+		glUniformMatrix4fv(shader.getUniformLocation("lightViewProjection"), 1, GL_FALSE, glm::value_ptr(shadowMap.viewProjection[cascade]));
+		shadowQueue.clear();
+		if (options.instancing)
+		{
+			setBatchInstances(casters, state.shadowLod[cascade], state);
+			submitBatches(shadowQueue, RENDER_PASS_SHADOW, shader);
+		}
+		else
+		{
+			for (unsigned int visible : casters)
+			{
+				// orthographic, so clip z is linear in the distance from the light, shifted to be positive
+				AABB bounds = objectBounds(visible, state.world);
+				glm::vec4 center = shadowMap.viewProjection[cascade] * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+				shadowQueue.submit(objectPacket(RENDER_PASS_SHADOW, shader, visible, state.shadowLod[cascade][visible], center.z + 1.0f, state));
+			}
+		}
+		shadowQueue.sort();
+		shadowQueue.execute(glState, streamBuffer);
+	};
 
-		glm::mat4 lightView = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-		lightView = glm::lookAt(directionalLightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-		glUniformMatrix4fv(lightViewLoc, 1, GL_FALSE, glm::value_ptr(lightView));
+	//===================
+	//	 FRAME PIPELINE
+	//===================
+	// frame N+1 is prepared on the job system while this thread submits frame N to GL: animation,
+	// transforms, the BVH, cascade fitting, culling, light binning and the camera's draw packets.
+	// Every frame has its own FrameState and the scene itself is only touched by the preparing job,
+	// so the render thread reads nothing a job writes.
+	FrameState frameStates[2];
+	frameStates[0].sceneQueue.depthPrepass = frameStates[1].sceneQueue.depthPrepass = options.depthPrepass;
+	frameStates[0].sceneQueue.multiDraw = frameStates[1].sceneQueue.multiDraw = multiDrawIndirect;
+	JobCounter preparing;
+	unsigned int framesPrepared = 0;
+	unsigned int finalFrame = options.headless ? options.warmupFrames + options.frames : replaying ? (unsigned int)cameraPath.size() : 0xFFFFFFFFu;
+	const float fovy = glm::radians(45.0f), nearPlane = 0.1f, farPlane = 500.0f;
+
+	// frame timing on a monotonic clock; the cap's wait comes before a frame's input is read, so the
+	// frame starts from the newest input there is
+	FrameClock frameClock;
+	FramePacer framePacer;
+	framePacer.setCap(options.fpsCap);
+
+	// render thread: the frame's time, camera and the scene variants its packets use
+	auto sampleFrame = [&](FrameState& state, unsigned int number)
+	{
+		// input is read as late as it can be, right before the camera is taken for the frame
+		glfwPollEvents();
+		state.inputTime = FrameClock::Clock::now();
 
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-						
-						// PLANE
-						// creating transformations (MVP) for plane
-						// general pattern: intialize -> MVP -> glUniformMatrix -> draw
+		// camera calculations
+		double frameDelta = frameClock.tick(); // movement speed calculations
+		if (fixedTimestep)
+		{
+			deltaTime = options.timestep;
+			sceneTime = number * options.timestep;
+		}
+		else
+		{
+			deltaTime = (float)frameDelta;
+			sceneTime = (float)frameClock.seconds();
+		}
 
-						glBindVertexArray(planeVAO); // start drawing planes
-						glm::mat4 model = glm::mat4(1.0f); // initialize identity matrix
+		// input
+		if (replaying)
+		{
+			const CameraSample& sample = cameraPath[number];
+			cameraPos = glm::vec3(sample.x, sample.y, sample.z);
+			yaw = sample.yaw;
+			pitch = sample.pitch;
+			updateCameraFront();
+		}
+		else if (!options.headless) processInput(window);
+		if (recording) cameraPath.record(sceneTime, cameraPos, yaw, pitch);
+
+		state.number = number;
+		state.sceneTime = sceneTime;
+		state.cameraPos = cameraPos;
+		state.cameraFront = cameraFront;
+		state.cameraUp = cameraUp;
+		state.width = scrWidth;
+		state.height = scrHeight;
+		// getting a variant may build it, which takes GL
+		state.receiverShader = &mainShaders.get(mainFeatures);
+		state.plainShader = &mainShaders.get(mainFeatures & ~(uint32_t)FEATURE_SHADOWS);
+		state.depthShader = options.depthPrepass ? &depthShaders.get(shadowFeatures) : NULL;
+
+		// the newest depths that made it back, reprojected into this frame's view when it's prepared
+		if (occlusion && options.occlusion == OCCLUSION_HIZ)
+		{
+			depthReadback.collect();
+			state.depthHistory = depthReadback.depth;
+			state.depthHistoryWidth = depthReadback.width;
+			state.depthHistoryHeight = depthReadback.height;
+			state.depthHistoryViewProjection = depthReadback.viewProjection;
+			state.depthHistoryDynamic = depthReadback.dynamicBounds;
+		}
+	};
 
-						model = glm::scale(model, glm::vec3(20.0f, 0.0f, 20.0f));
+	// any thread, one frame at a time: everything about the frame that takes no GL
+	auto prepareFrame = [&](FrameState& state, const FrameState& previous, ThreadPool& pool)
+	{
+		PROFILE_SCOPE("prepare frame");
+		Benchmark::Clock::time_point prepareStart = Benchmark::Clock::now();
 
-						glUniformMatrix4fv(lightModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// animation
+		for (unsigned int i = 0; i < movingCubeRest.size(); i++)
+		{
+			float bob = 0.5f + 0.5f * std::sin(state.sceneTime * 2.0f + i * 0.7f);
+			transforms.setPosition(sceneObjects[firstMovingCube + i].transform, movingCubeRest[i] + glm::vec3(0.0f, bob, 0.0f));
+		}
+		{
+			PROFILE_SCOPE("transforms");
+			transforms.update();
+		}
+		state.rebuilt = transforms.rebuilt;
 
-						glDrawArrays(GL_TRIANGLES, 0, 6);
+		// the snapshot the frame is drawn with; this one is two frames old, so it takes what moved in either of them
+		if (state.world.size() != transforms.size())
+		{
+			state.world.assign(transforms.world.begin(), transforms.world.begin() + transforms.size());
+			state.normal.assign(transforms.normal.begin(), transforms.normal.begin() + transforms.size());
+		}
+		else
+		{
+			const std::vector<unsigned int>* moved[2] = { &previous.rebuilt, &state.rebuilt };
+			for (const std::vector<unsigned int>* transformsMoved : moved)
+			{
+				for (unsigned int transform : *transformsMoved)
+				{
+					state.world[transform] = transforms.world[transform];
+					state.normal[transform] = transforms.normal[transform];
+				}
+			}
+		}
 
-						// CUBE
-						// creating transformations (MVP) for cube
-						// general pattern: intialize -> MVP -> glUniformMatrix -> draw
+		// the hierarchy is built on the first frame, when every world matrix is new
+		if (sceneBVH.size() == 0)
+		{
+			std::vector<AABB> bounds(sceneObjects.size());
+			for (unsigned int i = 0; i < sceneObjects.size(); i++) bounds[i] = objectBounds(i, state.world);
+			sceneBVH.build(bounds);
+		}
+		else
+		{
+			for (unsigned int transform : state.rebuilt) sceneBVH.refit(transformObject[transform], objectBounds(transformObject[transform], state.world));
+		}
 
-						// cube 1
-						glBindVertexArray(cubeVAO); // start drawing cubes
-						model = glm::mat4(1.0f); // initialize identity matrix
+		// per-frame constants, uploaded once and shared by every pass
+		float aspect = (float)state.width / (float)state.height;
+		state.uniforms.projection = glm::perspective(fovy, aspect, nearPlane, farPlane);
+		state.uniforms.view = glm::lookAt(state.cameraPos, state.cameraPos + state.cameraFront, state.cameraUp);
+		state.uniforms.eyePos = state.cameraPos;
+		state.uniforms.time = glm::sin(state.sceneTime);
+
+		// cascades follow the camera; the light shines from directionalLightPos towards the origin
+		float splitDepths[MAX_SHADOW_CASCADES] = {};
+		shadowMap.fit(state.cameraPos, state.cameraFront, state.cameraUp, fovy, aspect, nearPlane, -directionalLightPos, sceneBVH.bounds(),
+			state.shadows.cascadeViewProjection, splitDepths);
+		for (unsigned int i = 0; i < shadowMap.cascadeCount; i++) state.shadows.cascadeSplits[i] = splitDepths[i];
+		state.shadows.cascadeCount = (int)shadowMap.cascadeCount;
+
+		if (options.culling)
+		{
+			PROFILE_SCOPE("culling");
+			// the camera and the cascades are culled side by side
+			Frustum frusta[1 + MAX_SHADOW_CASCADES];
+			CullStats stats[1 + MAX_SHADOW_CASCADES];
+			frusta[0].extract(state.uniforms.projection * state.uniforms.view);
+			for (unsigned int i = 0; i < shadowMap.cascadeCount; i++) frusta[1 + i].extract(state.shadows.cascadeViewProjection[i]);
+			pool.parallelFor(1 + shadowMap.cascadeCount, 1, [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int i = begin; i < end; i++) stats[i] = sceneBVH.cull(frusta[i], i == 0 ? state.mainVisible : state.shadowVisible[i - 1]);
+				});
+			state.mainCull = stats[0];
+			state.shadowCull = CullStats();
+			for (unsigned int i = 1; i <= shadowMap.cascadeCount; i++)
+			{
+				state.shadowCull.tested += stats[i].tested;
+				state.shadowCull.culled += stats[i].culled;
+				state.shadowCull.drawn += stats[i].drawn;
+			}
+		}
+		else if (state.mainVisible.size() != sceneObjects.size())
+		{
+			for (unsigned int i = 0; i < sceneObjects.size(); i++) state.mainVisible.push_back(i);
+			for (unsigned int i = 0; i < shadowMap.cascadeCount; i++) state.shadowVisible[i] = state.mainVisible;
+			state.mainCull.drawn = (unsigned int)sceneObjects.size();
+			state.shadowCull.drawn = state.mainCull.drawn * shadowMap.cascadeCount;
+		}
 
-						model = glm::translate(model, glm::vec3(0.0f, 2.0f, -2.0f));
-						model = glm::scale(model, glm::vec3(1.5f, 1.5f, 1.5f));
+		// occlusion: objects in the camera's frustum but behind what's in the occlusion buffer are
+		// dropped from the camera's list, they may still cast shadows
+		state.occluders = 0;
+		state.occlusionMs = 0.0;
+		if (occlusion)
+		{
+			PROFILE_SCOPE("occlusion culling");
+			Benchmark::Clock::time_point occlusionStart = Benchmark::Clock::now();
+			glm::mat4 viewProjection = state.uniforms.projection * state.uniforms.view;
+			occlusionBuffer.resize(OCCLUSION_WIDTH, (unsigned int)std::lround((double)OCCLUSION_WIDTH * state.height / state.width));
+			bool filled = false;
+			if (options.occlusion == OCCLUSION_HIZ && !state.depthHistory.empty())
+			{
+				occlusionBuffer.reproject(state.depthHistory.data(), state.depthHistoryWidth, state.depthHistoryHeight, state.depthHistoryViewProjection, viewProjection,
+					state.depthHistoryDynamic);
+				filled = true;
+			}
+			else if (options.occlusion == OCCLUSION_RASTER)
+			{
+				// the occluders covering the most of the view, by bounding radius over distance
+				occluderCandidates.clear();
+				for (unsigned int object : state.mainVisible)
+				{
+					if (!sceneObjects[object].occluder) continue;
+					AABB bounds = objectBounds(object, state.world);
+					float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					float size = radius / std::max(glm::length((bounds.min + bounds.max) * 0.5f - state.cameraPos), nearPlane);
+					if (size >= MIN_OCCLUDER_SIZE) occluderCandidates.push_back({ size, object });
+				}
+				size_t count = std::min<size_t>(occluderCandidates.size(), MAX_OCCLUDERS);
+				std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + count, occluderCandidates.end(),
+					[](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+				occlusionBuffer.clear();
+				for (size_t i = 0; i < count; i++)
+				{
+					const SceneObject& object = sceneObjects[occluderCandidates[i].second];
+					occlusionBuffer.rasterize(*object.occluder, viewProjection * state.world[object.transform]);
+				}
+				state.occluders = (unsigned int)count;
+				filled = count > 0;
+			}
+			if (filled)
+			{
+				occlusionBuffer.buildPyramid();
+				occludedObjects.assign(state.mainVisible.size(), 0);
+				pool.parallelFor((unsigned int)state.mainVisible.size(), 256, [&](unsigned int begin, unsigned int end)
+					{
+						for (unsigned int i = begin; i < end; i++) occludedObjects[i] = occlusionBuffer.occluded(objectBounds(state.mainVisible[i], state.world), viewProjection);
+					});
+				size_t kept = 0;
+				for (size_t i = 0; i < state.mainVisible.size(); i++)
+				{
+					if (!occludedObjects[i]) state.mainVisible[kept++] = state.mainVisible[i];
+				}
+				state.mainCull.occluded = (unsigned int)(state.mainVisible.size() - kept);
+				state.mainCull.drawn = (unsigned int)kept;
+				state.mainVisible.resize(kept);
+			}
+			state.occlusionMs = std::chrono::duration<double, std::milli>(Benchmark::Clock::now() - occlusionStart).count();
+		}
 
-						glUniformMatrix4fv(lightModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// levels of detail: the coarsest whose error stays under --lod-error pixels, for the camera by
+		// distance and for each cascade by its texel size, which is the same at any distance from the light
+		state.mainLod.assign(sceneObjects.size(), 0);
+		for (unsigned int i = 0; i < shadowMap.cascadeCount; i++) state.shadowLod[i].assign(sceneObjects.size(), 0);
+		if (options.lod)
+		{
+			PROFILE_SCOPE("lod selection");
+			auto objectScale = [&](unsigned int object)
+			{
+				const glm::mat4& world = state.world[sceneObjects[object].transform];
+				return std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+			};
+			// the level each object had last frame, which it keeps unless it's clearly past a threshold
+			auto currentLod = [](const std::vector<uint8_t>& lods, unsigned int object) { return object < lods.size() ? lods[object] : 0u; };
+			float focalPixels = state.height / (2.0f * std::tan(fovy * 0.5f));
+			pool.parallelFor((unsigned int)state.mainVisible.size(), 256, [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int i = begin; i < end; i++)
+					{
+						unsigned int object = state.mainVisible[i];
+						const Mesh& mesh = *sceneObjects[object].mesh;
+						if (mesh.levelCount() == 1) continue;
+						AABB bounds = objectBounds(object, state.world);
+						glm::vec3 outside = glm::max(glm::max(bounds.min - state.cameraPos, state.cameraPos - bounds.max), glm::vec3(0.0f));
+						float distance = std::max(glm::length(outside), nearPlane);
+						state.mainLod[object] = (uint8_t)selectLod(mesh, objectScale(object) * focalPixels / distance, options.lodPixels, currentLod(previous.mainLod, object));
+					}
+				});
+			for (unsigned int cascade = 0; cascade < shadowMap.cascadeCount; cascade++)
+			{
+				// orthographic: the first row of the projection maps a world unit to 2 / width in clip space
+				const glm::mat4& viewProjection = state.shadows.cascadeViewProjection[cascade];
+				float texelsPerUnit = 0.5f * shadowMap.resolution * glm::length(glm::vec3(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0]));
+				for (unsigned int object : state.shadowVisible[cascade])
+				{
+					const Mesh& mesh = *sceneObjects[object].mesh;
+					if (mesh.levelCount() == 1) continue;
+					state.shadowLod[cascade][object] = (uint8_t)selectLod(mesh, objectScale(object) * texelsPerUnit, options.lodPixels,
+						currentLod(previous.shadowLod[cascade], object));
+				}
+			}
+		}
 
-						glDrawArrays(GL_TRIANGLES, 0, 36);
+		// point lights are sorted into the clusters of this view
+		if (mainFeatures & FEATURE_POINT_LIGHT)
+		{
+			PROFILE_SCOPE("light binning");
+			pointLights.bin(state.uniforms.view, fovy, aspect, nearPlane, farPlane, pool, state.lightClusters);
+		}
 
-						// cube 2
-						model = glm::mat4(1.0f); // initialize identity matrix
+		// the camera's queue holds the optional depth pre-pass, the scene and the skybox; instanced
+		// batches are added by the render thread, which owns the batches
+		state.sceneQueue.clear();
+		if (!options.instancing)
+		{
+			PROFILE_SCOPE("draw packets");
+			// objects that start beyond the last cascade can't be shadowed and skip the lookups
+			float shadowReach = splitDepths[shadowMap.cascadeCount - 1];
+			unsigned int perObject = options.depthPrepass ? 2 : 1;
+			DrawPacket* packets = state.sceneQueue.append(state.mainVisible.size() * perObject);
+			pool.parallelFor((unsigned int)state.mainVisible.size(), 256, [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int i = begin; i < end; i++)
+					{
+						unsigned int visible = state.mainVisible[i];
+						AABB bounds = objectBounds(visible, state.world);
+						AABB viewBounds = transformBounds(bounds.min, bounds.max, state.uniforms.view);
+						float nearestDepth = -viewBounds.max.z;
+						bool receives = (mainFeatures & FEATURE_SHADOWS) && nearestDepth <= shadowReach;
+						DrawPacket* packet = packets + i * perObject;
+						unsigned int lod = state.mainLod[visible];
+						if (options.depthPrepass) *packet++ = objectPacket(RENDER_PASS_DEPTH_PREPASS, *state.depthShader, visible, lod, nearestDepth, state);
+						*packet = objectPacket(RENDER_PASS_OPAQUE, receives ? *state.receiverShader : *state.plainShader, visible, lod, nearestDepth, state);
+					}
+				});
+		}
+		state.sceneQueue.submit({ makeSortKey(RENDER_PASS_SKYBOX, skyboxShader.ID, skyboxMesh.vao, skyboxTexture, 0.0f), &skyboxShader, &skyboxMesh,
+			GL_TEXTURE_CUBE_MAP, skyboxTexture, NULL, NULL, 0, NULL });
+		if (!options.instancing) state.sceneQueue.sort();
+		state.prepareMs = std::chrono::duration<double, std::milli>(Benchmark::Clock::now() - prepareStart).count();
+	};
 
-						model = glm::translate(model, glm::vec3(-3.0f, 0.25f, 1.0f));
-						model = glm::rotate(model, glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-						model = glm::rotate(model, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-						model = glm::scale(model, glm::vec3(0.50f, 0.50f, 0.50f));
+	// starts a frame: as a job drawn next time round, or right away without the pipeline
+	auto startFrame = [&](unsigned int number)
+	{
+		FrameState& state = frameStates[number % 2];
+		const FrameState& previous = frameStates[(number + 1) % 2];
+		sampleFrame(state, number);
+		if (options.pipeline) threadPool.submit([&prepareFrame, &state, &previous, &threadPool](unsigned int) { prepareFrame(state, previous, threadPool); }, &preparing);
+		else prepareFrame(state, previous, threadPool);
+		framesPrepared++;
+	};
 
-						glUniformMatrix4fv(lightModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// GPU pass timings and trace captures
+	Profiler& profiler = Profiler::get();
+	profiler.enabled = options.profile || options.trace;
+	bool captureKeyDown = false;
 
-						glDrawArrays(GL_TRIANGLES, 0, 36);
+	// benchmarks measure the finished scene, not placeholders
+	if (options.headless) assets.finish();
+	benchmark.addMetric("asset_loading_ms", assets.loadingMs());
 
-						// cube 3
-						model = glm::mat4(1.0f); // initialize identity matrix
+	// The Rendering Loop
+	while (!glfwWindowShouldClose(window))
+	{
+		if (options.headless && framesRendered >= options.warmupFrames + options.frames) break;
+		if (replaying && framesRendered >= cameraPath.size()) break;
+		framePacer.wait();
+		benchmark.beginFrame();
+		if (framesRendered == options.warmupFrames)
+		{
+			framePacer.reset();
+			profiler.resetTotals();
+			streamBuffer.fenceWaitMs = 0.0;
+			streamBuffer.framesWaited = 0;
+			if (options.trace) profiler.requestCapture(options.tracePath, options.traceFrames);
+		}
+		if (!options.headless)
+		{
+			bool captureKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+			if (captureKey && !captureKeyDown) profiler.requestCapture(options.tracePath, options.traceFrames);
+			captureKeyDown = captureKey;
+		}
+		profiler.beginFrame();
 
-						model = glm::translate(model, glm::vec3(-4.5f, 0.5f, -4.5f));
-						model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		// this frame was prepared while the last one was drawn
+		{
+			PROFILE_SCOPE("wait for frame");
+			Benchmark::Clock::time_point waitStart = Benchmark::Clock::now();
+			threadPool.wait(preparing);
+			if (framesRendered >= options.warmupFrames) prepareWaitTotal += std::chrono::duration<double, std::milli>(Benchmark::Clock::now() - waitStart).count();
+		}
+		// reloads swap program names, so they happen while no job is reading them
+		if (shaderReloader.poll()) configurePrograms();
+		if (assets.busy())
+		{
+			PROFILE_SCOPE("asset uploads");
+			assets.update();
+		}
+		// both of the above and last frame's skybox bind programs and textures without the cache
+		glState.invalidate();
+		glState.stats = RenderStats();
 
-						glUniformMatrix4fv(lightModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// the first frame has nothing to overlap with, and without the pipeline every frame is like it
+		if (framesPrepared == framesRendered)
+		{
+			startFrame(framesRendered);
+			threadPool.wait(preparing);
+		}
+		FrameState& state = frameStates[framesRendered % 2];
+		// input for the next frame is read now, a frame ahead of it being shown; --low-latency turns this off
+		if (options.pipeline && framesRendered + 1 < finalFrame) startFrame(framesRendered + 1);
 
-						glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		
-		// -------------------
-		//	  MAIN DRAWING
-		// -------------------
+		frameUBO.update(&state.uniforms);
+		if (mainFeatures & FEATURE_POINT_LIGHT)
+		{
+			pointLights.upload(state.lightClusters);
+			clusterGrid.gridSize = glm::uvec4(CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES, (unsigned int)pointLights.lights.size());
+			clusterGrid.screen = glm::vec4((float)state.width, (float)state.height, state.lightClusters.sliceScale, state.lightClusters.sliceBias);
+			clusterUBO.update(&clusterGrid);
+			if (framesRendered >= options.warmupFrames)
+			{
+				lightReferencesTotal += state.lightClusters.indexCount;
+				lightBinningTotal += state.lightClusters.binMilliseconds;
+			}
+		}
+		// anything that moves leaves the static shadow layer for good, so the layer is rebuilt once rather than every time it moves
+		bool dynamicMoved = false;
+		if (state.number > 0)
+		{
+			for (unsigned int transform : state.rebuilt)
+			{
+				SceneObject& object = sceneObjects[transformObject[transform]];
+				if (!object.dynamic)
+				{
+					object.dynamic = true;
+					dynamicObjects++;
+					shadowMap.invalidate();
+				}
+				dynamicMoved = true;
+			}
+		}
+		if (dynamicObjects > 0 && shadowMap.caching) shadowMap.createStaticLayer();
 
-		// main render
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClear(GL_DEPTH_BUFFER_BIT); // clears the screen using the color that was set in previous line 
+		// the cascades fit with the frame take over
+		for (unsigned int i = 0; i < shadowMap.cascadeCount; i++)
+		{
+			shadowMap.viewProjection[i] = state.shadows.cascadeViewProjection[i];
+			shadowMap.splitDepths[i] = state.shadows.cascadeSplits[i];
+		}
+		shadowUBO.update(&state.shadows);
 
-		// activate main shader
-		ourShader.use();
+		// every per-object draw and instance of the frame is streamed: one set of matrices per scene
+		// packet and shadow caster, over up to two queue executes per cascade and two for the camera
+		size_t streamedObjects = state.mainVisible.size() * (options.depthPrepass ? 2 : 1);
+		for (unsigned int i = 0; i < shadowMap.cascadeCount; i++) streamedObjects += state.shadowVisible[i].size();
+		streamBuffer.beginFrame(RenderQueue::frameStreamBytes(streamBuffer, streamedObjects, 2 * shadowMap.cascadeCount + 2));
 
-		// get time part
-		int sourceTimeLoc = glGetUniformLocation(ourShader.ID, "time");
-		glUniform1f(sourceTimeLoc, glm::sin(glfwGetTime()));
+		if (framesRendered >= options.warmupFrames)
+		{
+			mainDrawnTotal += state.mainCull.drawn; mainCulledTotal += state.mainCull.culled; mainTestedTotal += state.mainCull.tested;
+			mainOccludedTotal += state.mainCull.occluded; occlusionTotal += state.occlusionMs; occludersTotal += state.occluders;
+			shadowDrawnTotal += state.shadowCull.drawn; shadowCulledTotal += state.shadowCull.culled; shadowTestedTotal += state.shadowCull.tested;
+			prepareTotal += state.prepareMs;
+		}
 
-		// main transformation uniform location
-		int projectionLoc = glGetUniformLocation(ourShader.ID, "projection");
-		int modelLoc = glGetUniformLocation(ourShader.ID, "model");
-		int viewLoc = glGetUniformLocation(ourShader.ID, "view");
-		int lightProjectionLocInMain = glGetUniformLocation(ourShader.ID, "lightProjection"); // for updating the lightProj in main shader
-		int lightViewLocInMain = glGetUniformLocation(ourShader.ID, "lightView"); // for updating the lightView in main shader
+		// rendering
+		glClear(GL_DEPTH_BUFFER_BIT);
 
-		// main transformations and uniforming
-		glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 500.0f);
-		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+		// -------------------
+		//		  SHADOWS
+		// -------------------
+		benchmark.beginPass(PASS_SHADOW);
+		profiler.beginGpu("shadow");
 
-		glUniformMatrix4fv(lightProjectionLocInMain, 1, GL_FALSE, glm::value_ptr(lightProjection));
+		// with shadows off no variant reads the cascades, so nothing is rendered into them
+		unsigned int cascadesRendered = 0;
+		unsigned int shadowedCascades = (mainFeatures & FEATURE_SHADOWS) ? shadowMap.cascadeCount : 0;
+		for (unsigned int cascade = 0; cascade < shadowedCascades; cascade++)
+		{
+			bool staticDirty = shadowMap.cascadeMoved(cascade);
+			if (!shadowMap.hasStaticLayer())
+			{
+				if (!staticDirty) continue;
+				shadowMap.bindCascade(cascade);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				drawShadowCasters(cascade, state.shadowVisible[cascade], state);
+			}
+			else
+			{
+				staticCasters.clear();
+				dynamicCasters.clear();
+				for (unsigned int visible : state.shadowVisible[cascade]) (sceneObjects[visible].dynamic ? dynamicCasters : staticCasters).push_back(visible);
+				if (!staticDirty && !dynamicMoved && dynamicCasters == lastDynamicCasters[cascade]) continue;
+
+				if (staticDirty)
+				{
+					shadowMap.bindStaticCascade(cascade);
+					glClear(GL_DEPTH_BUFFER_BIT);
+					drawShadowCasters(cascade, staticCasters, state);
+				}
+				shadowMap.copyStaticCascade(cascade);
+				drawShadowCasters(cascade, dynamicCasters, state);
+				lastDynamicCasters[cascade] = dynamicCasters;
+			}
+			shadowMap.filterCascade(cascade, shadowMomentsShader, shadowBlurShader);
+			glState.invalidate(); // the moment filter draws with its own programs
+			shadowMap.markRendered(cascade);
+			cascadesRendered++;
+		}
+		if (framesRendered >= options.warmupFrames) cascadesRenderedTotal += cascadesRendered;
+		unsigned int shadowTriangles = glState.stats.triangles;
+		glBindFramebuffer(GL_FRAMEBUFFER, mainFBO);
+		if (benchmark.enabled) glFinish();
+		profiler.endGpu();
+		benchmark.endPass(PASS_SHADOW);
 
-		glm::mat4 view = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-		view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		// -------------------
+		//	  MAIN DRAWING
+		// -------------------
 
-		glUniformMatrix4fv(lightViewLocInMain, 1, GL_FALSE, glm::value_ptr(lightView));
+		// main render
+		benchmark.beginPass(PASS_MAIN);
+		profiler.beginGpu("main");
+		glViewport(0, 0, scrWidth, scrHeight);
+		glClear(GL_DEPTH_BUFFER_BIT); // clears the screen using the color that was set in previous line
 
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, shadowMap);
-		GLint shadowMapTextureLoc = glGetUniformLocation(ourShader.ID, "shadowMapTexture");
-		glUniform1i(shadowMapTextureLoc, 0);
-
-		// PLANE
-		// creating transformations (MVP) for plane
-		// general pattern: intialize -> MVP -> glUniformMatrix -> draw
-		glBindVertexArray(planeVAO); // start drawing planes
-		model = glm::mat4(1.0f); // initialize identity matrix; definition moved up to shadow portion
-
-		model = glm::scale(model, glm::vec3(20.0f, 0.0f, 20.0f));
-
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// CUBE
-		// creating transformations (MVP) for cube
-		// general pattern: intialize -> MVP -> glUniformMatrix -> draw
-
-		// cube 1
-		glBindVertexArray(cubeVAO); // start drawing cubes
-		model = glm::mat4(1.0f); // initialize identity matrix
-
-		model = glm::translate(model, glm::vec3(0.0f, 2.0f, -2.0f));
-		model = glm::scale(model, glm::vec3(1.5f, 1.5f, 1.5f));
-
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// cube 2
-		model = glm::mat4(1.0f); // initialize identity matrix
-
-		model = glm::translate(model, glm::vec3(-3.0f, 0.25f, 1.0f));
-		model = glm::rotate(model, glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		model = glm::rotate(model, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(0.50f, 0.50f, 0.50f));
-
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// cube 3
-		model = glm::mat4(1.0f); // initialize identity matrix
-
-		model = glm::translate(model, glm::vec3(-4.5f, 0.5f, -4.5f));
-		model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.momentTexture);
+		glActiveTexture(GL_TEXTURE0);
+		pointLights.bind(2);
 
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// the per-object packets came sorted with the frame, instanced ones are added here
+		if (options.instancing)
+		{
+			setBatchInstances(state.mainVisible, state.mainLod, state);
+			if (options.depthPrepass) submitBatches(state.sceneQueue, RENDER_PASS_DEPTH_PREPASS, *state.depthShader);
+			submitBatches(state.sceneQueue, RENDER_PASS_OPAQUE, *state.receiverShader);
+			state.sceneQueue.sort();
+		}
+		state.sceneQueue.execute(glState, streamBuffer, RENDER_PASS_DEPTH_PREPASS, RENDER_PASS_OPAQUE);
+		unsigned int mainTriangles = glState.stats.triangles - shadowTriangles;
 
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		if (benchmark.enabled) glFinish();
+		profiler.endGpu();
+		benchmark.endPass(PASS_MAIN);
 
 		// -------------------
 		//		 SKYBOX			// drawn last for optimization
 		// -------------------
-		// activate skybox shader
-		glDepthFunc(GL_LEQUAL);
-		skyboxShader.use();
+		benchmark.beginPass(PASS_SKYBOX);
+		profiler.beginGpu("skybox");
 
-		// get time part
-		int skyboxTimeLoc = glGetUniformLocation(skyboxShader.ID, "time");
-		glUniform1f(skyboxTimeLoc, glm::sin(glfwGetTime()));
+		state.sceneQueue.execute(glState, streamBuffer, RENDER_PASS_SKYBOX, RENDER_PASS_SKYBOX);
+		glState.bindVertexArray(0);
+		streamBuffer.endFrame(); // fenced after the last draw reading this frame's region
 
+		if (benchmark.enabled) glFinish();
+		profiler.endGpu();
+		benchmark.endPass(PASS_SKYBOX);
 
-		// skybox uniform locations and drawing
-		int skyboxProjectionLoc = glGetUniformLocation(skyboxShader.ID, "skyboxProjection");
-		glm::mat4 skyboxProjection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 500.0f);
-		glUniformMatrix4fv(skyboxProjectionLoc, 1, GL_FALSE, glm::value_ptr(skyboxProjection));
+		// the frame's depths head back to the CPU for the frames after it to be occlusion culled with
+		if (occlusion && options.occlusion == OCCLUSION_HIZ)
+		{
+			profiler.beginGpu("depth readback");
+			// moving objects' depths would still hide what's behind where they were, they're masked out on the CPU
+			dynamicBounds.clear();
+			for (unsigned int i = 0; i < sceneObjects.size(); i++)
+			{
+				if (sceneObjects[i].dynamic) dynamicBounds.push_back(objectBounds(i, state.world));
+			}
+			depthReadback.capture(mainFBO, scrWidth, scrHeight, state.uniforms.projection * state.uniforms.view, dynamicBounds, occlusionDepthShader);
+			glState.invalidate(); // the reduction draws with its own program and vertex array
+			profiler.endGpu();
+		}
 
-		int skyboxViewLoc = glGetUniformLocation(skyboxShader.ID, "skyboxView");
-		glm::mat4 skyboxView = glm::mat4(glm::mat3(glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp)));
-		glUniformMatrix4fv(skyboxViewLoc, 1, GL_FALSE, glm::value_ptr(skyboxView));
+		// swap the buffers; events are polled when the next frame's input is read
+		{
+			PROFILE_SCOPE("swap buffers");
+			if (!options.headless) glfwSwapBuffers(window);
+			// low latency: the driver is left nothing queued, which would otherwise keep the next
+			// frame's input waiting behind this frame's GPU work
+			if (options.lowLatency) glFinish();
+		}
+		framePacer.presented(state.inputTime);
+		benchmark.endFrame();
+		profiler.endFrame();
+		if (framesRendered >= options.warmupFrames)
+		{
+			drawsTotal += glState.stats.draws;
+			drawCommandsTotal += glState.stats.commands;
+			stateChangesTotal += glState.stats.stateChanges;
+			redundantChangesTotal += glState.stats.redundantChanges;
+			mainTrianglesTotal += mainTriangles;
+			shadowTrianglesTotal += shadowTriangles;
+		}
+		framesRendered++;
+	}
+	// a window closed mid-pipeline still has the next frame in preparation
+	threadPool.wait(preparing);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-		glBindVertexArray(skyboxVAO);
+	// how frame preparation scales with the size of the job system, on this scene; the thread
+	// preparing the frame helps out while it waits, so N workers are N + 1 threads
+	if (options.workerSweep)
+	{
+		const unsigned int sweepFrames = 30;
+		double oneWorkerMs = 0.0;
+		std::cout << "Frame preparation by workers:";
+		for (unsigned int workers : { 1u, 2u, 4u, 8u })
+		{
+			ThreadPool sweepPool(workers);
+			double totalMs = 0.0;
+			for (unsigned int i = 0; i < sweepFrames; i++)
+			{
+				unsigned int number = framesPrepared++;
+				FrameState& state = frameStates[number % 2];
+				state.number = number;
+				state.sceneTime = number * options.timestep;
+				prepareFrame(state, frameStates[(number + 1) % 2], sweepPool);
+				totalMs += state.prepareMs;
+			}
+			double ms = totalMs / sweepFrames;
+			if (workers == 1) oneWorkerMs = ms;
+			benchmark.addMetric("prepare_ms_" + std::to_string(workers) + "_workers", ms);
+			benchmark.addMetric("prepare_speedup_" + std::to_string(workers) + "_workers", oneWorkerMs / ms);
+			std::cout << " " << workers << ": " << ms << " ms (" << oneWorkerMs / ms << "x)";
+		}
+		std::cout << std::endl;
+	}
 
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
+	if (recording && cameraPath.save(options.recordPath))
+	{
+		std::cout << "Camera path: " << cameraPath.size() << " frames written to " << options.recordPath << std::endl;
+	}
 
-		glDepthFunc(GL_LESS);
+	// average culling counters per measured frame
+	double measuredFrames = framesRendered > options.warmupFrames ? (double)(framesRendered - options.warmupFrames) : 1.0;
+	benchmark.addMetric("main_objects_tested", mainTestedTotal / measuredFrames);
+	benchmark.addMetric("main_objects_culled", mainCulledTotal / measuredFrames);
+	benchmark.addMetric("main_objects_drawn", mainDrawnTotal / measuredFrames);
+	benchmark.addMetric("main_objects_occluded", mainOccludedTotal / measuredFrames);
+	benchmark.addMetric("occluded_fraction", mainOccludedTotal / std::max(mainOccludedTotal + mainDrawnTotal, 1.0));
+	benchmark.addMetric("occlusion_ms", occlusionTotal / measuredFrames);
+	benchmark.addMetric("shadow_objects_tested", shadowTestedTotal / measuredFrames);
+	benchmark.addMetric("shadow_objects_culled", shadowCulledTotal / measuredFrames);
+	benchmark.addMetric("shadow_objects_drawn", shadowDrawnTotal / measuredFrames);
+	benchmark.addMetric("shadow_cascades_rendered", cascadesRenderedTotal / measuredFrames);
+	benchmark.addMetric("shader_variants", (double)(mainShaders.size() + shadowShaders.size()));
+	benchmark.addMetric("draw_calls", drawsTotal / measuredFrames);
+	benchmark.addMetric("draw_commands", drawCommandsTotal / measuredFrames);
+	benchmark.addMetric("state_changes", stateChangesTotal / measuredFrames);
+	benchmark.addMetric("redundant_state_changes", redundantChangesTotal / measuredFrames);
+	benchmark.addMetric("main_triangles", mainTrianglesTotal / measuredFrames);
+	benchmark.addMetric("shadow_triangles", shadowTrianglesTotal / measuredFrames);
+	benchmark.addMetric("point_lights", (double)pointLights.lights.size());
+	benchmark.addMetric("lights_per_cluster", lightReferencesTotal / measuredFrames / CLUSTER_COUNT);
+	benchmark.addMetric("light_binning_ms", lightBinningTotal / measuredFrames);
+	benchmark.addMetric("workers", (double)threadPool.size());
+	benchmark.addMetric("frame_prepare_ms", prepareTotal / measuredFrames);
+	benchmark.addMetric("frame_prepare_wait_ms", prepareWaitTotal / measuredFrames);
+	benchmark.addMetric("stream_buffer_mb", streamBuffer.frameSize() / (1024.0 * 1024.0));
+	benchmark.addMetric("stream_fence_wait_ms", streamBuffer.fenceWaitMs / measuredFrames);
+	benchmark.addMetric("stream_frames_waited", streamBuffer.framesWaited / measuredFrames);
+	std::cout << "Culling per frame: main " << mainTestedTotal / measuredFrames << " tested, " << mainCulledTotal / measuredFrames
+		<< " culled, " << mainDrawnTotal / measuredFrames << " drawn; shadow " << shadowTestedTotal / measuredFrames << " tested, "
+		<< shadowCulledTotal / measuredFrames << " culled, " << shadowDrawnTotal / measuredFrames << " drawn" << std::endl;
+	if (occlusion)
+	{
+		std::cout << "Occlusion culling: " << occlusionModeNames[options.occlusion] << ", " << 100.0 * mainOccludedTotal / std::max(mainOccludedTotal + mainDrawnTotal, 1.0)
+			<< "% of the objects in the camera's frustum occluded (" << mainOccludedTotal / measuredFrames << " per frame), " << occlusionTotal / measuredFrames << " ms";
+		if (options.occlusion == OCCLUSION_RASTER) std::cout << ", " << occludersTotal / measuredFrames << " occluders drawn";
+		if (depthReadback.failed) std::cout << " (depth readback failed, nothing culled)";
+		std::cout << std::endl;
+	}
+	std::cout << "Draws per frame: " << drawsTotal / measuredFrames << " for " << drawCommandsTotal / measuredFrames << " meshes, state changes " << stateChangesTotal / measuredFrames
+		<< " (" << redundantChangesTotal / measuredFrames << " redundant ones skipped)" << std::endl;
+	std::cout << "Triangles per frame: main " << mainTrianglesTotal / measuredFrames << ", shadow " << shadowTrianglesTotal / measuredFrames
+		<< (options.lod ? "" : " (levels of detail off)") << std::endl;
+	if (profiler.enabled)
+	{
+		// the last frames' timings are still in flight
+		profiler.flush();
+		std::cout << "GPU per frame:";
+		for (const auto& pass : profiler.gpuAverages())
+		{
+			benchmark.addMetric("gpu_" + pass.first + "_ms", pass.second);
+			std::cout << " " << pass.first << " " << pass.second << " ms";
+		}
+		std::cout << " (" << profiler.droppedGpuResults() << " results not ready in time)" << std::endl;
+	}
+	std::cout << "Frame preparation: " << prepareTotal / measuredFrames << " ms on " << threadPool.size() << " workers, "
+		<< (options.pipeline ? "overlapped with drawing, " : "not overlapped, ") << prepareWaitTotal / measuredFrames << " ms waited for" << std::endl;
+	std::cout << "Stream buffer: " << (streamBuffer.persistent ? "persistent" : "unsynchronized") << ", " << streamBuffer.frames() << " frames of "
+		<< streamBuffer.frameSize() / (1024.0 * 1024.0) << " MB, " << streamBuffer.fenceWaitMs / measuredFrames << " ms per frame waiting on fences ("
+		<< 100.0 * streamBuffer.framesWaited / measuredFrames << "% of frames)" << std::endl;
+	benchmark.addMetric("frame_interval_ms", Benchmark::mean(framePacer.intervals));
+	benchmark.addMetric("frame_jitter_ms", framePacer.jitter());
+	benchmark.addMetric("input_to_photon_ms", Benchmark::mean(framePacer.latencies));
+	benchmark.addMetric("input_to_photon_p99_ms", Benchmark::percentile(framePacer.latencies, 99.0));
+	// input to photon ends when the swap returns, the display's own scan-out isn't visible from here
+	std::cout << "Frame pacing: " << (options.headless ? std::string("no swaps") : "swap interval " + std::to_string(options.swapInterval)) << ", "
+		<< (options.fpsCap > 0.0 ? std::to_string((int)options.fpsCap) + " fps cap" : std::string("uncapped")) << (options.lowLatency ? ", low latency" : "")
+		<< "; " << Benchmark::mean(framePacer.intervals) << " ms between frames, jitter " << framePacer.jitter() << " ms, input to photon "
+		<< Benchmark::mean(framePacer.latencies) << " ms (p99 " << Benchmark::percentile(framePacer.latencies, 99.0) << " ms)" << std::endl;
+	std::cout << "Shadow cascades rendered per frame: " << cascadesRenderedTotal / measuredFrames << " of " << shadowMap.cascadeCount << std::endl;
+	if (mainFeatures & FEATURE_POINT_LIGHT)
+	{
+		std::cout << "Point lights: " << pointLights.lights.size() << ", " << lightReferencesTotal / measuredFrames / CLUSTER_COUNT
+			<< " per cluster, binned in " << lightBinningTotal / measuredFrames << " ms" << std::endl;
+	}
 
-		// check and call events and swap the buffers
-		glfwPollEvents();
-		glfwSwapBuffers(window);
+	if (options.headless)
+	{
+		const char* renderer = (const char*)glGetString(GL_RENDERER);
+		if (benchmark.writeReport(options.reportPath, scrWidth, scrHeight, renderer ? renderer : "unknown"))
+		{
+			std::cout << "Benchmark: " << benchmark.sampleCount() << " frames, p50 "
+				<< Benchmark::percentile(benchmark.frameSamples(), 50.0) << " ms, report written to "
+				<< options.reportPath << std::endl;
+		}
+		glDeleteRenderbuffers(1, &mainColorRBO);
+		glDeleteRenderbuffers(1, &mainDepthRBO);
+		glDeleteFramebuffers(1, &mainFBO);
 	}
 
 	// de-allocating resources
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteBuffers(1, &planeVBO);
-	glDeleteVertexArrays(1, &skyboxVAO);
-	glDeleteBuffers(1, &skyboxVBO);
+	shaderReloader.stop();
+	assets.destroy();
+	depthReadback.destroy();
+	geometry.destroy();
+	glDeleteBuffers(1, &frameUBO.ID);
+	glDeleteBuffers(1, &lightUBO.ID);
+	glDeleteBuffers(1, &shadowUBO.ID);
+	glDeleteBuffers(1, &clusterUBO.ID);
+	shadowMap.destroy();
+	pointLights.destroy();
+	profiler.destroy();
+	streamBuffer.destroy();
 
 	glfwTerminate();
 	return 0;
 }
 
+// parses the command line into options; returns false on bad input
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless") options.headless = true;
+		else if (arg == "--frames" && hasValue) options.frames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--warmup" && hasValue) options.warmupFrames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--width" && hasValue) scrWidth = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--height" && hasValue) scrHeight = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--report" && hasValue) options.reportPath = argv[++i];
+		else if (arg == "--record" && hasValue) options.recordPath = argv[++i];
+		else if (arg == "--replay" && hasValue) options.replayPath = argv[++i];
+		else if (arg == "--timestep" && hasValue) options.timestep = std::strtof(argv[++i], NULL);
+		else if (arg == "--instancing") options.instancing = true;
+		else if (arg == "--cubes" && hasValue) options.extraCubes = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--vertex-format" && hasValue)
+		{
+			std::string format = argv[++i];
+			if (format == "float") options.vertexFormat = VERTEX_FORMAT_FLOAT;
+			else if (format == "packed") options.vertexFormat = VERTEX_FORMAT_PACKED;
+			else if (format == "half") options.vertexFormat = VERTEX_FORMAT_PACKED_HALF;
+			else
+			{
+				std::cout << "Unknown vertex format: " << format << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--shader-cache" && hasValue)
+		{
+			options.shaderCacheDirectory = argv[++i];
+			if (options.shaderCacheDirectory == "none") options.shaderCacheDirectory.clear();
+		}
+		else if (arg == "--no-culling") options.culling = false;
+		else if (arg == "--no-hot-reload") options.hotReload = false;
+		else if (arg == "--cascades" && hasValue) options.shadowCascades = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--cascade-split" && hasValue) options.cascadeSplitLambda = std::strtof(argv[++i], NULL);
+		else if (arg == "--shadow-size" && hasValue) options.shadowMapSize = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--shadow-distance" && hasValue) options.shadowDistance = std::strtof(argv[++i], NULL);
+		else if (arg == "--no-shadow-cache") options.shadowCache = false;
+		else if (arg == "--shadow-filter" && hasValue)
+		{
+			std::string filter = argv[++i];
+			int mode = 0;
+			while (mode < SHADOW_FILTER_COUNT && filter != shadowFilterNames[mode]) mode++;
+			if (mode == SHADOW_FILTER_COUNT)
+			{
+				std::cout << "Unknown shadow filter: " << filter << std::endl;
+				return false;
+			}
+			options.shadowFilter = (ShadowFilter)mode;
+		}
+		else if (arg == "--shadow-kernel" && hasValue) options.shadowKernel = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--no-shadows") options.shadows = false;
+		else if (arg == "--no-point-light") options.pointLight = false;
+		else if (arg == "--no-directional-light") options.directionalLight = false;
+		else if (arg == "--no-specular") options.specular = false;
+		else if (arg == "--lazy-shaders") options.prewarmShaders = false;
+		else if (arg == "--moving-cubes" && hasValue) options.movingCubes = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--lights" && hasValue) options.pointLights = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--depth-prepass") options.depthPrepass = true;
+		else if (arg == "--profile") options.profile = true;
+		else if (arg == "--trace" && hasValue)
+		{
+			options.trace = true;
+			options.tracePath = argv[++i];
+		}
+		else if (arg == "--trace-frames" && hasValue) options.traceFrames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--workers" && hasValue) options.workers = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--no-pipeline") options.pipeline = false;
+		else if (arg == "--worker-sweep") options.workerSweep = true;
+		else if (arg == "--stream-frames" && hasValue) options.streamFrames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--no-persistent-map") options.persistentMapping = false;
+		else if (arg == "--no-multi-draw") options.multiDraw = false;
+		else if (arg == "--model" && hasValue) options.modelPath = argv[++i];
+		else if (arg == "--import-benchmark" && hasValue) options.importBenchmark = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		else if (arg == "--no-lod") options.lod = false;
+		else if (arg == "--swap-interval" && hasValue) options.swapInterval = (int)std::strtol(argv[++i], NULL, 10);
+		else if (arg == "--fps-cap" && hasValue) options.fpsCap = std::strtod(argv[++i], NULL);
+		else if (arg == "--low-latency") options.lowLatency = true;
+		else if (arg == "--occlusion" && hasValue)
+		{
+			std::string mode = argv[++i];
+			int occlusion = 0;
+			while (occlusion <= OCCLUSION_RASTER && mode != occlusionModeNames[occlusion]) occlusion++;
+			if (occlusion > OCCLUSION_RASTER)
+			{
+				std::cout << "Unknown occlusion mode: " << mode << std::endl;
+				return false;
+			}
+			options.occlusion = (OcclusionMode)occlusion;
+		}
+		else if (arg == "--lod-error" && hasValue) options.lodPixels = std::strtof(argv[++i], NULL);
+		else if (arg == "--threshold" && hasValue) options.regressionThreshold = std::strtod(argv[++i], NULL);
+		else if (arg == "--compare" && i + 2 < argc)
+		{
+			options.compareBase = argv[++i];
+			options.compareCandidate = argv[++i];
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete option: " << arg << std::endl;
+			std::cout << "Usage: FinalProject [--headless] [--frames N] [--warmup N] [--width W] [--height H] [--report PATH]\n"
+				<< "                    [--record PATH | --replay PATH] [--timestep S] [--instancing] [--cubes N]\n"
+				<< "                    [--vertex-format float|packed|half] [--shader-cache DIR|none] [--no-hot-reload]\n"
+				<< "                    [--no-culling] [--cascades N] [--cascade-split L] [--shadow-size N] [--shadow-distance D]\n"
+				<< "                    [--no-shadow-cache] [--moving-cubes N] [--shadow-filter pcf|poisson|vsm|esm] [--shadow-kernel N]\n"
+				<< "                    [--no-shadows] [--no-point-light] [--no-directional-light] [--no-specular] [--lazy-shaders]\n"
+				<< "                    [--lights N] [--depth-prepass] [--profile] [--trace PATH] [--trace-frames N]\n"
+				<< "                    [--workers N] [--no-pipeline] [--worker-sweep] [--stream-frames N] [--no-persistent-map]\n"
+				<< "                    [--no-multi-draw] [--model PATH] [--import-benchmark N] [--no-lod] [--lod-error PX]\n"
+				<< "                    [--occlusion off|hiz|raster] [--swap-interval N] [--fps-cap N] [--low-latency]\n"
+				<< "       FinalProject --compare BASE.json NEW.json [--threshold PCT]" << std::endl;
+			return false;
+		}
+	}
+	if (!options.recordPath.empty() && !options.replayPath.empty())
+	{
+		std::cout << "--record and --replay can't be used together" << std::endl;
+		return false;
+	}
+	if (options.shadowCascades == 0 || options.shadowCascades > MAX_SHADOW_CASCADES)
+	{
+		std::cout << "Cascades must be between 1 and " << MAX_SHADOW_CASCADES << std::endl;
+		return false;
+	}
+	if (options.cascadeSplitLambda < 0.0f || options.cascadeSplitLambda > 1.0f || options.shadowMapSize == 0 || options.shadowDistance <= 0.1f)
+	{
+		std::cout << "Bad shadow settings: split must be 0-1, size non-zero and distance beyond the near plane" << std::endl;
+		return false;
+	}
+	if (options.shadowKernel == 0 || options.shadowKernel > MAX_SHADOW_KERNEL)
+	{
+		std::cout << "Shadow kernel must be between 1 and " << MAX_SHADOW_KERNEL << std::endl;
+		return false;
+	}
+	if (options.streamFrames < 2 || options.streamFrames > MAX_STREAM_FRAMES)
+	{
+		std::cout << "--stream-frames must be between 2 and " << MAX_STREAM_FRAMES << std::endl;
+		return false;
+	}
+	if (options.traceFrames == 0)
+	{
+		std::cout << "--trace-frames must be at least 1" << std::endl;
+		return false;
+	}
+	if (options.pointLights == 0)
+	{
+		std::cout << "--lights must be at least 1, use --no-point-light to turn point lights off" << std::endl;
+		return false;
+	}
+	if (options.movingCubes > options.extraCubes)
+	{
+		std::cout << "--moving-cubes can't exceed --cubes" << std::endl;
+		return false;
+	}
+	if (options.lodPixels <= 0.0f)
+	{
+		std::cout << "--lod-error must be positive" << std::endl;
+		return false;
+	}
+	if (options.fpsCap < 0.0)
+	{
+		std::cout << "--fps-cap can't be negative" << std::endl;
+		return false;
+	}
+	// a frame prepared ahead would be built from input read a frame before it's drawn
+	if (options.lowLatency) options.pipeline = false;
+	if (options.timestep <= 0.0f)
+	{
+		std::cout << "Timestep must be positive" << std::endl;
+		return false;
+	}
+	if (scrWidth == 0 || scrHeight == 0)
+	{
+		std::cout << "Width and height must be non-zero" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 // for resizing windows
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -669,6 +1725,12 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	if (pitch > 89.0f) pitch = 89.0f;
 	if (pitch < -89.0f) pitch = -89.0f;
 
+	updateCameraFront();
+}
+
+// rebuilds cameraFront from yaw and pitch
+void updateCameraFront()
+{
 	glm::vec3 direction;
 	direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
 	direction.y = sin(glm::radians(pitch));
@@ -0,0 +1,439 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "glcaps.h"
+#include "texturefile.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// staging buffers in the upload ring; a texture takes one from the frame its images are decoded until
+// the GPU has read it
+#define ASSET_UPLOAD_BUFFERS 3
+
+// block-compressed formats, not part of the core 3.3 headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+/// <summary>
+/// Decoded image waiting for its upload, plus where the time went
+/// </summary>
+struct LoadedImage
+{
+	std::string path;
+	unsigned char* pixels = NULL;	// stb_image allocation, RGB8
+	int width = 0, height = 0;
+	unsigned int worker = 0;		// thread pool worker that decoded it
+	double decodeMs = 0.0;
+	std::string error;				// stb_image's reason when decoding failed, read on the thread that decoded it
+};
+
+/// <summary>
+/// Loads assets on a thread pool and uploads them on the GL thread through a ring of pixel buffer objects.
+/// Textures are created right away with a placeholder so they can be bound from the first frame. Once
+/// every image of a texture is decoded, update() maps a free staging buffer and a worker copies the
+/// pixels into it; the update after that unmaps it, points the texture at it and fences it, and the
+/// buffer goes back into the ring when the fence says the GPU has read it.
+/// </summary>
+class AssetLoader
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit AssetLoader(ThreadPool& pool) : pool(pool), start(Clock::now())
+	{
+	}
+
+	// creates a cube map showing placeholderColor and queues its six faces (+x, -x, +y, -y, +z, -z) for decoding
+	unsigned int loadCubemap(const std::string faces[6], const unsigned char placeholderColor[3])
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholderColor);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		std::shared_ptr<TextureLoad> load = std::make_shared<TextureLoad>();
+		load->texture = texture;
+		load->target = GL_TEXTURE_CUBE_MAP;
+		load->images.resize(6);
+		load->remaining = 6;
+		load->requested = Clock::now();
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			load->images[i].path = faces[i];
+			decode(load, i);
+		}
+		pending++;
+		return texture;
+	}
+
+	// uploads a texture cooked by the Cooker project straight from the file mapping, mip chain included;
+	// returns 0 if the file is missing or the driver can't sample its format
+	unsigned int loadCookedTexture(const std::string& path)
+	{
+		Clock::time_point loadStart = Clock::now();
+		TextureFile file;
+		if (!file.open(path)) return 0;
+		const TextureFileHeader& header = *file.header;
+
+		static const char* formatNames[TEXTURE_FORMAT_COUNT] = { "rgba8", "bc1", "bc7" };
+		GLenum internalFormat = GL_RGBA8;
+		if (header.format == TEXTURE_FORMAT_BC1) internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		else if (header.format == TEXTURE_FORMAT_BC7) internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+		bool supported = header.format == TEXTURE_FORMAT_RGBA8
+			|| (header.format == TEXTURE_FORMAT_BC1 && (hasGLExtension("GL_EXT_texture_compression_s3tc") || hasGLExtension("GL_EXT_texture_compression_dxt1")))
+			|| (header.format == TEXTURE_FORMAT_BC7 && (hasGLVersion(4, 2) || hasGLExtension("GL_ARB_texture_compression_bptc")));
+		if (!supported)
+		{
+			std::cout << "ERROR::ASSETS::FORMAT_NOT_SUPPORTED " << path << " (" << formatNames[header.format] << ")" << std::endl;
+			return 0;
+		}
+
+		GLenum target = header.faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(target, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (uint32_t face = 0; face < header.faces; face++)
+		{
+			GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+			for (uint32_t mip = 0; mip < header.mipCount; mip++)
+			{
+				// the driver reads straight out of the page cache, nothing is decoded or copied on our side
+				GLsizei width = (GLsizei)textureMipDimension(header.width, mip), height = (GLsizei)textureMipDimension(header.height, mip);
+				const unsigned char* data = file.levelData(face, mip);
+				if (header.format == TEXTURE_FORMAT_RGBA8)
+				{
+					glTexImage2D(faceTarget, mip, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+				}
+				else
+				{
+					glCompressedTexImage2D(faceTarget, mip, internalFormat, width, height, 0, (GLsizei)file.level(face, mip).size, data);
+				}
+			}
+		}
+		setSampling(target, header.mipCount);
+
+		std::cout << "Asset " << path << ": " << header.width << "x" << header.height << ", " << header.faces
+			<< (header.faces == 1 ? " face, " : " faces, ") << header.mipCount << " mips, " << formatNames[header.format]
+			<< ", uploaded from the mapping in " << msSince(loadStart) << " ms" << std::endl;
+		return texture;
+	}
+
+	// GL thread: uploads textures staged by the last update and stages newly decoded ones, as far as
+	// the ring has buffers free; returns the number of textures finished
+	unsigned int update()
+	{
+		std::vector<std::shared_ptr<TextureLoad>> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.swap(copied);
+			waiting.insert(waiting.end(), decoded.begin(), decoded.end());
+			decoded.clear();
+		}
+		unsigned int finished = 0;
+		for (std::shared_ptr<TextureLoad>& load : ready)
+		{
+			upload(*load);
+			finished++;
+		}
+
+		size_t staged = 0;
+		for (; staged < waiting.size(); staged++)
+		{
+			std::shared_ptr<TextureLoad>& load = waiting[staged];
+			if (!validate(*load))
+			{
+				// a texture with a missing face keeps its placeholder rather than going incomplete
+				report(*load, 0.0, false);
+				finished++;
+				continue;
+			}
+			int buffer = acquireBuffer();
+			if (buffer < 0) break;
+			if (!stage(load, buffer))
+			{
+				upload(*load);
+				finished++;
+			}
+		}
+		waiting.erase(waiting.begin(), waiting.begin() + staged);
+		pending -= finished;
+		return finished;
+	}
+
+	// GL thread: blocks until everything queued so far is uploaded, used where placeholders would skew results
+	void finish()
+	{
+		while (pending > 0)
+		{
+			if (update() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	bool busy() const
+	{
+		return pending > 0;
+	}
+
+	// GL thread: waits for the loads still in flight, their jobs write into this loader and its buffers
+	void destroy()
+	{
+		finish();
+		for (UploadBuffer& buffer : buffers)
+		{
+			if (buffer.fence) glDeleteSync(buffer.fence);
+			if (buffer.pbo) glDeleteBuffers(1, &buffer.pbo);
+			buffer = UploadBuffer();
+		}
+	}
+
+	// milliseconds from construction until the last upload so far finished
+	double loadingMs() const
+	{
+		return lastReadyMs;
+	}
+
+private:
+	struct TextureLoad
+	{
+		unsigned int texture;
+		GLenum target;
+		std::vector<LoadedImage> images;
+		std::atomic<unsigned int> remaining;
+		Clock::time_point requested;
+		int buffer = -1;				// staging buffer the pixels were copied into, -1 to upload from client memory
+		double copyMs = 0.0;
+	};
+	struct UploadBuffer
+	{
+		unsigned int pbo = 0;
+		GLsizeiptr size = 0;
+		GLsync fence = 0;				// the GPU is done reading once this signals
+		bool staging = false;			// mapped, or waiting for its texture upload
+	};
+
+	ThreadPool& pool;
+	Clock::time_point start;
+	std::mutex mutex;
+	std::vector<std::shared_ptr<TextureLoad>> decoded;	// filled by workers, drained by update()
+	std::vector<std::shared_ptr<TextureLoad>> copied;	// staged by workers, uploaded by the next update()
+	std::vector<std::shared_ptr<TextureLoad>> waiting;	// decoded, waiting for a staging buffer; GL thread only
+	UploadBuffer buffers[ASSET_UPLOAD_BUFFERS];		// GL thread only
+	unsigned int pending = 0;							// GL thread only
+	double lastReadyMs = 0.0;
+
+	void decode(std::shared_ptr<TextureLoad> load, unsigned int index)
+	{
+		pool.submit([this, load, index](unsigned int worker)
+		{
+			LoadedImage& image = load->images[index];
+			Clock::time_point decodeStart = Clock::now();
+			int channels;
+			image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &channels, 3);
+			// stb_image keeps the reason per thread (STBI_THREAD_LOCAL), so it has to be read here
+			if (!image.pixels) image.error = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";
+			image.decodeMs = msSince(decodeStart);
+			image.worker = worker;
+			// the last image of a texture hands the whole texture to the GL thread
+			if (--load->remaining == 0)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				decoded.push_back(load);
+			}
+		});
+	}
+
+	// true if every image decoded and they all have the same size
+	static bool validate(const TextureLoad& load)
+	{
+		bool complete = true;
+		for (const LoadedImage& image : load.images)
+		{
+			if (!image.pixels)
+			{
+				std::cout << "ERROR::ASSETS::IMAGE_NOT_LOADED " << image.path << ": " << image.error << std::endl;
+				complete = false;
+			}
+			else if (image.width != load.images[0].width || image.height != load.images[0].height)
+			{
+				std::cout << "ERROR::ASSETS::IMAGE_SIZE_MISMATCH " << image.path << std::endl;
+				complete = false;
+			}
+		}
+		return complete;
+	}
+
+	static GLsizeiptr imageSize(const LoadedImage& image)
+	{
+		return (GLsizeiptr)image.width * image.height * 3;
+	}
+
+	// a staging buffer nothing is mapped from and the GPU no longer reads, -1 if the ring is busy
+	int acquireBuffer()
+	{
+		for (int i = 0; i < ASSET_UPLOAD_BUFFERS; i++)
+		{
+			UploadBuffer& buffer = buffers[i];
+			if (buffer.staging) continue;
+			if (buffer.fence)
+			{
+				if (glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) continue;
+				glDeleteSync(buffer.fence);
+				buffer.fence = 0;
+			}
+			return i;
+		}
+		return -1;
+	}
+
+	// maps the buffer and has a worker copy the texture's images into it back to back; false if it
+	// couldn't be mapped, the caller uploads from the decoded images then
+	bool stage(std::shared_ptr<TextureLoad> load, int index)
+	{
+		UploadBuffer& buffer = buffers[index];
+		GLsizeiptr size = 0;
+		for (const LoadedImage& image : load->images) size += imageSize(image);
+
+		if (!buffer.pbo) glGenBuffers(1, &buffer.pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+		if (size > buffer.size)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+			buffer.size = size;
+		}
+		// the fence has signalled, nothing the GPU still reads can be overwritten
+		unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (!mapped) return false;
+
+		buffer.staging = true;
+		load->buffer = index;
+		pool.submit([this, load, mapped](unsigned int)
+		{
+			Clock::time_point copyStart = Clock::now();
+			GLsizeiptr offset = 0;
+			for (LoadedImage& image : load->images)
+			{
+				std::memcpy(mapped + offset, image.pixels, (size_t)imageSize(image));
+				offset += imageSize(image);
+				stbi_image_free(image.pixels);
+				image.pixels = NULL;
+			}
+			load->copyMs = msSince(copyStart);
+			std::lock_guard<std::mutex> lock(mutex);
+			copied.push_back(load);
+		});
+		return true;
+	}
+
+	// points the texture at its staging buffer, or at the decoded images if it has none
+	void upload(TextureLoad& load)
+	{
+		Clock::time_point uploadStart = Clock::now();
+		bool complete = true;
+		if (load.buffer >= 0)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[load.buffer].pbo);
+			// the contents are undefined if the driver lost the mapping, e.g. on a mode switch
+			if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+			{
+				std::cout << "ERROR::ASSETS::STAGING_BUFFER_LOST texture " << load.texture << std::endl;
+				complete = false;
+			}
+		}
+
+		// a texture whose staging copy was lost keeps its placeholder
+		if (complete)
+		{
+			glBindTexture(load.target, load.texture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			GLsizeiptr offset = 0;
+			for (unsigned int i = 0; i < load.images.size(); i++)
+			{
+				LoadedImage& image = load.images[i];
+				GLenum target = load.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : load.target;
+				// from the buffer the pointer is an offset into it, and glTexImage2D returns without waiting for the transfer
+				const void* pixels = load.buffer >= 0 ? (const void*)offset : image.pixels;
+				glTexImage2D(target, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+				offset += imageSize(image);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+			// decoded at runtime, so the mip chain has to be built here too
+			glGenerateMipmap(load.target);
+			setSampling(load.target, 0);
+		}
+		if (load.buffer >= 0)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			UploadBuffer& buffer = buffers[load.buffer];
+			buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			buffer.staging = false;
+		}
+		report(load, msSince(uploadStart), complete);
+	}
+
+	void report(TextureLoad& load, double uploadMs, bool uploaded)
+	{
+		double readyMs = std::chrono::duration<double, std::milli>(Clock::now() - load.requested).count();
+		lastReadyMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		for (LoadedImage& image : load.images)
+		{
+			std::cout << "Asset " << image.path << ": " << image.width << "x" << image.height << ", decoded in "
+				<< image.decodeMs << " ms on worker " << image.worker << std::endl;
+			stbi_image_free(image.pixels);
+			image.pixels = NULL;
+		}
+		if (!uploaded)
+		{
+			std::cout << "Asset texture " << load.texture << ": keeping the placeholder" << std::endl;
+			return;
+		}
+		std::cout << "Asset texture " << load.texture << ": copied in " << load.copyMs << " ms, uploaded in " << uploadMs
+			<< " ms, ready " << readyMs << " ms after the request" << std::endl;
+	}
+
+	// trilinear filtering over mipCount levels, 0 for a chain built by glGenerateMipmap
+	static void setSampling(GLenum target, uint32_t mipCount)
+	{
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (mipCount > 0) glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)mipCount - 1);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (target == GL_TEXTURE_CUBE_MAP) glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+	static double msSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+};
+
+#endif
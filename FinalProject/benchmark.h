@@ -0,0 +1,231 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// render passes that get their own timing bucket
+enum BenchmarkPass
+{
+	PASS_SHADOW = 0,
+	PASS_MAIN,
+	PASS_SKYBOX,
+	PASS_COUNT
+};
+
+/// <summary>
+/// Collects per-pass and per-frame CPU times and writes them out as a JSON report
+/// </summary>
+class Benchmark
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	bool enabled = false;
+	unsigned int warmupFrames = 0; // frames rendered before samples are kept
+	std::string label;				// describes the configuration that was measured
+
+	void beginFrame()
+	{
+		if (!enabled) return;
+		frameStart = Clock::now();
+	}
+	void beginPass(BenchmarkPass pass)
+	{
+		if (!enabled) return;
+		passStart[pass] = Clock::now();
+	}
+	void endPass(BenchmarkPass pass)
+	{
+		if (!enabled) return;
+		currentPassTimes[pass] = msSince(passStart[pass]);
+	}
+	void endFrame()
+	{
+		if (!enabled) return;
+		double frameTime = msSince(frameStart);
+		if (framesSeen++ < warmupFrames) return;
+		frameTimes.push_back(frameTime);
+		for (int i = 0; i < PASS_COUNT; i++) passTimes[i].push_back(currentPassTimes[i]);
+	}
+
+	// one-off values reported next to the timings, e.g. startup costs or counters
+	void addMetric(const std::string& name, double value)
+	{
+		for (auto& metric : metrics)
+		{
+			if (metric.first == name)
+			{
+				metric.second = value;
+				return;
+			}
+		}
+		metrics.push_back(std::make_pair(name, value));
+	}
+
+	size_t sampleCount() const
+	{
+		return frameTimes.size();
+	}
+	const std::vector<double>& frameSamples() const
+	{
+		return frameTimes;
+	}
+
+	// nearest-rank percentile, p in [0, 100]
+	static double percentile(std::vector<double> samples, double p)
+	{
+		if (samples.empty()) return 0.0;
+		std::sort(samples.begin(), samples.end());
+		// the smallest sample with at least p percent of the samples at or below it
+		double rank = std::ceil(p / 100.0 * samples.size());
+		size_t index = rank < 1.0 ? 0 : (size_t)rank - 1;
+		return samples[std::min(index, samples.size() - 1)];
+	}
+	static double mean(const std::vector<double>& samples)
+	{
+		if (samples.empty()) return 0.0;
+		double sum = 0.0;
+		for (double s : samples) sum += s;
+		return sum / samples.size();
+	}
+
+	// writes the report; returns false if the file could not be opened
+	bool writeReport(const std::string& path, unsigned int width, unsigned int height, const std::string& renderer) const
+	{
+		std::ofstream out(path);
+		if (!out)
+		{
+			std::cout << "ERROR::BENCHMARK::REPORT_NOT_WRITABLE " << path << std::endl;
+			return false;
+		}
+		static const char* passNames[PASS_COUNT] = { "shadow", "main", "skybox" };
+
+		out << "{\n";
+		out << "  \"renderer\": \"" << escape(renderer) << "\",\n";
+		out << "  \"label\": \"" << escape(label) << "\",\n";
+		out << "  \"width\": " << width << ",\n";
+		out << "  \"height\": " << height << ",\n";
+		out << "  \"warmup_frames\": " << warmupFrames << ",\n";
+		out << "  \"frames\": " << frameTimes.size() << ",\n";
+		out << "  \"metrics\": {";
+		for (size_t i = 0; i < metrics.size(); i++)
+		{
+			out << (i ? ", " : " ") << "\"" << escape(metrics[i].first) << "\": " << metrics[i].second;
+		}
+		out << " },\n";
+		out << "  \"passes\": {\n";
+		for (int i = 0; i < PASS_COUNT; i++)
+		{
+			out << "    \"" << passNames[i] << "\": ";
+			writeStats(out, passTimes[i]);
+			out << (i + 1 < PASS_COUNT ? ",\n" : "\n");
+		}
+		out << "  },\n";
+		out << "  \"frame\": ";
+		writeStats(out, frameTimes);
+		out << "\n}\n";
+		return true;
+	}
+
+	// compares two reports written by writeReport and flags every percentile that got slower than
+	// the baseline by more than thresholdPercent; returns true if there was no regression. A stat
+	// missing from either report fails the comparison, so a truncated or foreign report can't pass it
+	static bool compareReports(const std::string& basePath, const std::string& candidatePath, double thresholdPercent)
+	{
+		std::string base, candidate;
+		if (!readFile(basePath, base) || !readFile(candidatePath, candidate)) return false;
+
+		static const char* sections[] = { "\"shadow\"", "\"main\"", "\"skybox\"", "\"frame\"" };
+		static const char* keys[] = { "\"p50_ms\"", "\"p95_ms\"", "\"p99_ms\"" };
+		bool passed = true;
+		for (const char* section : sections)
+		{
+			for (const char* key : keys)
+			{
+				double before = 0.0, after = 0.0;
+				bool inBase = readStat(base, section, key, before), inCandidate = readStat(candidate, section, key, after);
+				if (!inBase || !inCandidate)
+				{
+					std::cout << section << " " << key << ": missing from " << (inBase ? candidatePath : basePath) << "  ERROR" << std::endl;
+					passed = false;
+					continue;
+				}
+				double change = before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+				bool regressed = change > thresholdPercent;
+				passed = passed && !regressed;
+				std::cout << section << " " << key << ": " << before << " -> " << after << " ms ("
+					<< (change >= 0.0 ? "+" : "") << change << "%)" << (regressed ? "  REGRESSION" : "") << std::endl;
+			}
+		}
+		std::cout << (passed ? "No regressions above " : "Regressions found above ") << thresholdPercent << "%" << std::endl;
+		return passed;
+	}
+
+private:
+	Clock::time_point frameStart;
+	Clock::time_point passStart[PASS_COUNT];
+	unsigned int framesSeen = 0;
+	double currentPassTimes[PASS_COUNT] = {};
+	std::vector<double> passTimes[PASS_COUNT];
+	std::vector<double> frameTimes;
+	std::vector<std::pair<std::string, double>> metrics;
+
+	static double msSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+	static void writeStats(std::ostream& out, const std::vector<double>& samples)
+	{
+		out << "{ \"mean_ms\": " << mean(samples)
+			<< ", \"p50_ms\": " << percentile(samples, 50.0)
+			<< ", \"p95_ms\": " << percentile(samples, 95.0)
+			<< ", \"p99_ms\": " << percentile(samples, 99.0)
+			<< ", \"max_ms\": " << percentile(samples, 100.0) << " }";
+	}
+	static bool readFile(const std::string& path, std::string& text)
+	{
+		std::ifstream in(path);
+		if (!in)
+		{
+			std::cout << "ERROR::BENCHMARK::REPORT_NOT_READABLE " << path << std::endl;
+			return false;
+		}
+		std::stringstream stream;
+		stream << in.rdbuf();
+		text = stream.str();
+		return true;
+	}
+	// finds "section": { ... "key": value } in a report; only handles the flat layout writeReport produces
+	static bool readStat(const std::string& text, const char* section, const char* key, double& value)
+	{
+		size_t sectionPos = text.find(std::string(section) + ": {");
+		if (sectionPos == std::string::npos) return false;
+		size_t end = text.find('}', sectionPos);
+		size_t keyPos = text.find(key, sectionPos);
+		if (keyPos == std::string::npos || keyPos > end) return false;
+		value = std::strtod(text.c_str() + keyPos + std::strlen(key) + 1, NULL);
+		return true;
+	}
+	static std::string escape(const std::string& text)
+	{
+		std::string result;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\') result += '\\';
+			result += c;
+		}
+		return result;
+	}
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Camera state for a single frame
+/// </summary>
+struct CameraSample
+{
+	float time;			// seconds since the recording started
+	float x, y, z;		// camera position
+	float yaw, pitch;	// camera orientation in degrees
+};
+
+/// <summary>
+/// Recorded camera path, stored as a small header followed by tightly packed samples
+/// </summary>
+class CameraPath
+{
+public:
+	std::vector<CameraSample> samples;
+
+	void record(float time, const glm::vec3& position, float yaw, float pitch)
+	{
+		samples.push_back({ time, position.x, position.y, position.z, yaw, pitch });
+	}
+
+	size_t size() const
+	{
+		return samples.size();
+	}
+	const CameraSample& operator[](size_t index) const
+	{
+		return samples[index];
+	}
+
+	bool save(const std::string& path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		if (!out)
+		{
+			std::cout << "ERROR::CAMERAPATH::FILE_NOT_WRITABLE " << path << std::endl;
+			return false;
+		}
+		uint32_t header[3] = { MAGIC, VERSION, (uint32_t)samples.size() };
+		out.write((const char*)header, sizeof(header));
+		out.write((const char*)samples.data(), samples.size() * sizeof(CameraSample));
+		return (bool)out;
+	}
+
+	bool load(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		uint32_t header[3] = {};
+		if (!in || !in.read((char*)header, sizeof(header)) || header[0] != MAGIC || header[1] != VERSION)
+		{
+			std::cout << "ERROR::CAMERAPATH::FILE_NOT_VALID " << path << std::endl;
+			return false;
+		}
+		// the sample count is checked against what the file holds before anything is allocated for it
+		std::streamoff start = in.tellg();
+		in.seekg(0, std::ios::end);
+		std::streamoff remaining = in.tellg() - start;
+		in.seekg(start);
+		if (!in || remaining < 0 || (uint64_t)header[2] * sizeof(CameraSample) > (uint64_t)remaining)
+		{
+			std::cout << "ERROR::CAMERAPATH::FILE_TRUNCATED " << path << std::endl;
+			samples.clear();
+			return false;
+		}
+		samples.resize(header[2]);
+		if (!in.read((char*)samples.data(), samples.size() * sizeof(CameraSample)))
+		{
+			std::cout << "ERROR::CAMERAPATH::FILE_TRUNCATED " << path << std::endl;
+			samples.clear();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static const uint32_t MAGIC = 0x48545043; // "CPTH"
+	static const uint32_t VERSION = 1;
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// cluster grid: screen tiles times exponentially spaced view-depth slices, mirrored by ClusterData in source.fsh
+const unsigned int CLUSTER_TILES_X = 16;
+const unsigned int CLUSTER_TILES_Y = 9;
+const unsigned int CLUSTER_SLICES = 24;
+const unsigned int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+/// <summary>
+/// Point light with a finite range; two RGBA32F texels in the light buffer
+/// </summary>
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;		// the light fades out to nothing at this distance
+	glm::vec3 color;
+	float intensity;
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must be two vec4 texels");
+
+/// <summary>
+/// One frame's light lists, filled by ClusteredLights::bin() on any thread and handed to GL by upload()
+/// </summary>
+struct LightClusterLists
+{
+	std::vector<uint32_t> clusters;				// offset and count per cluster
+	std::vector<uint32_t> indices;
+	float sliceScale = 0.0f, sliceBias = 0.0f;	// slice = log(view depth) * scale + bias
+	unsigned int indexCount = 0;				// light references over all clusters
+	double binMilliseconds = 0.0;
+};
+
+/// <summary>
+/// Clustered forward lighting: the view frustum is cut into a grid of clusters and every cluster
+/// gets the list of point lights whose spheres touch it, so a fragment only walks the lights near it.
+/// The lists are rebuilt every frame on the thread pool, one depth slice per job, and handed to the
+/// shaders through texture buffers. Binning needs no GL, so it can run ahead of the frame being drawn.
+/// </summary>
+class ClusteredLights
+{
+public:
+	std::vector<PointLight> lights;		// world space; call uploadLights() after editing
+
+	unsigned int lightTexture = 0, clusterTexture = 0, indexTexture = 0;
+
+	void create()
+	{
+		GLint maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		maxIndices = (unsigned int)std::max(maxTexels, 65536);
+
+		createBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+		createBuffer(clusterBuffer, clusterTexture, GL_RG32UI);
+		createBuffer(indexBuffer, indexTexture, GL_R32UI);
+		uploadLights();
+	}
+
+	void uploadLights()
+	{
+		if (lights.size() * 2 > maxIndices)
+		{
+			std::cout << "ERROR::CLUSTERS::TOO_MANY_LIGHTS " << lights.size() << ", keeping " << maxIndices / 2 << std::endl;
+			lights.resize(maxIndices / 2);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, lights.size() * sizeof(PointLight), lights.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// bins every light into the clusters of a view; one call at a time, from any thread
+	void bin(const glm::mat4& view, float fovy, float aspect, float nearPlane, float farPlane, ThreadPool& pool, LightClusterLists& out)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (fovy != gridFovy || aspect != gridAspect || nearPlane != gridNear || farPlane != gridFar) buildGrid(fovy, aspect, nearPlane, farPlane);
+		out.clusters.resize(CLUSTER_COUNT * 2);
+		out.sliceScale = sliceScale;
+		out.sliceBias = sliceBias;
+
+		viewLights.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+		}
+
+		// slices are independent, each job writes only its own clusters and index list
+		pool.parallelFor(CLUSTER_SLICES, 1, [this, &out](unsigned int begin, unsigned int end)
+			{
+				PROFILE_SCOPE("bin light slice");
+				for (unsigned int slice = begin; slice < end; slice++) binSlice(slice, out.clusters);
+			});
+
+		// concatenate the per-slice lists and turn their local offsets into global ones
+		std::vector<uint32_t>& indices = out.indices;
+		unsigned int& indexCount = out.indexCount;
+		indices.clear();
+		indexCount = 0;
+		for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++)
+		{
+			unsigned int base = indexCount;
+			std::vector<uint32_t>& list = sliceIndices[slice];
+			size_t kept = std::min<size_t>(list.size(), maxIndices - indexCount);
+			indices.insert(indices.end(), list.begin(), list.begin() + kept);
+			indexCount += (unsigned int)kept;
+			for (unsigned int tile = 0; tile < CLUSTER_TILES_X * CLUSTER_TILES_Y; tile++)
+			{
+				uint32_t* cluster = &out.clusters[(slice * CLUSTER_TILES_X * CLUSTER_TILES_Y + tile) * 2];
+				cluster[0] = std::min(cluster[0] + base, indexCount);
+				cluster[1] = std::min(cluster[1], indexCount - cluster[0]);
+			}
+		}
+		if (indices.empty()) indices.push_back(0); // zero-sized buffers aren't valid texture storage
+		out.binMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// hands binned lists to the shaders; GL thread only
+	void upload(const LightClusterLists& lists)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, lists.clusters.size() * sizeof(uint32_t), lists.clusters.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, lists.indices.size() * sizeof(uint32_t), lists.indices.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// lights, clusters and indices on three consecutive texture units
+	void bind(unsigned int firstUnit) const
+	{
+		const unsigned int textures[3] = { lightTexture, clusterTexture, indexTexture };
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	void destroy()
+	{
+		glDeleteTextures(1, &lightTexture);
+		glDeleteTextures(1, &clusterTexture);
+		glDeleteTextures(1, &indexTexture);
+		glDeleteBuffers(1, &lightBuffer);
+		glDeleteBuffers(1, &clusterBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+	}
+
+private:
+	unsigned int lightBuffer = 0, clusterBuffer = 0, indexBuffer = 0;
+	unsigned int maxIndices = 65536;	// GL_MAX_TEXTURE_BUFFER_SIZE, at least 65536 in GL 3.3; longer lists are cut off
+
+	float gridFovy = 0.0f, gridAspect = 0.0f, gridNear = 0.0f, gridFar = 0.0f;
+	float tanHalfX = 0.0f, tanHalfY = 0.0f;
+	float sliceScale = 0.0f, sliceBias = 0.0f;
+	float sliceNear[CLUSTER_SLICES], sliceFar[CLUSTER_SLICES];	// view depth bounds of each slice
+
+	std::vector<glm::vec4> viewLights;		// view-space center and radius
+	std::vector<uint32_t> sliceIndices[CLUSTER_SLICES];
+
+	void createBuffer(unsigned int& buffer, unsigned int& texture, GLenum format)
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void buildGrid(float fovy, float aspect, float nearPlane, float farPlane)
+	{
+		gridFovy = fovy; gridAspect = aspect; gridNear = nearPlane; gridFar = farPlane;
+		tanHalfY = std::tan(fovy * 0.5f);
+		tanHalfX = tanHalfY * aspect;
+		// slice k covers near * (far / near)^(k / slices) to the next one, so clusters stay roughly cubic
+		float logRatio = std::log(farPlane / nearPlane);
+		sliceScale = CLUSTER_SLICES / logRatio;
+		sliceBias = -(float)CLUSTER_SLICES * std::log(nearPlane) / logRatio;
+		for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++)
+		{
+			sliceNear[slice] = nearPlane * std::pow(farPlane / nearPlane, (float)slice / CLUSTER_SLICES);
+			sliceFar[slice] = nearPlane * std::pow(farPlane / nearPlane, (float)(slice + 1) / CLUSTER_SLICES);
+		}
+	}
+
+	// tile range [first, last] covering the view-space interval [low, high] / depth, over depths [nearDepth, farDepth];
+	// false when it's off screen
+	static bool tileRange(float low, float high, float nearDepth, float farDepth, float tanHalf, unsigned int tiles, unsigned int& first, unsigned int& last)
+	{
+		// x / depth is monotonic in depth, so its extremes are at the depth bounds
+		float minimum = std::min(low / nearDepth, low / farDepth) / tanHalf;
+		float maximum = std::max(high / nearDepth, high / farDepth) / tanHalf;
+		int firstTile = (int)std::floor((minimum * 0.5f + 0.5f) * tiles);
+		int lastTile = (int)std::floor((maximum * 0.5f + 0.5f) * tiles);
+		if (lastTile < 0 || firstTile >= (int)tiles) return false;
+		first = (unsigned int)std::max(firstTile, 0);
+		last = (unsigned int)std::min(lastTile, (int)tiles - 1);
+		return true;
+	}
+
+	void binSlice(unsigned int slice, std::vector<uint32_t>& clusters)
+	{
+		struct Candidate
+		{
+			uint32_t light;
+			unsigned int firstX, lastX, firstY, lastY;
+		};
+		std::vector<Candidate> candidates;
+		float depthNear = sliceNear[slice], depthFar = sliceFar[slice];
+
+		// lights overlapping the slice's depth range, with the screen tiles their spheres project to
+		for (uint32_t i = 0; i < viewLights.size(); i++)
+		{
+			const glm::vec4& light = viewLights[i];
+			float depth = -light.z, radius = light.w;
+			if (depth + radius < depthNear || depth - radius > depthFar) continue;
+
+			Candidate candidate = { i, 0, CLUSTER_TILES_X - 1, 0, CLUSTER_TILES_Y - 1 };
+			float low = std::max(depth - radius, depthNear), high = std::min(depth + radius, depthFar);
+			if (!tileRange(light.x - radius, light.x + radius, low, high, tanHalfX, CLUSTER_TILES_X, candidate.firstX, candidate.lastX)) continue;
+			if (!tileRange(light.y - radius, light.y + radius, low, high, tanHalfY, CLUSTER_TILES_Y, candidate.firstY, candidate.lastY)) continue;
+			candidates.push_back(candidate);
+		}
+
+		// every tile walks the candidates and keeps those whose sphere touches its cluster's box
+		std::vector<uint32_t>& list = sliceIndices[slice];
+		list.clear();
+		for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++)
+		{
+			float y0 = (2.0f * y / CLUSTER_TILES_Y - 1.0f) * tanHalfY, y1 = (2.0f * (y + 1) / CLUSTER_TILES_Y - 1.0f) * tanHalfY;
+			for (unsigned int x = 0; x < CLUSTER_TILES_X; x++)
+			{
+				float x0 = (2.0f * x / CLUSTER_TILES_X - 1.0f) * tanHalfX, x1 = (2.0f * (x + 1) / CLUSTER_TILES_X - 1.0f) * tanHalfX;
+				// view-space box around the cluster's frustum piece
+				glm::vec3 boxMin(std::min(x0 * depthNear, x0 * depthFar), std::min(y0 * depthNear, y0 * depthFar), -depthFar);
+				glm::vec3 boxMax(std::max(x1 * depthNear, x1 * depthFar), std::max(y1 * depthNear, y1 * depthFar), -depthNear);
+
+				uint32_t* cluster = &clusters[((slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x) * 2];
+				cluster[0] = (uint32_t)list.size();
+				for (const Candidate& candidate : candidates)
+				{
+					if (x < candidate.firstX || x > candidate.lastX || y < candidate.firstY || y > candidate.lastY) continue;
+					const glm::vec4& light = viewLights[candidate.light];
+					glm::vec3 center(light);
+					glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+					glm::vec3 offset = center - closest;
+					if (glm::dot(offset, offset) <= light.w * light.w) list.push_back(candidate.light);
+				}
+				cluster[1] = (uint32_t)list.size() - cluster[0];
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "transforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Axis-aligned bounding box
+/// </summary>
+struct AABB
+{
+	glm::vec3 min, max;
+};
+
+// bounds of an object-space box after a transform, without transforming all eight corners
+inline AABB transformBounds(const glm::vec3& min, const glm::vec3& max, const glm::mat4& world)
+{
+	glm::vec3 center = glm::vec3(world * glm::vec4((min + max) * 0.5f, 1.0f));
+	glm::vec3 extent = (max - min) * 0.5f;
+	glm::vec3 worldExtent = glm::abs(glm::vec3(world[0])) * extent.x + glm::abs(glm::vec3(world[1])) * extent.y + glm::abs(glm::vec3(world[2])) * extent.z;
+	return { center - worldExtent, center + worldExtent };
+}
+
+inline AABB mergeBounds(const AABB& a, const AABB& b)
+{
+	return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+// result of testing a box against a frustum
+enum CullResult
+{
+	CULL_OUTSIDE = 0,
+	CULL_INTERSECTS,
+	CULL_INSIDE
+};
+
+/// <summary>
+/// Per-pass culling counters: boxes tested, objects rejected and objects left to draw
+/// </summary>
+struct CullStats
+{
+	unsigned int tested = 0, culled = 0, drawn = 0;
+	unsigned int occluded = 0;	// in the frustum but hidden, set by occlusion culling
+};
+
+/// <summary>
+/// Six clip planes pulled out of a view-projection matrix, stored as structure-of-arrays so a box
+/// is tested against four planes per SSE instruction
+/// </summary>
+class Frustum
+{
+public:
+	void extract(const glm::mat4& viewProjection)
+	{
+		// rows of the matrix; a point is inside when row3 +- rowN >= 0 (Gribb & Hartmann)
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++) rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+		glm::vec4 planes[8] = {
+			rows[3] + rows[0], rows[3] - rows[0],	// left, right
+			rows[3] + rows[1], rows[3] - rows[1],	// bottom, top
+			rows[3] + rows[2], rows[3] - rows[2],	// near, far
+			glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) // padding, always inside
+		};
+		for (int i = 0; i < 8; i++)
+		{
+			nx[i] = planes[i].x; ny[i] = planes[i].y; nz[i] = planes[i].z; w[i] = planes[i].w;
+		}
+	}
+
+	// a box is outside if it's fully behind any plane and inside if it's fully in front of all of them
+	CullResult test(const AABB& box) const
+	{
+		glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+#ifdef TRANSFORMS_SSE
+		__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+		__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+		__m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+		int outside = 0, intersects = 0;
+		for (int i = 0; i < 8; i += 4)
+		{
+			__m128 px = _mm_load_ps(&nx[i]), py = _mm_load_ps(&ny[i]), pz = _mm_load_ps(&nz[i]);
+			// signed distance of the center and the box's projected radius, for four planes at once
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(&w[i])));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+				_mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+			outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+			intersects |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+		}
+		if (outside) return CULL_OUTSIDE;
+		return intersects ? CULL_INTERSECTS : CULL_INSIDE;
+#else
+		bool intersects = false;
+		for (int i = 0; i < 6; i++)
+		{
+			float distance = nx[i] * center.x + ny[i] * center.y + nz[i] * center.z + w[i];
+			float radius = std::fabs(nx[i]) * extent.x + std::fabs(ny[i]) * extent.y + std::fabs(nz[i]) * extent.z;
+			if (distance + radius < 0.0f) return CULL_OUTSIDE;
+			if (distance - radius < 0.0f) intersects = true;
+		}
+		return intersects ? CULL_INTERSECTS : CULL_INSIDE;
+#endif
+	}
+
+private:
+	alignas(16) float nx[8], ny[8], nz[8], w[8];
+};
+
+/// <summary>
+/// Bounding volume hierarchy over object boxes, one object per leaf. Built once with median splits;
+/// moved objects are refit by walking from their leaf to the root.
+/// </summary>
+class BVH
+{
+public:
+	void build(const std::vector<AABB>& bounds)
+	{
+		nodes.clear();
+		order.resize(bounds.size());
+		leafOf.resize(bounds.size());
+		for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+		if (!bounds.empty()) buildNode(bounds, 0, (unsigned int)bounds.size(), -1);
+	}
+
+	size_t size() const
+	{
+		return order.size();
+	}
+
+	// box around every object, the root's bounds
+	AABB bounds() const
+	{
+		return nodes.empty() ? AABB{ glm::vec3(0.0f), glm::vec3(0.0f) } : nodes[0].bounds;
+	}
+
+	// updates one object's box and every ancestor that has to grow or shrink with it
+	void refit(unsigned int item, const AABB& bounds)
+	{
+		int node = leafOf[item];
+		nodes[node].bounds = bounds;
+		for (node = nodes[node].parent; node >= 0; node = nodes[node].parent)
+		{
+			AABB merged = mergeBounds(nodes[nodes[node].left].bounds, nodes[nodes[node].right].bounds);
+			if (merged.min == nodes[node].bounds.min && merged.max == nodes[node].bounds.max) break;
+			nodes[node].bounds = merged;
+		}
+	}
+
+	// appends every object whose box touches the frustum; subtrees fully inside skip further tests
+	CullStats cull(const Frustum& frustum, std::vector<unsigned int>& visible) const
+	{
+		CullStats stats;
+		visible.clear();
+		if (nodes.empty()) return stats;
+
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			stats.tested++;
+			CullResult result = frustum.test(node.bounds);
+			if (result == CULL_OUTSIDE) continue;
+			if (result == CULL_INSIDE || node.left < 0)
+			{
+				visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+				continue;
+			}
+			stack[top++] = node.right;
+			stack[top++] = node.left;
+		}
+		stats.drawn = (unsigned int)visible.size();
+		stats.culled = (unsigned int)order.size() - stats.drawn;
+		return stats;
+	}
+
+private:
+	struct Node
+	{
+		AABB bounds;
+		int parent;
+		int left, right;			// -1 for leaves
+		unsigned int first, count;	// range of objects in order[] below this node
+	};
+
+	std::vector<Node> nodes;
+	std::vector<unsigned int> order;	// object indices, every subtree is a contiguous range
+	std::vector<int> leafOf;			// object index -> leaf node
+
+	int buildNode(const std::vector<AABB>& bounds, unsigned int first, unsigned int count, int parent)
+	{
+		int index = (int)nodes.size();
+		nodes.push_back(Node());
+		Node node;
+		node.parent = parent;
+		node.first = first;
+		node.count = count;
+		node.left = node.right = -1;
+		node.bounds = bounds[order[first]];
+		glm::vec3 centroidMin = (node.bounds.min + node.bounds.max) * 0.5f, centroidMax = centroidMin;
+		for (unsigned int i = first + 1; i < first + count; i++)
+		{
+			const AABB& box = bounds[order[i]];
+			node.bounds = mergeBounds(node.bounds, box);
+			centroidMin = glm::min(centroidMin, (box.min + box.max) * 0.5f);
+			centroidMax = glm::max(centroidMax, (box.min + box.max) * 0.5f);
+		}
+
+		if (count == 1)
+		{
+			leafOf[order[first]] = index;
+		}
+		else
+		{
+			// split at the median centroid along the axis the centroids spread furthest on
+			glm::vec3 spread = centroidMax - centroidMin;
+			int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+			unsigned int half = count / 2;
+			std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+				[&bounds, axis](unsigned int a, unsigned int b)
+				{
+					return bounds[a].min[axis] + bounds[a].max[axis] < bounds[b].min[axis] + bounds[b].max[axis];
+				});
+			node.left = buildNode(bounds, first, half, index);
+			node.right = buildNode(bounds, first + half, count - half, index);
+		}
+		nodes[index] = node;
+		return index;
+	}
+};
+
+#endif
@@ -0,0 +1,7 @@
+// per-frame constants shared by every program, packs the same as FrameUniforms in uniforms.h
+layout(std140) uniform FrameData
+{
+	mat4 view, projection;
+	vec3 eyePos;
+	float time;
+};
\ No newline at end of file
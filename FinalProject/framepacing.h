@@ -0,0 +1,144 @@
+#ifndef FRAMEPACING_H
+#define FRAMEPACING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+/// <summary>
+/// Monotonic high-resolution clock for frame timing. Times are kept as clock ticks and only turned
+/// into seconds as differences, so deltas stay exact however long the program has been running.
+/// </summary>
+class FrameClock
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameClock() : start(Clock::now()), last(start) {}
+
+	// seconds since the tick before, and starts the next interval
+	double tick()
+	{
+		Clock::time_point now = Clock::now();
+		double delta = std::chrono::duration<double>(now - last).count();
+		last = now;
+		return delta;
+	}
+
+	// seconds from the clock's start to the last tick
+	double seconds() const
+	{
+		return std::chrono::duration<double>(last - start).count();
+	}
+
+private:
+	Clock::time_point start, last;
+};
+
+/// <summary>
+/// Holds frames to a rate cap, sleeping most of the way to the next frame's start and spinning the
+/// rest, since sleeps wake up late by an amount that depends on the OS timer. Also collects the
+/// present-to-present intervals and input latencies the pacing is judged by.
+/// </summary>
+class FramePacer
+{
+public:
+	typedef FrameClock::Clock Clock;
+
+	std::vector<double> intervals;	// ms between presents
+	std::vector<double> latencies;	// ms from the input a frame was built from to its present
+
+	FramePacer()
+	{
+#ifdef _WIN32
+		// the default timer period is 15.6 ms, longer than a frame
+		timeBeginPeriod(1);
+#endif
+	}
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	// frames per second to hold to, 0 for none
+	void setCap(double fps)
+	{
+		period = fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps)) : Clock::duration::zero();
+	}
+
+	// returns once the next frame is due. Frames are due a period after the one before was, so
+	// they don't drift; a frame more than a period late resets the schedule instead of hurrying
+	// the ones after it.
+	void wait()
+	{
+		Clock::time_point now = Clock::now();
+		if (period.count() == 0)
+		{
+			due = now;
+			return;
+		}
+		due += period;
+		if (now > due + period) due = now;
+		while (due - now > spinMargin)
+		{
+			Clock::duration request = due - now - spinMargin;
+			std::this_thread::sleep_for(request);
+			Clock::time_point woke = Clock::now();
+			// how late sleeps wake, kept as a margin that decays back when they get more punctual
+			Clock::duration late = woke - now - request;
+			spinMargin = std::max(late + late / 4, spinMargin - spinMargin / 16);
+			spinMargin = std::min(std::max(spinMargin, minimumMargin), period);
+			now = woke;
+		}
+		while (Clock::now() < due) std::this_thread::yield();
+	}
+
+	// a frame was presented; inputTime is when the input it was built from was read
+	void presented(Clock::time_point inputTime)
+	{
+		Clock::time_point now = Clock::now();
+		if (lastPresent != Clock::time_point()) intervals.push_back(std::chrono::duration<double, std::milli>(now - lastPresent).count());
+		latencies.push_back(std::chrono::duration<double, std::milli>(now - inputTime).count());
+		lastPresent = now;
+	}
+
+	// drops the samples so far, warm-up frames don't count
+	void reset()
+	{
+		intervals.clear();
+		latencies.clear();
+	}
+
+	// standard deviation of the present intervals
+	double jitter() const
+	{
+		if (intervals.empty()) return 0.0;
+		double average = 0.0, sum = 0.0;
+		for (double interval : intervals) average += interval / intervals.size();
+		for (double interval : intervals) sum += (interval - average) * (interval - average);
+		return std::sqrt(sum / intervals.size());
+	}
+
+private:
+	const Clock::duration minimumMargin = std::chrono::microseconds(200);
+	Clock::duration period = Clock::duration::zero();
+	Clock::duration spinMargin = std::chrono::milliseconds(1);
+	Clock::time_point due = Clock::now(), lastPresent;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "glcaps.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// ARB_draw_indirect isn't part of the 3.3 core headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+/// <summary>
+/// One draw of glMultiDrawElementsIndirect, laid out the way GL reads it from GL_DRAW_INDIRECT_BUFFER
+/// </summary>
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;	// added to the instance index of attributes with a divisor
+};
+
+typedef void (APIENTRY* MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+// glMultiDrawElementsIndirect, NULL where it's missing; its commands' baseInstance only works with
+// ARB_base_instance too, which GL 4.3 has built in
+inline MultiDrawElementsIndirectProc loadMultiDrawIndirect(void* (*loader)(const char* name))
+{
+	bool supported = hasGLVersion(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance"));
+	return supported ? (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect") : NULL;
+}
+
+/// <summary>
+/// Every static mesh in one vertex buffer and one index buffer. Meshes get a range of each from a
+/// first-fit allocator and are drawn with a base vertex, so meshes sharing a vertex layout also share
+/// a vertex array and any run of them can go out as one multi-draw. Vertices of different layouts
+/// sit in the same buffer, each range starting at a multiple of its own stride. Both buffers double
+/// when full, and everything in them is copied over on the GPU.
+/// </summary>
+class GeometryArena
+{
+public:
+	unsigned int vbo = 0, ebo = 0;
+
+	// vertexBytes and indexCount are the starting sizes
+	void create(GLsizeiptr vertexBytes, GLsizeiptr indexCount)
+	{
+		vertexCapacity = std::max<GLsizeiptr>(vertexBytes, 1024);
+		indexCapacity = std::max<GLsizeiptr>(indexCount, 1024);
+		vbo = createBuffer(vertexCapacity);
+		ebo = createBuffer(indexCapacity * sizeof(uint32_t));
+		freeVertices.assign(1, { 0, vertexCapacity });
+		freeIndices.assign(1, { 0, indexCapacity });
+	}
+
+	// uploads a mesh into the arena in the given format
+	Mesh add(const MeshData& data, VertexFormat format)
+	{
+		glm::vec3 boundsMin, boundsMax;
+		meshBounds(data, boundsMin, boundsMax);
+		std::vector<unsigned char> vertices = packVertices(data, format);
+		return addPacked(vertices.data(), data.vertexCount(), data.indices.data(), data.indices.size(), format,
+			!data.colors.empty(), !data.normals.empty(), boundsMin, boundsMax);
+	}
+
+	// uploads vertices already packed in the format's layout, e.g. straight from a cooked mesh file
+	Mesh addPacked(const void* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, VertexFormat format,
+		bool hasColors, bool hasNormals, glm::vec3 boundsMin, glm::vec3 boundsMax)
+	{
+		Mesh mesh;
+		mesh.vao = vertexArray(format, hasColors, hasNormals);
+		mesh.vertexStride = vertexStride(format, hasColors, hasNormals);
+		mesh.vertexCount = vertexCount;
+		mesh.indexCount = (GLsizei)indexCount;
+		mesh.boundsMin = boundsMin;
+		mesh.boundsMax = boundsMax;
+
+		GLsizeiptr vertexBytes = (GLsizeiptr)vertexCount * mesh.vertexStride;
+		GLintptr vertexStart = 0, indexStart = 0;
+		while (!take(freeVertices, vertexBytes, mesh.vertexStride, vertexStart)) grow(vbo, vertexCapacity, freeVertices, 1, vertexBytes + mesh.vertexStride);
+		while (!take(freeIndices, mesh.indexCount, 1, indexStart)) grow(ebo, indexCapacity, freeIndices, sizeof(uint32_t), mesh.indexCount);
+		mesh.baseVertex = (GLint)(vertexStart / mesh.vertexStride);
+		mesh.firstIndex = (GLuint)indexStart;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, vertexStart, vertexBytes, vertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexStart * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		vertexBytesUsed += vertexBytes;
+		indicesUsed += mesh.indexCount;
+		return mesh;
+	}
+
+	// adds a level of detail to a mesh in the arena: its own indices into the mesh's vertices
+	void addLevel(Mesh& mesh, const uint32_t* indices, size_t indexCount, float error)
+	{
+		Mesh level = mesh;
+		level.lods.clear();
+		level.indexCount = (GLsizei)indexCount;
+		level.lodError = error;
+		GLintptr indexStart = 0;
+		while (!take(freeIndices, level.indexCount, 1, indexStart)) grow(ebo, indexCapacity, freeIndices, sizeof(uint32_t), level.indexCount);
+		level.firstIndex = (GLuint)indexStart;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexStart * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		indicesUsed += level.indexCount;
+		mesh.lods.push_back(level);
+	}
+
+	// gives the ranges of the mesh and its levels back; the GPU may still be drawing from them, so only
+	// reuse them for meshes added once the frames in flight are done
+	void remove(const Mesh& mesh)
+	{
+		GLsizeiptr vertexBytes = (GLsizeiptr)mesh.vertexCount * mesh.vertexStride;
+		give(freeVertices, (GLintptr)mesh.baseVertex * mesh.vertexStride, vertexBytes);
+		vertexBytesUsed -= vertexBytes;
+		for (unsigned int lod = 0; lod < mesh.levelCount(); lod++)
+		{
+			give(freeIndices, mesh.level(lod).firstIndex, mesh.level(lod).indexCount);
+			indicesUsed -= mesh.level(lod).indexCount;
+		}
+	}
+
+	// the vertex array for a layout, created on first use; it reads from the arena's buffers at offset 0
+	unsigned int vertexArray(VertexFormat format, bool hasColors, bool hasNormals)
+	{
+		for (const Layout& layout : layouts)
+		{
+			if (layout.format == format && layout.hasColors == hasColors && layout.hasNormals == hasNormals) return layout.vao;
+		}
+		Layout layout = { format, hasColors, hasNormals, 0 };
+		glGenVertexArrays(1, &layout.vao);
+		layouts.push_back(layout);
+		bindLayout(layout);
+		return layout.vao;
+	}
+
+	size_t vertexArrayCount() const
+	{
+		return layouts.size();
+	}
+	GLsizeiptr vertexBufferSize() const
+	{
+		return vertexCapacity;
+	}
+	GLsizeiptr indexBufferSize() const
+	{
+		return indexCapacity * sizeof(uint32_t);
+	}
+	GLsizeiptr bytesUsed() const
+	{
+		return vertexBytesUsed + indicesUsed * sizeof(uint32_t);
+	}
+
+	void destroy()
+	{
+		for (Layout& layout : layouts) glDeleteVertexArrays(1, &layout.vao);
+		layouts.clear();
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ebo);
+		vbo = ebo = 0;
+	}
+
+private:
+	struct Range
+	{
+		GLintptr start;
+		GLsizeiptr size;
+	};
+	struct Layout
+	{
+		VertexFormat format;
+		bool hasColors, hasNormals;
+		unsigned int vao;
+	};
+
+	std::vector<Range> freeVertices, freeIndices;	// sorted by start, never adjacent
+	std::vector<Layout> layouts;
+	GLsizeiptr vertexCapacity = 0, indexCapacity = 0;	// bytes and indices
+	GLsizeiptr vertexBytesUsed = 0, indicesUsed = 0;
+
+	static unsigned int createBuffer(GLsizeiptr bytes)
+	{
+		unsigned int buffer = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+	void bindLayout(const Layout& layout)
+	{
+		glBindVertexArray(layout.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo); // element buffer binding is stored in the VAO
+		setVertexAttributes(layout.format, layout.hasColors, layout.hasNormals);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// first free range that fits size units starting at a multiple of alignment
+	static bool take(std::vector<Range>& free, GLsizeiptr size, GLsizeiptr alignment, GLintptr& start)
+	{
+		for (size_t i = 0; i < free.size(); i++)
+		{
+			Range range = free[i];
+			GLintptr aligned = (range.start + alignment - 1) / alignment * alignment;
+			if (aligned + size > range.start + range.size) continue;
+
+			// what's left on either side stays free
+			free.erase(free.begin() + i);
+			if (aligned + size < range.start + range.size) free.insert(free.begin() + i, { aligned + size, range.start + range.size - aligned - size });
+			if (aligned > range.start) free.insert(free.begin() + i, { range.start, aligned - range.start });
+			start = aligned;
+			return true;
+		}
+		return false;
+	}
+
+	static void give(std::vector<Range>& free, GLintptr start, GLsizeiptr size)
+	{
+		if (size == 0) return;
+		auto next = std::lower_bound(free.begin(), free.end(), start, [](const Range& range, GLintptr value) { return range.start < value; });
+		next = free.insert(next, { start, size });
+		if (next + 1 != free.end() && next->start + next->size == (next + 1)->start)
+		{
+			next->size += (next + 1)->size;
+			free.erase(next + 1);
+		}
+		if (next != free.begin() && (next - 1)->start + (next - 1)->size == next->start)
+		{
+			(next - 1)->size += next->size;
+			free.erase(next);
+		}
+	}
+
+	// doubles a buffer, or more until it gains at least needed units, copying its contents, and points
+	// every vertex array at the new one
+	void grow(unsigned int& buffer, GLsizeiptr& capacity, std::vector<Range>& free, GLsizeiptr unitSize, GLsizeiptr needed)
+	{
+		GLsizeiptr grownCapacity = capacity * 2;
+		while (grownCapacity - capacity < needed) grownCapacity *= 2;
+		unsigned int grown = createBuffer(grownCapacity * unitSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * unitSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = grown;
+		give(free, capacity, grownCapacity - capacity);
+		capacity = grownCapacity;
+		for (const Layout& layout : layouts) bindLayout(layout);
+		std::cout << "Geometry arena: " << (&buffer == &vbo ? "vertex" : "index") << " buffer grown to "
+			<< capacity * unitSize / 1024.0 << " KB" << std::endl;
+	}
+};
+
+// dedupes, optimizes and uploads a mesh into the arena, logging the size change
+inline Mesh createMesh(GeometryArena& arena, const char* name, MeshData data, size_t sourceVertexCount, size_t sourceStride, VertexFormat format)
+{
+	optimizeVertexCache(data);
+	optimizeVertexFetch(data);
+	Mesh mesh = arena.add(data, format);
+	std::cout << "Mesh " << name << ": " << sourceVertexCount << " -> " << mesh.vertexCount << " vertices, "
+		<< sourceVertexCount * sourceStride << " -> " << mesh.vertexCount * mesh.vertexStride + mesh.indexCount * sizeof(uint32_t)
+		<< " bytes, base vertex " << mesh.baseVertex << ", first index " << mesh.firstIndex << std::endl;
+	return mesh;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef GLCAPS_H
+#define GLCAPS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <string>
+
+// true if the current context advertises the extension; only valid after the loader ran
+inline bool hasGLExtension(const char* name)
+{
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && std::strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+// true if the context version is at least major.minor
+inline bool hasGLVersion(int major, int minor)
+{
+	int contextMajor = 0, contextMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+// vendor, renderer and version strings; anything built by the driver is only valid for the same triple
+inline std::string driverIdentity()
+{
+	const char* strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+	std::string identity;
+	for (const char* s : strings)
+	{
+		identity += s ? s : "";
+		identity += '\n';
+	}
+	return identity;
+}
+
+#endif
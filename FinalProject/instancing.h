@@ -0,0 +1,79 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+// first vertex attribute location used by per-instance data, after position, color and normal
+const unsigned int INSTANCE_ATTRIBUTE_BASE = 3;
+
+/// <summary>
+/// Per-instance vertex data, read by the INSTANCED variants of source.vsh and shadowMapper.vsh
+/// </summary>
+struct InstanceData
+{
+	glm::mat4 model;			// locations 3-6
+	glm::mat3 normalMatrix;		// locations 7-9
+};
+
+// enables the per-instance attributes of the bound vertex array and points them at an array of
+// InstanceData at offset in the bound GL_ARRAY_BUFFER
+inline void pointInstanceAttributes(GLintptr offset)
+{
+	GLsizei stride = sizeof(InstanceData);
+	unsigned int location = INSTANCE_ATTRIBUTE_BASE;
+	for (int column = 0; column < 4; column++, location++)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+	}
+	for (int column = 0; column < 3; column++, location++)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+	}
+}
+
+/// <summary>
+/// All objects that share a mesh, drawn with one instanced draw call per pass. The batch only
+/// gathers the instances' matrices; the render queue streams them to the GPU with the frame's other
+/// per-object data, since meshes in the geometry arena share their vertex array with other batches.
+/// </summary>
+class InstanceBatch
+{
+public:
+	const Mesh* mesh;
+	std::vector<unsigned int> transforms;	// indices into the transform store
+	std::vector<InstanceData> instances;	// their matrices, in the same order
+
+	InstanceBatch(const Mesh* mesh) : mesh(mesh)
+	{
+	}
+
+	GLsizei instanceCount() const
+	{
+		return (GLsizei)transforms.size();
+	}
+
+	// switches to a new set of instances, e.g. the ones that survived culling, with matrices indexed
+	// like the transform store's
+	void setInstances(const std::vector<glm::mat4>& world, const std::vector<glm::mat3>& normal, const std::vector<unsigned int>& visible)
+	{
+		transforms = visible;
+		instances.resize(transforms.size());
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			instances[i].model = world[transforms[i]];
+			instances[i].normalMatrix = normal[transforms[i]];
+		}
+	}
+};
+
+#endif
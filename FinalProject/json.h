@@ -0,0 +1,241 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const uint32_t JSON_NONE = 0xFFFFFFFFu;
+
+enum JsonType
+{
+	JSON_NULL = 0,
+	JSON_BOOLEAN,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT
+};
+
+/// <summary>
+/// One value of a parsed document. Strings and keys point into the source text, still escaped;
+/// children of arrays and objects are linked through firstChild and next.
+/// </summary>
+struct JsonValue
+{
+	JsonType type;
+	double number;			// also 0 or 1 for booleans
+	const char* text;		// string contents
+	uint32_t length;
+	const char* key;		// member name, when the parent is an object
+	uint32_t keyLength;
+	uint32_t firstChild, next;
+};
+
+/// <summary>
+/// Small JSON reader for asset metadata: one pass over text that must outlive the document, every
+/// value in one array and addressed by index, no allocation per string
+/// </summary>
+class JsonDocument
+{
+public:
+	std::vector<JsonValue> values;	// values[0] is the root
+
+	bool parse(const char* text, size_t size)
+	{
+		values.clear();
+		p = text;
+		end = text + size;
+		depth = 0;
+		uint32_t root = JSON_NONE;
+		if (!parseValue(root)) return false;
+		skipSpace();
+		return p == end;
+	}
+
+	const JsonValue& operator[](uint32_t index) const
+	{
+		return values[index];
+	}
+
+	// the member of an object with the given name, JSON_NONE if there's none or value isn't an object
+	uint32_t member(uint32_t object, const char* name) const
+	{
+		if (object == JSON_NONE || values[object].type != JSON_OBJECT) return JSON_NONE;
+		size_t length = std::strlen(name);
+		for (uint32_t child = values[object].firstChild; child != JSON_NONE; child = values[child].next)
+		{
+			if (values[child].keyLength == length && std::memcmp(values[child].key, name, length) == 0) return child;
+		}
+		return JSON_NONE;
+	}
+
+	// the elements of an array in order, for indexing; empty if value isn't an array
+	std::vector<uint32_t> elements(uint32_t array) const
+	{
+		std::vector<uint32_t> result;
+		if (array == JSON_NONE || values[array].type != JSON_ARRAY) return result;
+		for (uint32_t child = values[array].firstChild; child != JSON_NONE; child = values[child].next) result.push_back(child);
+		return result;
+	}
+
+	double number(uint32_t value, double fallback) const
+	{
+		return value != JSON_NONE && (values[value].type == JSON_NUMBER || values[value].type == JSON_BOOLEAN) ? values[value].number : fallback;
+	}
+
+	// a non-negative integer below JSON_NONE, such as an index into another array; fallback if value is
+	// missing and JSON_NONE if it's anything else
+	uint32_t index(uint32_t value, uint32_t fallback) const
+	{
+		if (value == JSON_NONE) return fallback;
+		double n = number(value, -1.0);
+		return n >= 0.0 && n < (double)JSON_NONE && n == (double)(uint32_t)n ? (uint32_t)n : JSON_NONE;
+	}
+
+	// a string's contents with the common escapes resolved; \u escapes outside ASCII aren't
+	std::string string(uint32_t value) const
+	{
+		std::string result;
+		if (value == JSON_NONE || values[value].type != JSON_STRING) return result;
+		const char* s = values[value].text;
+		for (uint32_t i = 0; i < values[value].length; i++)
+		{
+			if (s[i] != '\\' || i + 1 == values[value].length)
+			{
+				result += s[i];
+				continue;
+			}
+			char escaped = s[++i];
+			switch (escaped)
+			{
+			case 'n': result += '\n'; break;
+			case 't': result += '\t'; break;
+			case 'r': result += '\r'; break;
+			case 'b': result += '\b'; break;
+			case 'f': result += '\f'; break;
+			case 'u':
+				if (i + 4 < values[value].length) result += (char)std::strtol(std::string(s + i + 1, 4).c_str(), NULL, 16);
+				i += 4;
+				break;
+			default: result += escaped; break;
+			}
+		}
+		return result;
+	}
+
+private:
+	const char* p = NULL;
+	const char* end = NULL;
+	unsigned int depth = 0;
+
+	void skipSpace()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+	}
+
+	uint32_t add(JsonType type)
+	{
+		JsonValue value = { type, 0.0, NULL, 0, NULL, 0, JSON_NONE, JSON_NONE };
+		values.push_back(value);
+		return (uint32_t)values.size() - 1;
+	}
+
+	// the contents of a string starting at the opening quote, escapes left in
+	bool parseString(const char*& text, uint32_t& length)
+	{
+		if (p >= end || *p != '"') return false;
+		text = ++p;
+		while (p < end && *p != '"')
+		{
+			if (*p == '\\') p++;
+			p++;
+		}
+		if (p >= end) return false;
+		length = (uint32_t)(p - text);
+		p++;
+		return true;
+	}
+
+	bool parseValue(uint32_t& index)
+	{
+		skipSpace();
+		if (p >= end) return false;
+		char c = *p;
+		if (c == '{' || c == '[')
+		{
+			if (++depth > 256) return false;
+			bool object = c == '{';
+			index = add(object ? JSON_OBJECT : JSON_ARRAY);
+			p++;
+			skipSpace();
+			uint32_t last = JSON_NONE;
+			if (p < end && *p == (object ? '}' : ']'))
+			{
+				p++;
+				depth--;
+				return true;
+			}
+			for (;;)
+			{
+				const char* key = NULL;
+				uint32_t keyLength = 0;
+				if (object)
+				{
+					skipSpace();
+					if (!parseString(key, keyLength)) return false;
+					skipSpace();
+					if (p >= end || *p++ != ':') return false;
+				}
+				uint32_t child = JSON_NONE;
+				if (!parseValue(child)) return false;
+				values[child].key = key;
+				values[child].keyLength = keyLength;
+				if (last == JSON_NONE) values[index].firstChild = child;
+				else values[last].next = child;
+				last = child;
+
+				skipSpace();
+				if (p >= end) return false;
+				if (*p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (*p++ != (object ? '}' : ']')) return false;
+				depth--;
+				return true;
+			}
+		}
+		if (c == '"')
+		{
+			index = add(JSON_STRING);
+			return parseString(values[index].text, values[index].length);
+		}
+		if (c == 't' || c == 'f' || c == 'n')
+		{
+			const char* word = c == 't' ? "true" : c == 'f' ? "false" : "null";
+			size_t length = std::strlen(word);
+			if ((size_t)(end - p) < length || std::memcmp(p, word, length) != 0) return false;
+			p += length;
+			index = add(c == 'n' ? JSON_NULL : JSON_BOOLEAN);
+			values[index].number = c == 't' ? 1.0 : 0.0;
+			return true;
+		}
+
+		// numbers are copied out since strtod needs a terminator the mapped text doesn't have
+		char digits[64];
+		size_t length = 0;
+		while (p < end && length < sizeof(digits) - 1 && ((*p && std::strchr("+-.eE", *p)) || (*p >= '0' && *p <= '9'))) digits[length++] = *p++;
+		if (length == 0) return false;
+		digits[length] = '\0';
+		char* parsedEnd = NULL;
+		index = add(JSON_NUMBER);
+		values[index].number = std::strtod(digits, &parsedEnd);
+		return parsedEnd == digits + length;
+	}
+};
+
+#endif
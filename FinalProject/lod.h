@@ -0,0 +1,311 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+const unsigned int MAX_MESH_LODS = 5;	// the full mesh and up to four simplified levels
+const size_t MIN_LOD_TRIANGLES = 64;	// no level is made from fewer triangles than this
+// a coarser level is only switched to once its error is this far under the limit, see selectLod()
+const float LOD_HYSTERESIS = 0.75f;
+
+/// <summary>
+/// One simplified level of a mesh: indices into the full mesh's vertices, and how far its surface
+/// strays from the full one in object-space units
+/// </summary>
+struct MeshLod
+{
+	std::vector<uint32_t> indices;
+	float error;
+};
+
+/// <summary>
+/// Error quadric of the planes around a vertex (Garland and Heckbert): the area-weighted sum of
+/// squared distances from a point to all of them
+/// </summary>
+struct Quadric
+{
+	double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0;
+	double weight = 0;	// total area, turns the sum into a mean
+
+	// the plane through point with the given unit normal
+	void addPlane(const glm::vec3& normal, const glm::vec3& point, double area)
+	{
+		double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, point);
+		a2 += area * a * a; b2 += area * b * b; c2 += area * c * c;
+		ab += area * a * b; ac += area * a * c; bc += area * b * c;
+		ad += area * a * d; bd += area * b * d; cd += area * c * d;
+		d2 += area * d * d;
+		weight += area;
+	}
+
+	void add(const Quadric& q)
+	{
+		a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc; ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2;
+		weight += q.weight;
+	}
+
+	double error(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z) + d2;
+	}
+};
+
+/// <summary>
+/// Edge-collapse simplification of a triangle list by quadric error. Every collapse moves a vertex
+/// onto a neighbor, so any level it produces indexes the full mesh's vertices and shares its vertex
+/// buffer. Vertices where normals or colors split (several vertices at one position) and vertices on
+/// open borders never move, which keeps seams and outlines closed. simplify() can be called with
+/// smaller and smaller targets to take a whole chain of levels from one run.
+/// </summary>
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const MeshData& mesh) : positions(mesh.positions.data()), vertexCount(mesh.vertexCount()), result(mesh.indices)
+	{
+		// vertices sharing a position are grouped by sorting, the first of each group stands for it
+		canonical.resize(vertexCount);
+		std::vector<uint32_t> sorted(vertexCount);
+		std::iota(sorted.begin(), sorted.end(), 0);
+		std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b)
+			{
+				const float* pa = positions + a * 3;
+				const float* pb = positions + b * 3;
+				return pa[0] != pb[0] ? pa[0] < pb[0] : pa[1] != pb[1] ? pa[1] < pb[1] : pa[2] < pb[2];
+			});
+		locked.assign(vertexCount, 0);
+		for (size_t i = 0; i < vertexCount;)
+		{
+			size_t end = i + 1;
+			while (end < vertexCount && std::equal(positions + sorted[i] * 3, positions + sorted[i] * 3 + 3, positions + sorted[end] * 3)) end++;
+			for (size_t k = i; k < end; k++) canonical[sorted[k]] = sorted[i];
+			if (end - i > 1) locked[sorted[i]] = 1;
+			i = end;
+		}
+
+		// edges used by one triangle are open borders, by more than two non-manifold; either way their ends stay
+		std::vector<uint64_t> edges;
+		edges.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				uint64_t a = canonical[result[i + e]], b = canonical[result[i + (e + 1) % 3]];
+				edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i]) end++;
+			if (end - i != 2)
+			{
+				locked[(uint32_t)(edges[i] >> 32)] = 1;
+				locked[(uint32_t)edges[i]] = 1;
+			}
+			i = end;
+		}
+
+		quadrics.resize(vertexCount);
+		for (size_t i = 0; i + 2 < result.size(); i += 3)
+		{
+			glm::vec3 a = position(result[i]), b = position(result[i + 1]), c = position(result[i + 2]);
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length == 0.0f) continue;
+			for (int k = 0; k < 3; k++) quadrics[canonical[result[i + k]]].addPlane(normal / length, a, 0.5 * length);
+		}
+	}
+
+	const std::vector<uint32_t>& indices() const
+	{
+		return result;
+	}
+
+	// largest distance a collapse so far moved the surface, the root of its mean squared plane distance
+	float error() const
+	{
+		return maxError;
+	}
+
+	// collapses edges, cheapest first, until at most targetIndexCount indices are left or the next
+	// collapse would cost more than errorLimit; false if nothing could be collapsed
+	bool simplify(size_t targetIndexCount, float errorLimit)
+	{
+		bool collapsedAny = false;
+		double limitSquared = (double)errorLimit * errorLimit;
+		while (result.size() > targetIndexCount)
+		{
+			buildAdjacency();
+
+			// the cheapest edge out of every vertex that may move
+			const double NONE = -1.0;
+			cheapest.assign(vertexCount, { 0, 0, NONE });
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int e = 0; e < 6; e++)
+				{
+					uint32_t from = result[i + e % 3], to = result[i + (e + 1 + e / 3) % 3];
+					if (locked[canonical[from]]) continue;
+					double edgeCost = cost(from, to);
+					if (cheapest[from].cost == NONE || edgeCost < cheapest[from].cost) cheapest[from] = { from, to, edgeCost };
+				}
+			}
+			collapses.clear();
+			for (const Collapse& collapse : cheapest)
+			{
+				if (collapse.cost != NONE) collapses.push_back(collapse);
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			// a pass takes the cheapest collapses whose neighborhoods don't overlap, so each one's flip
+			// check still holds after the others
+			std::iota(remap.begin(), remap.end(), 0);
+			std::fill(touched.begin(), touched.end(), 0);
+			size_t removable = (result.size() - targetIndexCount + 2) / 3, removed = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapse.cost > limitSquared || removed >= removable) break;
+				if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to)) continue;
+
+				remap[collapse.from] = collapse.to;
+				for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; t++)
+				{
+					const uint32_t* triangle = &result[vertexTriangles[t] * 3];
+					for (int k = 0; k < 3; k++) touched[triangle[k]] = 1;
+					if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) removed++;
+				}
+				quadrics[canonical[collapse.to]].add(quadrics[canonical[collapse.from]]);
+				maxError = std::max(maxError, (float)std::sqrt(std::max(collapse.cost, 0.0)));
+			}
+			if (removed == 0) break;
+			collapsedAny = true;
+
+			// triangles that lost an edge are gone
+			size_t kept = 0;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+				if (a == b || b == c || a == c) continue;
+				result[kept++] = a;
+				result[kept++] = b;
+				result[kept++] = c;
+			}
+			result.resize(kept);
+		}
+		return collapsedAny;
+	}
+
+private:
+	struct Collapse
+	{
+		uint32_t from, to;
+		double cost;
+	};
+
+	const float* positions;
+	size_t vertexCount;
+	std::vector<uint32_t> result;
+	std::vector<uint32_t> canonical;	// the vertex standing for each vertex's position
+	std::vector<uint8_t> locked;		// by canonical vertex
+	std::vector<Quadric> quadrics;		// by canonical vertex
+	std::vector<uint32_t> triangleOffsets, vertexTriangles, remap;
+	std::vector<uint8_t> touched;
+	std::vector<Collapse> cheapest, collapses;
+	float maxError = 0.0f;
+
+	glm::vec3 position(uint32_t vertex) const
+	{
+		return glm::vec3(positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2]);
+	}
+
+	// mean squared distance of the target from the planes around both vertices
+	double cost(uint32_t from, uint32_t to) const
+	{
+		Quadric q = quadrics[canonical[from]];
+		q.add(quadrics[canonical[to]]);
+		return q.weight > 0.0 ? q.error(position(to)) / q.weight : 0.0;
+	}
+
+	// triangles using each vertex
+	void buildAdjacency()
+	{
+		triangleOffsets.assign(vertexCount + 1, 0);
+		for (uint32_t index : result) triangleOffsets[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) triangleOffsets[v + 1] += triangleOffsets[v];
+		vertexTriangles.resize(result.size());
+		remap.resize(vertexCount);
+		touched.resize(vertexCount);
+		std::vector<uint32_t>& next = remap; // borrowed as fill cursors, reset before the pass uses it
+		std::copy(triangleOffsets.begin(), triangleOffsets.end() - 1, next.begin());
+		for (size_t i = 0; i < result.size(); i++) vertexTriangles[next[result[i]]++] = (uint32_t)(i / 3);
+	}
+
+	// whether moving from onto to turns any remaining triangle around from by more than about 80 degrees
+	bool flips(uint32_t from, uint32_t to) const
+	{
+		glm::vec3 source = position(from), target = position(to);
+		for (uint32_t t = triangleOffsets[from]; t < triangleOffsets[from + 1]; t++)
+		{
+			const uint32_t* triangle = &result[vertexTriangles[t] * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue; // collapses away
+			int k = triangle[0] == from ? 0 : triangle[1] == from ? 1 : 2;
+			glm::vec3 a = position(triangle[(k + 1) % 3]), b = position(triangle[(k + 2) % 3]);
+			glm::vec3 before = glm::cross(a - source, b - source), after = glm::cross(a - target, b - target);
+			if (glm::dot(before, after) <= 0.2f * glm::length(before) * glm::length(after)) return true;
+		}
+		return false;
+	}
+};
+
+// a chain of simplified levels for a mesh, each with about half the triangles of the one before and
+// reordered for the vertex cache; it ends where a level would stray from the full mesh by more than
+// maxRelativeError of the mesh's size, or stops shrinking
+inline std::vector<MeshLod> buildLods(const MeshData& mesh, float maxRelativeError = 0.05f)
+{
+	std::vector<MeshLod> lods;
+	glm::vec3 boundsMin, boundsMax;
+	meshBounds(mesh, boundsMin, boundsMax);
+	float errorLimit = glm::length(boundsMax - boundsMin) * maxRelativeError;
+
+	MeshSimplifier simplifier(mesh);
+	size_t previous = mesh.indices.size();
+	// meshes that small aren't worth a draw's worth of savings
+	while (lods.size() + 1 < MAX_MESH_LODS && previous >= 3 * MIN_LOD_TRIANGLES)
+	{
+		simplifier.simplify(previous / 6 * 3, errorLimit);
+		size_t count = simplifier.indices().size();
+		if (count == 0 || count > previous * 3 / 4) break;
+		MeshLod lod = { simplifier.indices(), simplifier.error() };
+		optimizeVertexCache(lod.indices, mesh.vertexCount());
+		lods.push_back(lod);
+		previous = count;
+	}
+	return lods;
+}
+
+// the coarsest level whose error covers at most maxPixels, at pixelsPerUnit for the object's
+// object-space units. Going coarser than current takes LOD_HYSTERESIS of the limit and going finer
+// the whole limit, so objects sitting at a threshold don't flicker between two levels.
+inline unsigned int selectLod(const Mesh& mesh, float pixelsPerUnit, float maxPixels, unsigned int current)
+{
+	unsigned int level = 0;
+	for (unsigned int lod = 1; lod < mesh.levelCount(); lod++)
+	{
+		float limit = lod > current ? maxPixels * LOD_HYSTERESIS : maxPixels;
+		if (mesh.level(lod).lodError * pixelsPerUnit > limit) break;
+		level = lod;
+	}
+	return level;
+}
+
+#endif
@@ -0,0 +1,407 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Struct containing data about a vertex
+/// </summary>
+struct Vertex
+{
+	GLfloat x, y, z;	// Position
+	GLubyte r, g, b;	// Color
+	GLfloat nx, ny, nz;	// normal vectors
+};
+
+// GPU vertex layouts a mesh can be uploaded with
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT = 0,	// float position, ubyte color, float normal (28 bytes, same as Vertex)
+	VERTEX_FORMAT_PACKED,		// float position, 2_10_10_10 normal, ubyte color (20 bytes)
+	VERTEX_FORMAT_PACKED_HALF	// half position, 2_10_10_10 normal, ubyte color (16 bytes)
+};
+
+/// <summary>
+/// Indexed mesh on the CPU; colors and normals are optional and stored as separate streams
+/// </summary>
+struct MeshData
+{
+	std::vector<float> positions;	// 3 per vertex
+	std::vector<GLubyte> colors;	// 3 per vertex, or empty
+	std::vector<float> normals;		// 3 per vertex, or empty
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const
+	{
+		return positions.size() / 3;
+	}
+};
+
+/// <summary>
+/// Indexed mesh on the GPU: a range of vertices and indices in a GeometryArena, drawn through the
+/// arena's vertex array for the mesh's layout
+/// </summary>
+struct Mesh
+{
+	unsigned int vao = 0;		// shared by every mesh in the arena with the same vertex layout
+	GLsizei indexCount = 0;
+	GLuint firstIndex = 0;		// where the indices start in the arena's index buffer
+	GLint baseVertex = 0;		// added to every index, where the vertices start in the arena's vertex buffer
+	GLsizei vertexStride = 0;
+	size_t vertexCount = 0;
+	glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f); // object-space AABB, used for culling
+	std::vector<Mesh> lods;		// coarser levels of detail: fewer indices into the same vertices, see lod.h
+	float lodError = 0.0f;		// how far this level's surface strays from the full mesh, in object space
+
+	// level 0 is the mesh itself, levels past the last one clamp to it
+	const Mesh& level(unsigned int lod) const
+	{
+		return lod == 0 || lods.empty() ? *this : lods[std::min<size_t>(lod, lods.size()) - 1];
+	}
+	unsigned int levelCount() const
+	{
+		return 1 + (unsigned int)lods.size();
+	}
+
+	// arena indices are always 32-bit, so meshes of any size can share one buffer and one indirect call
+	const void* indexOffset() const
+	{
+		return (const void*)(firstIndex * sizeof(uint32_t));
+	}
+	void draw() const
+	{
+		glBindVertexArray(vao);
+		glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, indexOffset(), baseVertex);
+	}
+	void drawInstanced(GLsizei instanceCount) const
+	{
+		glBindVertexArray(vao);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, indexOffset(), instanceCount, baseVertex);
+	}
+};
+
+// merges bit-identical vertices of a triangle list into an index buffer
+inline void deduplicateVertices(MeshData& mesh, const float* positions, const GLubyte* colors, const float* normals, size_t count)
+{
+	std::unordered_map<std::string, uint32_t> seen;
+	seen.reserve(count);
+	mesh.indices.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		char key[3 * sizeof(float) + 3 + 3 * sizeof(float)] = {};
+		std::memcpy(key, positions + i * 3, 3 * sizeof(float));
+		if (colors) std::memcpy(key + 12, colors + i * 3, 3);
+		if (normals) std::memcpy(key + 15, normals + i * 3, 3 * sizeof(float));
+
+		auto inserted = seen.emplace(std::string(key, sizeof(key)), (uint32_t)mesh.vertexCount());
+		if (inserted.second)
+		{
+			mesh.positions.insert(mesh.positions.end(), positions + i * 3, positions + i * 3 + 3);
+			if (colors) mesh.colors.insert(mesh.colors.end(), colors + i * 3, colors + i * 3 + 3);
+			if (normals) mesh.normals.insert(mesh.normals.end(), normals + i * 3, normals + i * 3 + 3);
+		}
+		mesh.indices.push_back(inserted.first->second);
+	}
+}
+
+// builds an indexed mesh from a non-indexed triangle list of Vertex
+inline MeshData buildIndexedMesh(const Vertex* vertices, size_t count)
+{
+	std::vector<float> positions(count * 3), normals(count * 3);
+	std::vector<GLubyte> colors(count * 3);
+	for (size_t i = 0; i < count; i++)
+	{
+		positions[i * 3 + 0] = vertices[i].x; positions[i * 3 + 1] = vertices[i].y; positions[i * 3 + 2] = vertices[i].z;
+		colors[i * 3 + 0] = vertices[i].r; colors[i * 3 + 1] = vertices[i].g; colors[i * 3 + 2] = vertices[i].b;
+		normals[i * 3 + 0] = vertices[i].nx; normals[i * 3 + 1] = vertices[i].ny; normals[i * 3 + 2] = vertices[i].nz;
+	}
+	MeshData mesh;
+	deduplicateVertices(mesh, positions.data(), colors.data(), normals.data(), count);
+	return mesh;
+}
+
+// builds an indexed mesh from a non-indexed triangle list of xyz positions
+inline MeshData buildIndexedMesh(const float* positions, size_t count)
+{
+	MeshData mesh;
+	deduplicateVertices(mesh, positions, NULL, NULL, count);
+	return mesh;
+}
+
+// reorders triangles for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm)
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const int CACHE_SIZE = 32;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// triangles that use each vertex
+	std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+	for (uint32_t index : indices) triangleOffsets[index + 1]++;
+	for (size_t v = 0; v < vertexCount; v++) triangleOffsets[v + 1] += triangleOffsets[v];
+	std::vector<uint32_t> vertexTriangles(indices.size());
+	std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++) vertexTriangles[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+	}
+
+	std::vector<uint32_t> remaining(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) remaining[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+	std::vector<bool> emitted(triangleCount, false);
+
+	auto score = [&](uint32_t v) -> float
+	{
+		if (remaining[v] == 0) return -1.0f;
+		float result = 0.0f;
+		int position = cachePosition[v];
+		if (position >= 0)
+		{
+			// the last triangle's vertices get a fixed score so it isn't immediately reused
+			if (position < 3) result = 0.75f;
+			else result = std::pow(1.0f - (position - 3) * (1.0f / (CACHE_SIZE - 3)), 1.5f);
+		}
+		return result + 2.0f * std::pow((float)remaining[v], -0.5f);
+	};
+
+	for (size_t v = 0; v < vertexCount; v++) vertexScore[v] = score((uint32_t)v);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++) triangleScore[t] += vertexScore[indices[t * 3 + k]];
+	}
+
+	std::vector<uint32_t> cache, newCache;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	size_t bestTriangle = 0;
+	for (size_t t = 1; t < triangleCount; t++)
+	{
+		if (triangleScore[t] > triangleScore[bestTriangle]) bestTriangle = t;
+	}
+	size_t nextUnemitted = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		// the emitted triangle's vertices move to the front of the cache
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			uint32_t* begin = &vertexTriangles[triangleOffsets[v]];
+			uint32_t* end = begin + remaining[v];
+			std::remove(begin, end, (uint32_t)bestTriangle);
+			remaining[v]--;
+		}
+		for (size_t i = 0; i < newCache.size(); i++) cachePosition[newCache[i]] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+
+		// rescore the vertices that are or were in the cache and the triangles that use them
+		float bestScore = -1.0f;
+		bool found = false;
+		for (uint32_t v : newCache)
+		{
+			float newScore = score(v);
+			float difference = newScore - vertexScore[v];
+			vertexScore[v] = newScore;
+			for (uint32_t i = 0; i < remaining[v]; i++)
+			{
+				uint32_t t = vertexTriangles[triangleOffsets[v] + i];
+				triangleScore[t] += difference;
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+					found = true;
+				}
+			}
+		}
+		if (newCache.size() > (size_t)CACHE_SIZE) newCache.resize(CACHE_SIZE);
+		cache.swap(newCache);
+
+		// nothing in the cache touches a remaining triangle, continue with the next unemitted one
+		if (!found)
+		{
+			while (nextUnemitted < triangleCount && emitted[nextUnemitted]) nextUnemitted++;
+			bestTriangle = nextUnemitted;
+		}
+	}
+	indices.swap(result);
+}
+
+inline void optimizeVertexCache(MeshData& mesh)
+{
+	optimizeVertexCache(mesh.indices, mesh.vertexCount());
+}
+
+// renumbers vertices in the order the index buffer first uses them, so vertex fetches walk memory forwards
+inline void optimizeVertexFetch(MeshData& mesh)
+{
+	const uint32_t UNUSED = 0xFFFFFFFFu;
+	std::vector<uint32_t> remap(mesh.vertexCount(), UNUSED);
+	uint32_t next = 0;
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UNUSED) remap[index] = next++;
+		index = remap[index];
+	}
+
+	MeshData reordered;
+	reordered.positions.resize(next * 3);
+	if (!mesh.colors.empty()) reordered.colors.resize(next * 3);
+	if (!mesh.normals.empty()) reordered.normals.resize(next * 3);
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		if (remap[v] == UNUSED) continue;
+		for (int k = 0; k < 3; k++)
+		{
+			reordered.positions[remap[v] * 3 + k] = mesh.positions[v * 3 + k];
+			if (!mesh.colors.empty()) reordered.colors[remap[v] * 3 + k] = mesh.colors[v * 3 + k];
+			if (!mesh.normals.empty()) reordered.normals[remap[v] * 3 + k] = mesh.normals[v * 3 + k];
+		}
+	}
+	reordered.indices.swap(mesh.indices);
+	mesh = std::move(reordered);
+}
+
+// object-space AABB of the mesh's vertices, zero for an empty mesh
+inline void meshBounds(const MeshData& mesh, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	boundsMin = boundsMax = glm::vec3(0.0f);
+	for (size_t v = 0; v < mesh.vertexCount(); v++)
+	{
+		glm::vec3 position(mesh.positions[3 * v], mesh.positions[3 * v + 1], mesh.positions[3 * v + 2]);
+		boundsMin = v == 0 ? position : glm::min(boundsMin, position);
+		boundsMax = v == 0 ? position : glm::max(boundsMax, position);
+	}
+}
+
+// bytes per vertex for a format; colors and normals only take space when the mesh has them
+inline GLsizei vertexStride(VertexFormat format, bool hasColors, bool hasNormals)
+{
+	if (format == VERTEX_FORMAT_FLOAT) return (GLsizei)((hasColors || hasNormals) ? sizeof(Vertex) : 3 * sizeof(float));
+	GLsizei stride = format == VERTEX_FORMAT_PACKED_HALF ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+	if (hasNormals) stride += sizeof(uint32_t);
+	if (hasColors) stride += 4;
+	return stride;
+}
+
+// interleaves the mesh streams into the layout of the given format
+inline std::vector<unsigned char> packVertices(const MeshData& mesh, VertexFormat format)
+{
+	bool hasColors = !mesh.colors.empty(), hasNormals = !mesh.normals.empty();
+	GLsizei stride = vertexStride(format, hasColors, hasNormals);
+	std::vector<unsigned char> data(mesh.vertexCount() * stride, 0);
+	for (size_t v = 0; v < mesh.vertexCount(); v++)
+	{
+		unsigned char* out = &data[v * stride];
+		const float* position = &mesh.positions[v * 3];
+		if (format == VERTEX_FORMAT_FLOAT)
+		{
+			if (stride == (GLsizei)sizeof(Vertex))
+			{
+				Vertex vertex = {};
+				vertex.x = position[0]; vertex.y = position[1]; vertex.z = position[2];
+				if (hasColors) { vertex.r = mesh.colors[v * 3]; vertex.g = mesh.colors[v * 3 + 1]; vertex.b = mesh.colors[v * 3 + 2]; }
+				if (hasNormals) { vertex.nx = mesh.normals[v * 3]; vertex.ny = mesh.normals[v * 3 + 1]; vertex.nz = mesh.normals[v * 3 + 2]; }
+				std::memcpy(out, &vertex, sizeof(Vertex));
+			}
+			else std::memcpy(out, position, 3 * sizeof(float));
+			continue;
+		}
+
+		if (format == VERTEX_FORMAT_PACKED_HALF)
+		{
+			uint16_t halves[4] = { glm::packHalf1x16(position[0]), glm::packHalf1x16(position[1]), glm::packHalf1x16(position[2]), glm::packHalf1x16(1.0f) };
+			std::memcpy(out, halves, sizeof(halves));
+			out += sizeof(halves);
+		}
+		else
+		{
+			std::memcpy(out, position, 3 * sizeof(float));
+			out += 3 * sizeof(float);
+		}
+		if (hasNormals)
+		{
+			glm::vec3 normal(mesh.normals[v * 3], mesh.normals[v * 3 + 1], mesh.normals[v * 3 + 2]);
+			float length = glm::length(normal);
+			if (length > 0.0f) normal /= length;
+			uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+			std::memcpy(out, &packed, sizeof(packed));
+			out += sizeof(packed);
+		}
+		if (hasColors)
+		{
+			out[0] = mesh.colors[v * 3]; out[1] = mesh.colors[v * 3 + 1]; out[2] = mesh.colors[v * 3 + 2]; out[3] = 255;
+		}
+	}
+	return data;
+}
+
+// points attributes 0 (position), 1 (color) and 2 (normal) of the bound vertex array at the bound
+// GL_ARRAY_BUFFER, laid out as the format packs them, matching the shaders
+inline void setVertexAttributes(VertexFormat format, bool hasColors, bool hasNormals)
+{
+	GLsizei stride = vertexStride(format, hasColors, hasNormals);
+	if (format == VERTEX_FORMAT_FLOAT)
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, x)); // position
+		if (hasColors)
+		{
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(Vertex, r)); // color
+		}
+		if (hasNormals)
+		{
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, nx)); // normal
+		}
+		return;
+	}
+
+	size_t offset = 0;
+	glEnableVertexAttribArray(0);
+	if (format == VERTEX_FORMAT_PACKED_HALF)
+	{
+		glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset); // position
+		offset += 4 * sizeof(uint16_t);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset); // position
+		offset += 3 * sizeof(float);
+	}
+	if (hasNormals)
+	{
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset); // normal
+		offset += sizeof(uint32_t);
+	}
+	if (hasColors)
+	{
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offset); // color
+	}
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include "lod.h"
+#include "mesh.h"
+#include "texturefile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+enum MeshFileFlags
+{
+	MESH_FILE_COLORS = 1,
+	MESH_FILE_NORMALS = 2
+};
+
+/// <summary>
+/// Start of a cooked mesh file: vertices already packed in a VertexFormat, 32-bit indices of every
+/// level of detail one after the other and a MeshFileLod per level, each starting on a
+/// MESH_FILE_ALIGNMENT boundary, so all of it uploads straight from a mapping of the file
+/// </summary>
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;			// VertexFormat the vertices are packed in
+	uint32_t flags;				// MeshFileFlags
+	uint64_t vertexCount, indexCount;
+	uint64_t vertexOffset, indexOffset;	// from the start of the file
+	uint64_t sourceSize, sourceTime;	// of the model it was imported from, a cache is stale once they change
+	float boundsMin[3], boundsMax[3];
+	uint32_t lodCount;			// level 0, the full mesh, included
+	uint32_t reserved;
+	uint64_t lodOffset;
+};
+
+/// <summary>
+/// Where one level of detail's indices sit in the file's index array
+/// </summary>
+struct MeshFileLod
+{
+	uint64_t firstIndex, indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+const uint32_t MESH_FILE_MAGIC = 0x48534D43; // "CMSH"
+const uint32_t MESH_FILE_VERSION = 2;
+const uint32_t MESH_FILE_ALIGNMENT = 16;
+
+// size and modification time of a file, false if it can't be read
+inline bool fileStamp(const std::string& path, uint64_t& size, uint64_t& time)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) return false;
+	size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return false;
+	size = (uint64_t)info.st_size;
+	time = (uint64_t)info.st_mtime;
+#endif
+	return true;
+}
+
+/// <summary>
+/// Cooked mesh opened straight from a file mapping; vertices() and indices() point into the mapping
+/// </summary>
+class MeshFile
+{
+public:
+	MappedFile file;
+	const MeshFileHeader* header = NULL;
+
+	bool open(const std::string& path)
+	{
+		header = NULL;
+		if (!file.open(path)) return false;
+
+		// files of another version are stale caches rather than broken ones
+		const MeshFileHeader* candidate = (const MeshFileHeader*)file.data;
+		if (file.size < sizeof(MeshFileHeader) || (candidate->magic == MESH_FILE_MAGIC && candidate->version != MESH_FILE_VERSION))
+		{
+			file.close();
+			return false;
+		}
+		if (candidate->magic != MESH_FILE_MAGIC || candidate->format > VERTEX_FORMAT_PACKED_HALF || candidate->vertexCount == 0
+			|| candidate->indexCount % 3 != 0 || candidate->lodCount == 0 || candidate->lodCount > MAX_MESH_LODS)
+		{
+			std::cout << "ERROR::MESHFILE::FILE_NOT_VALID " << path << std::endl;
+			file.close();
+			return false;
+		}
+		// counts are checked against the file size before they are multiplied, so the products can't wrap
+		if (candidate->vertexCount > file.size || candidate->indexCount > file.size || candidate->indexOffset % sizeof(uint32_t) != 0
+			|| candidate->lodOffset % alignof(MeshFileLod) != 0)
+		{
+			std::cout << "ERROR::MESHFILE::FILE_NOT_VALID " << path << std::endl;
+			file.close();
+			return false;
+		}
+		uint64_t vertexBytes = candidate->vertexCount * stride(candidate);
+		uint64_t indexBytes = candidate->indexCount * sizeof(uint32_t);
+		uint64_t lodBytes = candidate->lodCount * sizeof(MeshFileLod);
+		if (candidate->vertexOffset > file.size || vertexBytes > file.size - candidate->vertexOffset
+			|| candidate->indexOffset > file.size || indexBytes > file.size - candidate->indexOffset
+			|| candidate->lodOffset > file.size || lodBytes > file.size - candidate->lodOffset)
+		{
+			std::cout << "ERROR::MESHFILE::FILE_TRUNCATED " << path << std::endl;
+			file.close();
+			return false;
+		}
+		const MeshFileLod* levels = (const MeshFileLod*)(file.data + candidate->lodOffset);
+		for (uint32_t i = 0; i < candidate->lodCount; i++)
+		{
+			if (levels[i].firstIndex > candidate->indexCount || levels[i].indexCount > candidate->indexCount - levels[i].firstIndex
+				|| levels[i].indexCount % 3 != 0)
+			{
+				std::cout << "ERROR::MESHFILE::FILE_NOT_VALID " << path << std::endl;
+				file.close();
+				return false;
+			}
+		}
+		// the indices go straight to the GPU, one past the vertices would read outside the vertex buffer
+		const uint32_t* fileIndices = (const uint32_t*)(file.data + candidate->indexOffset);
+		uint32_t maxIndex = 0;
+		for (uint64_t i = 0; i < candidate->indexCount; i++) maxIndex = std::max(maxIndex, fileIndices[i]);
+		if (candidate->indexCount > 0 && maxIndex >= candidate->vertexCount)
+		{
+			std::cout << "ERROR::MESHFILE::INDEX_OUT_OF_RANGE " << path << std::endl;
+			file.close();
+			return false;
+		}
+		header = candidate;
+		return true;
+	}
+
+	bool hasColors() const
+	{
+		return (header->flags & MESH_FILE_COLORS) != 0;
+	}
+	bool hasNormals() const
+	{
+		return (header->flags & MESH_FILE_NORMALS) != 0;
+	}
+	const void* vertices() const
+	{
+		return file.data + header->vertexOffset;
+	}
+	const uint32_t* indices() const
+	{
+		return (const uint32_t*)(file.data + header->indexOffset);
+	}
+	const MeshFileLod* lods() const
+	{
+		return (const MeshFileLod*)(file.data + header->lodOffset);
+	}
+
+private:
+	static GLsizei stride(const MeshFileHeader* header)
+	{
+		return vertexStride((VertexFormat)header->format, (header->flags & MESH_FILE_COLORS) != 0, (header->flags & MESH_FILE_NORMALS) != 0);
+	}
+};
+
+// writes a mesh whose vertices are already packed in format, with its levels of detail; the source
+// stamp is what the cache is checked against
+inline bool writeMeshFile(const std::string& path, const MeshData& data, const std::vector<unsigned char>& vertices, const std::vector<MeshLod>& lods,
+	VertexFormat format, uint64_t sourceSize, uint64_t sourceTime)
+{
+	std::vector<MeshFileLod> levels(1 + lods.size(), MeshFileLod());
+	levels[0].indexCount = data.indices.size();
+	for (size_t i = 0; i < lods.size(); i++)
+	{
+		levels[i + 1].firstIndex = levels[i].firstIndex + levels[i].indexCount;
+		levels[i + 1].indexCount = lods[i].indices.size();
+		levels[i + 1].error = lods[i].error;
+	}
+
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.format = format;
+	header.flags = (data.colors.empty() ? 0 : MESH_FILE_COLORS) | (data.normals.empty() ? 0 : MESH_FILE_NORMALS);
+	header.vertexCount = data.vertexCount();
+	header.indexCount = levels.back().firstIndex + levels.back().indexCount;
+	header.vertexOffset = (sizeof(MeshFileHeader) + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+	header.indexOffset = (header.vertexOffset + vertices.size() + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+	header.lodCount = (uint32_t)levels.size();
+	header.lodOffset = (header.indexOffset + header.indexCount * sizeof(uint32_t) + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	glm::vec3 boundsMin, boundsMax;
+	meshBounds(data, boundsMin, boundsMax);
+	for (int k = 0; k < 3; k++)
+	{
+		header.boundsMin[k] = boundsMin[k];
+		header.boundsMax[k] = boundsMax[k];
+	}
+
+	// written next to the cache and renamed over it, so a crash or a full disk never leaves a half-written cache behind
+	std::string temporary = path + ".tmp";
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "ERROR::MESHFILE::FILE_NOT_WRITABLE " << temporary << std::endl;
+		return false;
+	}
+	static const char padding[MESH_FILE_ALIGNMENT] = {};
+	out.write((const char*)&header, sizeof(header));
+	out.write(padding, header.vertexOffset - sizeof(header));
+	out.write((const char*)vertices.data(), vertices.size());
+	out.write(padding, header.indexOffset - header.vertexOffset - vertices.size());
+	out.write((const char*)data.indices.data(), data.indices.size() * sizeof(uint32_t));
+	for (const MeshLod& lod : lods) out.write((const char*)lod.indices.data(), lod.indices.size() * sizeof(uint32_t));
+	out.write(padding, header.lodOffset - header.indexOffset - header.indexCount * sizeof(uint32_t));
+	out.write((const char*)levels.data(), levels.size() * sizeof(MeshFileLod));
+	out.close();
+	if (!out)
+	{
+		std::cout << "ERROR::MESHFILE::WRITE_FAILED " << temporary << std::endl;
+		std::remove(temporary.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed)
+	{
+		std::cout << "ERROR::MESHFILE::FILE_NOT_WRITABLE " << path << std::endl;
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+#endif
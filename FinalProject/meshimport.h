@@ -0,0 +1,826 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "geometry.h"
+#include "json.h"
+#include "lod.h"
+#include "mesh.h"
+#include "meshfile.h"
+#include "texturefile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// color of imported vertices that don't have one, the shaders light it like the cubes
+const GLubyte IMPORT_DEFAULT_GRAY = 200;
+
+/// <summary>
+/// Where an import's time and memory went
+/// </summary>
+struct MeshImportStats
+{
+	uint64_t sourceBytes = 0;	// the model and any buffers it references
+	size_t triangles = 0, vertices = 0;
+	double parseMs = 0.0;		// source to MeshData
+	double optimizeMs = 0.0;	// vertex cache and fetch order, packing
+	double lodMs = 0.0;			// simplifying the levels of detail
+	unsigned int levels = 1;	// levels of detail, the full mesh included
+	double cacheWriteMs = 0.0;
+	double uploadMs = 0.0;		// into the geometry arena; on a cache hit that's the whole load
+	size_t peakBytes = 0;		// most the parser's own buffers held at once
+	bool fromCache = false;
+};
+
+// area-weighted vertex normals for the triangles from firstIndex on, which only use vertices from firstVertex on
+inline void computeNormals(MeshData& mesh, size_t firstVertex, size_t firstIndex)
+{
+	mesh.normals.resize(mesh.positions.size());
+	std::fill(mesh.normals.begin() + firstVertex * 3, mesh.normals.end(), 0.0f);
+	for (size_t i = firstIndex; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const uint32_t* triangle = &mesh.indices[i];
+		glm::vec3 a = glm::make_vec3(&mesh.positions[triangle[0] * 3]);
+		glm::vec3 b = glm::make_vec3(&mesh.positions[triangle[1] * 3]);
+		glm::vec3 c = glm::make_vec3(&mesh.positions[triangle[2] * 3]);
+		glm::vec3 normal = glm::cross(b - a, c - a); // length is twice the area
+		for (int k = 0; k < 3; k++)
+		{
+			for (int axis = 0; axis < 3; axis++) mesh.normals[triangle[k] * 3 + axis] += normal[axis];
+		}
+	}
+	for (size_t v = firstVertex; v < mesh.vertexCount(); v++)
+	{
+		glm::vec3 normal = glm::make_vec3(&mesh.normals[v * 3]);
+		float length = glm::length(normal);
+		normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		for (int axis = 0; axis < 3; axis++) mesh.normals[v * 3 + axis] = normal[axis];
+	}
+}
+
+//===================
+//		 OBJ
+//===================
+
+// OBJ text is read through a cursor that never moves past the end of the current line
+inline const char* objSkipSpace(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+inline const char* objNextLine(const char* p, const char* end)
+{
+	while (p < end && *p != '\n') p++;
+	return p < end ? p + 1 : end;
+}
+
+// decimal number with an optional fraction and exponent; strtof would need a terminated copy of every token
+inline bool objParseFloat(const char*& p, const char* end, float& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	p = objSkipSpace(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	// up to 18 significant digits in an integer, the rest only move the exponent
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	bool digits = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits = true)
+	{
+		if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits = true)
+		{
+			if (mantissa < 100000000000000000ull)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (!digits) return false;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+		int written = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++) written = std::min(written * 10 + (*p - '0'), 1000);
+		exponent += negativeExponent ? -written : written;
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0) result = -exponent <= 22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0) result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+	value = (float)(negative ? -result : result);
+	return true;
+}
+
+inline bool objParseIndex(const char*& p, const char* end, long& value)
+{
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9') return false;
+	long result = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) result = result * 10 + (*p - '0');
+	value = negative ? -result : result;
+	return true;
+}
+
+const uint64_t OBJ_VERTEX_MAP_EMPTY = ~0ull;
+
+/// <summary>
+/// Open-addressing map from an OBJ face corner's position and normal index to the vertex made for
+/// that pair; two flat arrays rather than a node per corner
+/// </summary>
+class ObjVertexMap
+{
+public:
+	void reserve(size_t count)
+	{
+		size_t capacity = 1024;
+		while (capacity < count * 2) capacity *= 2;
+		rehash(capacity);
+	}
+
+	// the vertex for key, next if the key is new
+	uint32_t find(uint64_t key, uint32_t next, bool& inserted)
+	{
+		if ((count + 1) * 2 > keys.size()) rehash(std::max<size_t>(keys.size() * 2, 1024));
+		size_t mask = keys.size() - 1;
+		for (size_t i = hash(key) & mask;; i = (i + 1) & mask)
+		{
+			if (keys[i] == key)
+			{
+				inserted = false;
+				return values[i];
+			}
+			if (keys[i] == OBJ_VERTEX_MAP_EMPTY)
+			{
+				keys[i] = key;
+				values[i] = next;
+				count++;
+				inserted = true;
+				return next;
+			}
+		}
+	}
+
+	size_t bytes() const
+	{
+		return keys.capacity() * sizeof(uint64_t) + values.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> values;
+	size_t count = 0;
+
+	static uint64_t hash(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		return key;
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<uint64_t> oldKeys(capacity, OBJ_VERTEX_MAP_EMPTY);
+		std::vector<uint32_t> oldValues(capacity);
+		oldKeys.swap(keys);
+		oldValues.swap(values);
+		count = 0;
+		bool inserted;
+		for (size_t i = 0; i < oldKeys.size(); i++)
+		{
+			if (oldKeys[i] != OBJ_VERTEX_MAP_EMPTY) find(oldKeys[i], oldValues[i], inserted);
+		}
+	}
+};
+
+// Wavefront OBJ in one pass over the mapped text: v (with an optional r g b after the position), vn
+// and f with any number of corners, fan-triangulated. Texture coordinates, groups and materials are
+// skipped; every distinct position and normal pair becomes one vertex.
+inline bool importObj(const std::string& path, const unsigned char* data, size_t size, MeshData& mesh, MeshImportStats& stats)
+{
+	std::vector<float> positions, normals, colors;
+	ObjVertexMap corners;
+	corners.reserve(size / 100); // about a vertex per hundred bytes of a typical export
+	std::vector<uint32_t> polygon;
+	bool missingNormals = false;
+
+	const char* p = (const char*)data;
+	const char* end = p + size;
+	size_t line = 1;
+	auto fail = [&](const char* reason)
+	{
+		std::cout << "ERROR::MESH_IMPORT::OBJ_" << reason << " " << path << ":" << line << std::endl;
+		return false;
+	};
+	for (; p < end; p = objNextLine(p, end), line++)
+	{
+		p = objSkipSpace(p, end);
+		if (end - p < 2 || (p[0] != 'v' && p[0] != 'f')) continue;
+
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p++;
+			float values[7];
+			int count = 0;
+			while (count < 7 && objParseFloat(p, end, values[count])) count++;
+			if (count < 3) return fail("BAD_POSITION");
+			positions.insert(positions.end(), values, values + 3);
+			// x y z r g b, the common vertex color extension; colors are indexed like positions
+			if (count == 6)
+			{
+				colors.resize(positions.size() - 3, IMPORT_DEFAULT_GRAY / 255.0f);
+				colors.insert(colors.end(), values + 3, values + 6);
+			}
+		}
+		else if (p[0] == 'v' && end - p > 2 && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+		{
+			p += 2;
+			float values[3];
+			if (!objParseFloat(p, end, values[0]) || !objParseFloat(p, end, values[1]) || !objParseFloat(p, end, values[2])) return fail("BAD_NORMAL");
+			normals.insert(normals.end(), values, values + 3);
+		}
+		else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p++;
+			polygon.clear();
+			for (;;)
+			{
+				p = objSkipSpace(p, end);
+				if (p >= end || *p == '\n' || *p == '\r' || *p == '#') break;
+
+				// v, v/vt, v//vn or v/vt/vn, negative indices counting back from the last one read
+				long position = 0, texcoord = 0, normal = 0;
+				if (!objParseIndex(p, end, position)) return fail("BAD_FACE");
+				if (p < end && *p == '/')
+				{
+					p++;
+					if (p < end && *p != '/' && !objParseIndex(p, end, texcoord)) return fail("BAD_FACE");
+					if (p < end && *p == '/' && (++p, !objParseIndex(p, end, normal))) return fail("BAD_FACE");
+				}
+				long positionCount = (long)(positions.size() / 3), normalCount = (long)(normals.size() / 3);
+				bool hasNormal = normal != 0;
+				position = position < 0 ? positionCount + position : position - 1;
+				normal = !hasNormal ? -1 : normal < 0 ? normalCount + normal : normal - 1;
+				if (position < 0 || position >= positionCount || (hasNormal && (normal < 0 || normal >= normalCount))) return fail("INDEX_OUT_OF_RANGE");
+				if (!hasNormal) missingNormals = true;
+
+				bool inserted = false;
+				uint64_t key = ((uint64_t)position << 32) | (uint32_t)(normal + 1);
+				uint32_t vertex = corners.find(key, (uint32_t)mesh.vertexCount(), inserted);
+				if (inserted)
+				{
+					mesh.positions.insert(mesh.positions.end(), &positions[position * 3], &positions[position * 3] + 3);
+					for (int k = 0; k < 3; k++) mesh.normals.push_back(normal >= 0 ? normals[normal * 3 + k] : 0.0f);
+					for (int k = 0; k < 3; k++)
+					{
+						float color = (size_t)position * 3 + k < colors.size() ? colors[position * 3 + k] : IMPORT_DEFAULT_GRAY / 255.0f;
+						mesh.colors.push_back((GLubyte)(std::min(std::max(color, 0.0f), 1.0f) * 255.0f + 0.5f));
+					}
+				}
+				polygon.push_back(vertex);
+			}
+			if (polygon.size() < 3) return fail("BAD_FACE");
+			for (size_t i = 2; i < polygon.size(); i++)
+			{
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i - 1]);
+				mesh.indices.push_back(polygon[i]);
+			}
+		}
+	}
+
+	stats.peakBytes = (positions.capacity() + normals.capacity() + colors.capacity() + mesh.positions.capacity() + mesh.normals.capacity()) * sizeof(float)
+		+ mesh.colors.capacity() + mesh.indices.capacity() * sizeof(uint32_t) + corners.bytes();
+	if (mesh.indices.empty())
+	{
+		std::cout << "ERROR::MESH_IMPORT::OBJ_NO_FACES " << path << std::endl;
+		return false;
+	}
+	if (missingNormals) computeNormals(mesh, 0, 0);
+	return true;
+}
+
+//===================
+//		 GLTF
+//===================
+
+/// <summary>
+/// glTF accessor, resolved against its buffer view and buffer so elements can be read directly
+/// </summary>
+struct GltfAccessor
+{
+	const unsigned char* data = NULL;	// first element
+	size_t count = 0;
+	size_t stride = 0;
+	int componentType = 0;				// GL enum values: GL_FLOAT, GL_UNSIGNED_BYTE, ...
+	int components = 0;
+	bool normalized = false;
+
+	// element i as up to four floats, normalized integers mapped to [0, 1] or [-1, 1]
+	void read(size_t i, float out[4]) const
+	{
+		const unsigned char* element = data + i * stride;
+		for (int c = 0; c < components && c < 4; c++)
+		{
+			switch (componentType)
+			{
+			case GL_FLOAT: std::memcpy(&out[c], element + c * 4, 4); break;
+			case GL_UNSIGNED_BYTE: out[c] = normalized ? element[c] / 255.0f : element[c]; break;
+			case GL_BYTE: out[c] = normalized ? std::max((signed char)element[c] / 127.0f, -1.0f) : (signed char)element[c]; break;
+			case GL_UNSIGNED_SHORT:
+			{
+				uint16_t value;
+				std::memcpy(&value, element + c * 2, 2);
+				out[c] = normalized ? value / 65535.0f : value;
+				break;
+			}
+			case GL_SHORT:
+			{
+				int16_t value;
+				std::memcpy(&value, element + c * 2, 2);
+				out[c] = normalized ? std::max(value / 32767.0f, -1.0f) : value;
+				break;
+			}
+			default: out[c] = 0.0f; break;
+			}
+		}
+	}
+
+	uint32_t readIndex(size_t i) const
+	{
+		const unsigned char* element = data + i * stride;
+		if (componentType == GL_UNSIGNED_BYTE) return element[0];
+		if (componentType == GL_UNSIGNED_SHORT)
+		{
+			uint16_t value;
+			std::memcpy(&value, element, 2);
+			return value;
+		}
+		uint32_t value;
+		std::memcpy(&value, element, 4);
+		return value;
+	}
+};
+
+inline size_t gltfComponentSize(int componentType)
+{
+	switch (componentType)
+	{
+	case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+	case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+	case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+inline bool decodeBase64(const char* text, size_t length, std::vector<unsigned char>& out)
+{
+	out.clear();
+	out.reserve(length / 4 * 3);
+	uint32_t bits = 0;
+	int bitCount = 0;
+	for (size_t i = 0; i < length && text[i] != '='; i++)
+	{
+		char c = text[i];
+		int value = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 : c >= '0' && c <= '9' ? c - '0' + 52
+			: c == '+' ? 62 : c == '/' ? 63 : -1;
+		if (value < 0) return false;
+		bits = (bits << 6) | (uint32_t)value;
+		bitCount += 6;
+		if (bitCount >= 8)
+		{
+			bitCount -= 8;
+			out.push_back((unsigned char)(bits >> bitCount));
+		}
+	}
+	return true;
+}
+
+// a relative URI's %XX escapes decoded
+inline std::string decodeUri(const std::string& uri)
+{
+	std::string result;
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			result += (char)std::strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+			i += 2;
+		}
+		else result += uri[i];
+	}
+	return result;
+}
+
+// glTF 2.0, as .gltf with .bin or base64 buffers or as binary .glb: every triangle primitive placed
+// by the default scene's nodes, transformed into one mesh. POSITION, NORMAL and COLOR_0 are read;
+// materials, textures, skins and morph targets aren't.
+inline bool importGltf(const std::string& path, const unsigned char* data, size_t size, MeshData& mesh, MeshImportStats& stats)
+{
+	auto fail = [&](const char* reason)
+	{
+		std::cout << "ERROR::MESH_IMPORT::GLTF_" << reason << " " << path << std::endl;
+		return false;
+	};
+
+	// a .glb is a JSON chunk and an optional binary chunk, the first buffer
+	const char* json = (const char*)data;
+	size_t jsonSize = size;
+	const unsigned char* binary = NULL;
+	size_t binarySize = 0;
+	uint32_t header[3] = {};
+	if (size >= 12) std::memcpy(header, data, 12);
+	if (header[0] == 0x46546C67) // "glTF"
+	{
+		if (header[1] != 2 || header[2] > size) return fail("UNSUPPORTED_CONTAINER");
+		json = NULL;
+		for (size_t offset = 12; offset + 8 <= header[2];)
+		{
+			uint32_t chunk[2];
+			std::memcpy(chunk, data + offset, 8);
+			if (chunk[0] > header[2] - offset - 8) return fail("TRUNCATED");
+			if (chunk[1] == 0x4E4F534A && !json) // "JSON"
+			{
+				json = (const char*)data + offset + 8;
+				jsonSize = chunk[0];
+			}
+			else if (chunk[1] == 0x004E4942 && !binary) // "BIN\0"
+			{
+				binary = data + offset + 8;
+				binarySize = chunk[0];
+			}
+			offset += 8 + ((chunk[0] + 3) & ~3u);
+		}
+		if (!json) return fail("NO_JSON_CHUNK");
+	}
+
+	JsonDocument document;
+	if (!document.parse(json, jsonSize)) return fail("BAD_JSON");
+	const uint32_t root = 0;
+
+	// buffers: the .glb's binary chunk, base64 data URIs or files next to the model
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::vector<std::pair<const unsigned char*, size_t>> buffers;
+	std::vector<std::unique_ptr<MappedFile>> bufferFiles;
+	std::vector<std::vector<unsigned char>> decodedBuffers;
+	for (uint32_t buffer : document.elements(document.member(root, "buffers")))
+	{
+		uint32_t uriValue = document.member(buffer, "uri");
+		size_t byteLength = document.index(document.member(buffer, "byteLength"), 0);
+		if (uriValue == JSON_NONE)
+		{
+			if (!binary || binarySize < byteLength) return fail("MISSING_BUFFER");
+			buffers.push_back({ binary, binarySize });
+			continue;
+		}
+		std::string uri = document.string(uriValue);
+		if (uri.compare(0, 5, "data:") == 0)
+		{
+			size_t comma = uri.find(',');
+			if (comma == std::string::npos || uri.find(";base64") > comma) return fail("UNSUPPORTED_DATA_URI");
+			decodedBuffers.emplace_back();
+			if (!decodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, decodedBuffers.back())) return fail("BAD_DATA_URI");
+			buffers.push_back({ decodedBuffers.back().data(), decodedBuffers.back().size() });
+		}
+		else
+		{
+			bufferFiles.emplace_back(new MappedFile());
+			if (!bufferFiles.back()->open(directory + decodeUri(uri))) return fail("MISSING_BUFFER_FILE");
+			buffers.push_back({ bufferFiles.back()->data, bufferFiles.back()->size });
+			stats.sourceBytes += bufferFiles.back()->size;
+		}
+		if (buffers.back().second < byteLength) return fail("TRUNCATED");
+	}
+
+	std::vector<uint32_t> bufferViews = document.elements(document.member(root, "bufferViews"));
+	std::vector<uint32_t> accessorValues = document.elements(document.member(root, "accessors"));
+	auto accessor = [&](uint32_t index, GltfAccessor& out) -> bool
+	{
+		if (index >= accessorValues.size()) return false;
+		uint32_t value = accessorValues[index];
+		static const char* types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+		std::string type = document.string(document.member(value, "type"));
+		out.components = 0;
+		for (int i = 0; i < 4; i++) if (type == types[i]) out.components = i + 1;
+		out.componentType = (int)document.index(document.member(value, "componentType"), 0);
+		out.normalized = document.number(document.member(value, "normalized"), 0.0) != 0.0;
+		out.count = document.index(document.member(value, "count"), 0);
+		size_t elementSize = gltfComponentSize(out.componentType) * out.components;
+		if (elementSize == 0 || document.member(value, "sparse") != JSON_NONE) return false;
+
+		size_t view = document.index(document.member(value, "bufferView"), JSON_NONE);
+		if (view >= bufferViews.size()) return false;
+		size_t buffer = document.index(document.member(bufferViews[view], "buffer"), JSON_NONE);
+		size_t viewOffset = document.index(document.member(bufferViews[view], "byteOffset"), 0);
+		size_t viewLength = document.index(document.member(bufferViews[view], "byteLength"), 0);
+		size_t offset = document.index(document.member(value, "byteOffset"), 0);
+		out.stride = document.index(document.member(bufferViews[view], "byteStride"), (uint32_t)elementSize);
+		if (buffer >= buffers.size() || viewOffset + viewLength > buffers[buffer].second || out.stride < elementSize) return false;
+		if (out.count > 0 && offset + (out.count - 1) * out.stride + elementSize > viewLength) return false;
+		out.data = buffers[buffer].first + viewOffset + offset;
+		return true;
+	};
+
+	// one primitive, appended with the node's transform applied
+	std::vector<uint32_t> meshValues = document.elements(document.member(root, "meshes"));
+	bool skippedPrimitives = false;
+	auto addPrimitive = [&](uint32_t primitive, const glm::mat4& transform) -> bool
+	{
+		if (document.number(document.member(primitive, "mode"), 4.0) != 4.0)
+		{
+			skippedPrimitives = true;
+			return true;
+		}
+		uint32_t attributes = document.member(primitive, "attributes");
+		GltfAccessor positions, normals, colors, indices;
+		if (!accessor(document.index(document.member(attributes, "POSITION"), JSON_NONE), positions) || positions.components != 3) return false;
+		bool hasNormals = accessor(document.index(document.member(attributes, "NORMAL"), JSON_NONE), normals) && normals.components == 3 && normals.count == positions.count;
+		bool hasColors = accessor(document.index(document.member(attributes, "COLOR_0"), JSON_NONE), colors) && colors.components >= 3 && colors.count == positions.count;
+		bool indexed = document.member(primitive, "indices") != JSON_NONE;
+		if (indexed && (!accessor(document.index(document.member(primitive, "indices"), JSON_NONE), indices) || indices.components != 1
+			|| (indices.componentType != GL_UNSIGNED_BYTE && indices.componentType != GL_UNSIGNED_SHORT && indices.componentType != GL_UNSIGNED_INT)))
+		{
+			return false;
+		}
+
+		size_t firstVertex = mesh.vertexCount(), firstIndex = mesh.indices.size();
+		glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+		mesh.positions.reserve(mesh.positions.size() + positions.count * 3);
+		mesh.normals.reserve(mesh.normals.size() + positions.count * 3);
+		mesh.colors.reserve(mesh.colors.size() + positions.count * 3);
+		for (size_t v = 0; v < positions.count; v++)
+		{
+			float value[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			positions.read(v, value);
+			glm::vec3 position = glm::vec3(transform * glm::vec4(value[0], value[1], value[2], 1.0f));
+			mesh.positions.insert(mesh.positions.end(), &position[0], &position[0] + 3);
+
+			glm::vec3 normal(0.0f);
+			if (hasNormals)
+			{
+				normals.read(v, value);
+				normal = normalTransform * glm::vec3(value[0], value[1], value[2]);
+				float length = glm::length(normal);
+				if (length > 0.0f) normal /= length;
+			}
+			mesh.normals.insert(mesh.normals.end(), &normal[0], &normal[0] + 3);
+
+			float color[4] = { IMPORT_DEFAULT_GRAY / 255.0f, IMPORT_DEFAULT_GRAY / 255.0f, IMPORT_DEFAULT_GRAY / 255.0f, 1.0f };
+			if (hasColors) colors.read(v, color);
+			for (int k = 0; k < 3; k++) mesh.colors.push_back((GLubyte)(std::min(std::max(color[k], 0.0f), 1.0f) * 255.0f + 0.5f));
+		}
+
+		size_t indexCount = indexed ? indices.count : positions.count;
+		mesh.indices.reserve(mesh.indices.size() + indexCount - indexCount % 3);
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t index = indexed ? indices.readIndex(i + k) : (uint32_t)(i + k);
+				if (index >= positions.count) return false;
+				mesh.indices.push_back((uint32_t)firstVertex + index);
+			}
+		}
+		// flipped transforms turn the winding around
+		if (glm::determinant(glm::mat3(transform)) < 0.0f)
+		{
+			for (size_t i = firstIndex; i < mesh.indices.size(); i += 3) std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+		}
+		if (!hasNormals) computeNormals(mesh, firstVertex, firstIndex);
+		return true;
+	};
+
+	// the node hierarchy from the default scene's roots; no scene draws every mesh once as it is
+	std::vector<uint32_t> nodes = document.elements(document.member(root, "nodes"));
+	std::vector<uint32_t> scenes = document.elements(document.member(root, "scenes"));
+	std::vector<std::pair<uint32_t, glm::mat4>> pending;
+	size_t sceneIndex = document.index(document.member(root, "scene"), 0);
+	if (sceneIndex < scenes.size())
+	{
+		for (uint32_t node : document.elements(document.member(scenes[sceneIndex], "nodes"))) pending.push_back({ document.index(node, JSON_NONE), glm::mat4(1.0f) });
+	}
+	else
+	{
+		for (uint32_t meshValue : meshValues)
+		{
+			for (uint32_t primitive : document.elements(document.member(meshValue, "primitives")))
+			{
+				if (!addPrimitive(primitive, glm::mat4(1.0f))) return fail("BAD_PRIMITIVE");
+			}
+		}
+	}
+	size_t visited = 0;
+	while (!pending.empty())
+	{
+		uint32_t nodeIndex = pending.back().first;
+		glm::mat4 parent = pending.back().second;
+		pending.pop_back();
+		// glTF forbids cycles; the count keeps a broken file from looping forever
+		if (nodeIndex >= nodes.size() || ++visited > nodes.size() * 4) return fail("BAD_NODE");
+		uint32_t node = nodes[nodeIndex];
+
+		glm::mat4 local(1.0f);
+		std::vector<uint32_t> matrix = document.elements(document.member(node, "matrix"));
+		if (matrix.size() == 16)
+		{
+			for (int i = 0; i < 16; i++) glm::value_ptr(local)[i] = (float)document.number(matrix[i], 0.0); // column-major, like glm
+		}
+		else
+		{
+			std::vector<uint32_t> t = document.elements(document.member(node, "translation"));
+			std::vector<uint32_t> r = document.elements(document.member(node, "rotation"));
+			std::vector<uint32_t> s = document.elements(document.member(node, "scale"));
+			if (t.size() == 3) local = glm::translate(local, glm::vec3(document.number(t[0], 0.0), document.number(t[1], 0.0), document.number(t[2], 0.0)));
+			if (r.size() == 4) local *= glm::mat4_cast(glm::quat((float)document.number(r[3], 1.0), (float)document.number(r[0], 0.0), (float)document.number(r[1], 0.0), (float)document.number(r[2], 0.0)));
+			if (s.size() == 3) local = glm::scale(local, glm::vec3(document.number(s[0], 1.0), document.number(s[1], 1.0), document.number(s[2], 1.0)));
+		}
+		glm::mat4 world = parent * local;
+
+		size_t meshIndex = document.index(document.member(node, "mesh"), JSON_NONE);
+		if (meshIndex < meshValues.size())
+		{
+			for (uint32_t primitive : document.elements(document.member(meshValues[meshIndex], "primitives")))
+			{
+				if (!addPrimitive(primitive, world)) return fail("BAD_PRIMITIVE");
+			}
+		}
+		for (uint32_t child : document.elements(document.member(node, "children"))) pending.push_back({ document.index(child, JSON_NONE), world });
+	}
+
+	size_t decodedBytes = 0;
+	for (const std::vector<unsigned char>& decoded : decodedBuffers) decodedBytes += decoded.capacity();
+	stats.peakBytes = (mesh.positions.capacity() + mesh.normals.capacity()) * sizeof(float) + mesh.colors.capacity()
+		+ mesh.indices.capacity() * sizeof(uint32_t) + document.values.capacity() * sizeof(JsonValue) + decodedBytes;
+	if (skippedPrimitives) std::cout << "Mesh " << path << ": primitives that aren't triangle lists skipped" << std::endl;
+	if (mesh.indices.empty()) return fail("NO_TRIANGLES");
+	return true;
+}
+
+//===================
+//	  LOADING
+//===================
+
+inline bool hasExtension(const std::string& path, const char* extension)
+{
+	size_t length = std::strlen(extension);
+	if (path.size() < length) return false;
+	for (size_t i = 0; i < length; i++)
+	{
+		if (std::tolower((unsigned char)path[path.size() - length + i]) != extension[i]) return false;
+	}
+	return true;
+}
+
+// puts a model and its levels of detail into the arena: straight from its cooked copy (path + ".cmesh")
+// when that was made from the model as it is now and in the same vertex format, otherwise imported,
+// optimized, simplified and cooked again
+inline bool loadModel(GeometryArena& arena, const std::string& path, VertexFormat format, Mesh& mesh, MeshImportStats& stats)
+{
+	typedef std::chrono::steady_clock Clock;
+	auto millisecondsSince = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+	stats = MeshImportStats();
+	uint64_t sourceSize = 0, sourceTime = 0;
+	if (!fileStamp(path, sourceSize, sourceTime))
+	{
+		std::cout << "ERROR::MESH_IMPORT::FILE_NOT_FOUND " << path << std::endl;
+		return false;
+	}
+	stats.sourceBytes = sourceSize;
+	std::string cachePath = path + ".cmesh";
+
+	Clock::time_point start = Clock::now();
+	MeshFile cache;
+	if (cache.open(cachePath) && cache.header->sourceSize == sourceSize && cache.header->sourceTime == sourceTime && cache.header->format == (uint32_t)format)
+	{
+		const MeshFileHeader& header = *cache.header;
+		const MeshFileLod* levels = cache.lods();
+		mesh = arena.addPacked(cache.vertices(), (size_t)header.vertexCount, cache.indices() + levels[0].firstIndex, (size_t)levels[0].indexCount, format,
+			cache.hasColors(), cache.hasNormals(), glm::make_vec3(header.boundsMin), glm::make_vec3(header.boundsMax));
+		for (uint32_t lod = 1; lod < header.lodCount; lod++)
+		{
+			arena.addLevel(mesh, cache.indices() + levels[lod].firstIndex, (size_t)levels[lod].indexCount, levels[lod].error);
+		}
+		stats.uploadMs = millisecondsSince(start);
+		stats.fromCache = true;
+		stats.levels = header.lodCount;
+		stats.triangles = (size_t)levels[0].indexCount / 3;
+		stats.vertices = (size_t)header.vertexCount;
+		std::cout << "Mesh " << path << ": " << stats.triangles << " triangles from " << cachePath << " in " << stats.uploadMs << " ms" << std::endl;
+		return true;
+	}
+	cache.file.close();
+
+	MappedFile source;
+	if (!source.open(path))
+	{
+		std::cout << "ERROR::MESH_IMPORT::FILE_NOT_READABLE " << path << std::endl;
+		return false;
+	}
+	MeshData data;
+	bool imported = false;
+	if (hasExtension(path, ".obj")) imported = importObj(path, source.data, source.size, data, stats);
+	else if (hasExtension(path, ".gltf") || hasExtension(path, ".glb")) imported = importGltf(path, source.data, source.size, data, stats);
+	else std::cout << "ERROR::MESH_IMPORT::UNSUPPORTED_FORMAT " << path << std::endl;
+	source.close();
+	if (!imported) return false;
+	stats.parseMs = millisecondsSince(start);
+	stats.triangles = data.indices.size() / 3;
+	stats.vertices = data.vertexCount();
+
+	start = Clock::now();
+	optimizeVertexCache(data);
+	optimizeVertexFetch(data);
+	std::vector<unsigned char> vertices = packVertices(data, format);
+	stats.optimizeMs = millisecondsSince(start);
+
+	start = Clock::now();
+	std::vector<MeshLod> lods = buildLods(data);
+	stats.lodMs = millisecondsSince(start);
+	stats.levels = 1 + (unsigned int)lods.size();
+
+	start = Clock::now();
+	writeMeshFile(cachePath, data, vertices, lods, format, sourceSize, sourceTime);
+	stats.cacheWriteMs = millisecondsSince(start);
+
+	start = Clock::now();
+	glm::vec3 boundsMin, boundsMax;
+	meshBounds(data, boundsMin, boundsMax);
+	mesh = arena.addPacked(vertices.data(), data.vertexCount(), data.indices.data(), data.indices.size(), format,
+		!data.colors.empty(), !data.normals.empty(), boundsMin, boundsMax);
+	for (const MeshLod& lod : lods) arena.addLevel(mesh, lod.indices.data(), lod.indices.size(), lod.error);
+	stats.uploadMs = millisecondsSince(start);
+	std::cout << "Mesh " << path << ": " << stats.triangles << " triangles, " << stats.vertices << " vertices imported in " << stats.parseMs
+		<< " ms (" << stats.sourceBytes / (1024.0 * 1024.0) / (stats.parseMs / 1000.0) << " MB/s, " << stats.peakBytes / (1024.0 * 1024.0)
+		<< " MB peak), optimized in " << stats.optimizeMs << " ms, " << stats.levels << " levels of detail in " << stats.lodMs
+		<< " ms, cached in " << stats.cacheWriteMs << " ms" << std::endl;
+	for (unsigned int lod = 1; lod < mesh.levelCount(); lod++)
+	{
+		std::cout << "  level " << lod << ": " << mesh.level(lod).indexCount / 3 << " triangles, error " << mesh.level(lod).lodError << std::endl;
+	}
+	return true;
+}
+
+// a rippled grid of about the given number of triangles, with normals, as OBJ text: the import benchmark's model
+inline bool writeSyntheticObj(const std::string& path, size_t triangles)
+{
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		std::cout << "ERROR::MESH_IMPORT::FILE_NOT_WRITABLE " << path << std::endl;
+		return false;
+	}
+	unsigned int side = std::max(1u, (unsigned int)std::sqrt(triangles / 2.0));
+	std::fprintf(file, "# synthetic import benchmark, %u x %u quads\n", side, side);
+	for (unsigned int z = 0; z <= side; z++)
+	{
+		for (unsigned int x = 0; x <= side; x++)
+		{
+			float u = (float)x / side, v = (float)z / side;
+			float height = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+			glm::vec3 normal = glm::normalize(glm::vec3(-2.0f * std::cos(u * 40.0f) * std::cos(v * 40.0f), 1.0f, 2.0f * std::sin(u * 40.0f) * std::sin(v * 40.0f)));
+			std::fprintf(file, "v %.6f %.6f %.6f\nvn %.5f %.5f %.5f\n", u, height, v, normal.x, normal.y, normal.z);
+		}
+	}
+	for (unsigned int z = 0; z < side; z++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			unsigned int a = z * (side + 1) + x + 1, b = a + 1, c = a + side + 1, d = c + 1;
+			std::fprintf(file, "f %u//%u %u//%u %u//%u\nf %u//%u %u//%u %u//%u\n", a, a, c, c, b, b, b, b, c, c, d, d);
+		}
+	}
+	bool written = std::ferror(file) == 0;
+	if (std::fclose(file) != 0) written = false;
+	if (!written) std::cout << "ERROR::MESH_IMPORT::WRITE_FAILED " << path << std::endl;
+	return written;
+}
+
+#endif
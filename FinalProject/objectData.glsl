@@ -0,0 +1,6 @@
+// per-object matrices, a range of the stream buffer bound per draw; packs the same as ObjectUniforms in uniforms.h
+layout(std140) uniform ObjectData
+{
+	mat4 model;
+	mat3 normalMatrix; // built on the CPU once per object, not per vertex
+};
\ No newline at end of file
@@ -0,0 +1,515 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "mesh.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// where the occlusion buffer's depths come from
+enum OcclusionMode
+{
+	OCCLUSION_OFF = 0,
+	OCCLUSION_HIZ,		// the GPU's depth buffer, downsampled, read back and reprojected a frame or two later
+	OCCLUSION_RASTER	// the biggest occluders of the frame itself, rasterized on the CPU
+};
+const char* const occlusionModeNames[] = { "off", "hiz", "raster" };
+
+const unsigned int OCCLUSION_WIDTH = 256;	// texels across the occlusion buffer, its height follows the aspect ratio
+const unsigned int OCCLUSION_READBACKS = 3;	// downsampled depth buffers on their way to the CPU
+const unsigned int MAX_OCCLUDERS = 32;		// raster mode: objects drawn into the buffer per frame, the largest on screen
+const float MIN_OCCLUDER_SIZE = 0.1f;		// raster mode: smallest occluder, in radius over distance
+
+/// <summary>
+/// CPU copy of a mesh's triangles for the software rasterizer, positions only
+/// </summary>
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+inline OccluderMesh occluderMesh(const MeshData& mesh)
+{
+	OccluderMesh occluder;
+	occluder.positions.resize(mesh.vertexCount());
+	for (size_t i = 0; i < occluder.positions.size(); i++)
+	{
+		occluder.positions[i] = glm::vec3(mesh.positions[i * 3 + 0], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2]);
+	}
+	occluder.indices = mesh.indices;
+	return occluder;
+}
+
+/// <summary>
+/// Low-resolution depth buffer with a max-depth mip pyramid over it. Filled either by reprojecting an
+/// older frame's depths or by rasterizing occluders, then boxes are tested against the level where
+/// their screen rectangle covers at most 2x2 texels. Depths are window depths, 0 near and 1 far;
+/// anything nothing was drawn to is far, so it hides nothing.
+/// </summary>
+class OcclusionBuffer
+{
+public:
+	void resize(unsigned int width, unsigned int height)
+	{
+		// rows are whole groups of four for the rasterizer
+		width = std::max((width + 3) & ~3u, 4u);
+		height = std::max(height, 1u);
+		if (!levels.empty() && width == widths[0] && height == heights[0]) return;
+		levels.clear();
+		widths.clear();
+		heights.clear();
+		for (;;)
+		{
+			levels.push_back(std::vector<float>((size_t)width * height, 1.0f));
+			widths.push_back(width);
+			heights.push_back(height);
+			if (width == 1 && height == 1) break;
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+		}
+	}
+
+	unsigned int width() const
+	{
+		return widths.empty() ? 0 : widths[0];
+	}
+	unsigned int height() const
+	{
+		return heights.empty() ? 0 : heights[0];
+	}
+
+	void clear()
+	{
+		std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+	}
+
+	// scatters every covered texel of a depth buffer rendered with sourceViewProjection to where it
+	// lands in this view. Where several land in one texel the farthest wins, and texels none land in
+	// (revealed by the camera's motion, or spread apart as it comes closer) stay far. Texels under
+	// the excluded boxes, where the objects that may have moved since were in the source frame, are
+	// left out too, so only what stood still occludes and the result stays conservative.
+	void reproject(const float* source, unsigned int sourceWidth, unsigned int sourceHeight, const glm::mat4& sourceViewProjection,
+		const glm::mat4& viewProjection, const std::vector<AABB>& excluded)
+	{
+		std::vector<float>& depth = levels[0];
+		std::fill(depth.begin(), depth.end(), -1.0f);
+		maskBoxes(excluded, sourceWidth, sourceHeight, sourceViewProjection);
+		// normalized device coordinates of the source straight to clip space of this view
+		glm::mat4 reprojection = viewProjection * glm::inverse(sourceViewProjection);
+		float w = (float)widths[0], h = (float)heights[0];
+		for (unsigned int y = 0; y < sourceHeight; y++)
+		{
+			float ndcY = (y + 0.5f) / sourceHeight * 2.0f - 1.0f;
+			glm::vec4 rowBase = reprojection[1] * ndcY + reprojection[3];
+			for (unsigned int x = 0; x < sourceWidth; x++)
+			{
+				float sourceDepth = source[(size_t)y * sourceWidth + x];
+				if (sourceDepth >= 1.0f || sourceMask[(size_t)y * sourceWidth + x]) continue;
+				float ndcX = (x + 0.5f) / sourceWidth * 2.0f - 1.0f;
+				glm::vec4 clip = rowBase + reprojection[0] * ndcX + reprojection[2] * (sourceDepth * 2.0f - 1.0f);
+				if (clip.w <= 0.0f) continue;
+				glm::vec3 ndc = glm::vec3(clip) / clip.w;
+				if (ndc.z < -1.0f || ndc.z > 1.0f) continue;
+				float px = (ndc.x * 0.5f + 0.5f) * w, py = (ndc.y * 0.5f + 0.5f) * h;
+				if (px < 0.0f || py < 0.0f || px >= w || py >= h) continue;
+				float& target = depth[(size_t)py * widths[0] + (size_t)px];
+				target = std::max(target, ndc.z * 0.5f + 0.5f);
+			}
+		}
+		for (float& texel : depth)
+		{
+			if (texel < 0.0f) texel = 1.0f;
+		}
+	}
+
+	// draws a mesh's triangles, clipped against the near plane; both windings, the nearest depth wins
+	void rasterize(const OccluderMesh& mesh, const glm::mat4& worldViewProjection)
+	{
+		clipPositions.resize(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); i++) clipPositions[i] = worldViewProjection * glm::vec4(mesh.positions[i], 1.0f);
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			glm::vec4 polygon[4];
+			unsigned int count = clipNear(clipPositions[mesh.indices[i]], clipPositions[mesh.indices[i + 1]], clipPositions[mesh.indices[i + 2]], polygon);
+			for (unsigned int k = 1; k + 1 < count; k++) rasterizeTriangle(polygon[0], polygon[k], polygon[k + 1]);
+		}
+	}
+
+	// once the buffer is filled: grows the far side by a texel, since a texel only partly covered by an
+	// occluder may hold its depth, then builds every level from the one below
+	void buildPyramid()
+	{
+		unsigned int w = widths[0], h = heights[0];
+		std::vector<float>& depth = levels[0];
+		scratch.resize(depth.size());
+		for (unsigned int y = 0; y < h; y++)
+		{
+			const float* row = &depth[(size_t)y * w];
+			for (unsigned int x = 0; x < w; x++) scratch[(size_t)y * w + x] = std::max(row[x], std::max(row[x > 0 ? x - 1 : x], row[x + 1 < w ? x + 1 : x]));
+		}
+		for (unsigned int y = 0; y < h; y++)
+		{
+			const float* above = &scratch[(size_t)(y > 0 ? y - 1 : y) * w];
+			const float* row = &scratch[(size_t)y * w];
+			const float* below = &scratch[(size_t)(y + 1 < h ? y + 1 : y) * w];
+			for (unsigned int x = 0; x < w; x++) depth[(size_t)y * w + x] = std::max(row[x], std::max(above[x], below[x]));
+		}
+
+		for (size_t level = 1; level < levels.size(); level++)
+		{
+			const std::vector<float>& below = levels[level - 1];
+			unsigned int belowWidth = widths[level - 1], belowHeight = heights[level - 1];
+			for (unsigned int y = 0; y < heights[level]; y++)
+			{
+				unsigned int y0 = y * 2, y1 = std::min(y * 2 + 1, belowHeight - 1);
+				for (unsigned int x = 0; x < widths[level]; x++)
+				{
+					unsigned int x0 = x * 2, x1 = std::min(x * 2 + 1, belowWidth - 1);
+					levels[level][(size_t)y * widths[level] + x] = std::max(std::max(below[(size_t)y0 * belowWidth + x0], below[(size_t)y0 * belowWidth + x1]),
+						std::max(below[(size_t)y1 * belowWidth + x0], below[(size_t)y1 * belowWidth + x1]));
+				}
+			}
+		}
+	}
+
+	// true if the box is behind everything in the texels its screen rectangle touches; boxes reaching
+	// behind the camera never are
+	bool occluded(const AABB& box, const glm::mat4& viewProjection) const
+	{
+		float loX = 1e30f, loY = 1e30f, hiX = -1e30f, hiY = -1e30f;
+		float nearest = 1.0f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y,
+				corner & 4 ? box.max.z : box.min.z, 1.0f);
+			if (clip.w <= 0.0f) return false;
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			loX = std::min(loX, ndc.x); loY = std::min(loY, ndc.y);
+			hiX = std::max(hiX, ndc.x); hiY = std::max(hiY, ndc.y);
+			nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+		}
+		if (nearest <= 0.0f) return false;
+
+		int w = (int)widths[0], h = (int)heights[0];
+		int x0 = std::clamp((int)std::floor((loX * 0.5f + 0.5f) * w), 0, w - 1), x1 = std::clamp((int)std::floor((hiX * 0.5f + 0.5f) * w), 0, w - 1);
+		int y0 = std::clamp((int)std::floor((loY * 0.5f + 0.5f) * h), 0, h - 1), y1 = std::clamp((int)std::floor((hiY * 0.5f + 0.5f) * h), 0, h - 1);
+		size_t level = 0;
+		while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) level++;
+
+		float farthest = 0.0f;
+		for (int y = y0 >> level; y <= y1 >> level; y++)
+		{
+			for (int x = x0 >> level; x <= x1 >> level; x++) farthest = std::max(farthest, levels[level][(size_t)y * widths[level] + x]);
+		}
+		return nearest > farthest;
+	}
+
+private:
+	std::vector<std::vector<float>> levels;	// level 0 is the full buffer, each one after it half the size
+	std::vector<unsigned int> widths, heights;
+	std::vector<float> scratch;
+	std::vector<glm::vec4> clipPositions;
+	std::vector<uint8_t> sourceMask;		// reproject: source texels left out
+
+	// marks the source texels the boxes' screen rectangles touch, a texel more on each side for the
+	// reduction's footprint; a box reaching behind the source camera masks everything
+	void maskBoxes(const std::vector<AABB>& boxes, unsigned int sourceWidth, unsigned int sourceHeight, const glm::mat4& sourceViewProjection)
+	{
+		sourceMask.assign((size_t)sourceWidth * sourceHeight, 0);
+		int w = (int)sourceWidth, h = (int)sourceHeight;
+		for (const AABB& box : boxes)
+		{
+			float loX = 1e30f, loY = 1e30f, hiX = -1e30f, hiY = -1e30f;
+			bool behind = false;
+			for (int corner = 0; corner < 8 && !behind; corner++)
+			{
+				glm::vec4 clip = sourceViewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y,
+					corner & 4 ? box.max.z : box.min.z, 1.0f);
+				behind = clip.w <= 0.0f;
+				loX = std::min(loX, clip.x / clip.w); loY = std::min(loY, clip.y / clip.w);
+				hiX = std::max(hiX, clip.x / clip.w); hiY = std::max(hiY, clip.y / clip.w);
+			}
+			if (behind)
+			{
+				std::fill(sourceMask.begin(), sourceMask.end(), 1);
+				return;
+			}
+			if (hiX < -1.0f || loX > 1.0f || hiY < -1.0f || loY > 1.0f) continue;
+			int x0 = std::max((int)std::floor((loX * 0.5f + 0.5f) * w) - 1, 0), x1 = std::min((int)std::floor((hiX * 0.5f + 0.5f) * w) + 1, w - 1);
+			int y0 = std::max((int)std::floor((loY * 0.5f + 0.5f) * h) - 1, 0), y1 = std::min((int)std::floor((hiY * 0.5f + 0.5f) * h) + 1, h - 1);
+			for (int y = y0; y <= y1; y++) std::fill(sourceMask.begin() + (size_t)y * w + x0, sourceMask.begin() + (size_t)y * w + x1 + 1, 1);
+		}
+	}
+
+	// Sutherland-Hodgman against the near plane, z >= -w; a triangle comes out as up to four corners
+	static unsigned int clipNear(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, glm::vec4* polygon)
+	{
+		const glm::vec4 corners[3] = { a, b, c };
+		unsigned int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& from = corners[i];
+			const glm::vec4& to = corners[(i + 1) % 3];
+			float fromDistance = from.z + from.w, toDistance = to.z + to.w;
+			if (fromDistance >= 0.0f) polygon[count++] = from;
+			if ((fromDistance >= 0.0f) != (toDistance >= 0.0f)) polygon[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+		}
+		return count;
+	}
+
+	// half-space rasterization at texel centers, four texels of a row at a time
+	void rasterizeTriangle(const glm::vec4& clipA, const glm::vec4& clipB, const glm::vec4& clipC)
+	{
+		float w = (float)widths[0], h = (float)heights[0];
+		auto toScreen = [&](const glm::vec4& clip)
+		{
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			return glm::vec3((ndc.x * 0.5f + 0.5f) * w, (ndc.y * 0.5f + 0.5f) * h, ndc.z * 0.5f + 0.5f);
+		};
+		glm::vec3 a = toScreen(clipA), b = toScreen(clipB), c = toScreen(clipC);
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (std::fabs(area) < 1e-8f) return;
+		if (area < 0.0f)
+		{
+			std::swap(b, c);
+			area = -area;
+		}
+
+		int minX = std::max((int)std::floor(std::min(a.x, std::min(b.x, c.x))), 0), maxX = std::min((int)std::ceil(std::max(a.x, std::max(b.x, c.x))), (int)widths[0] - 1);
+		int minY = std::max((int)std::floor(std::min(a.y, std::min(b.y, c.y))), 0), maxY = std::min((int)std::ceil(std::max(a.y, std::max(b.y, c.y))), (int)heights[0] - 1);
+		if (minX > maxX || minY > maxY) return;
+
+		// edge functions, positive inside: e = A x + B y + C for the edges a->b, b->c and c->a
+		float edgeA[3] = { a.y - b.y, b.y - c.y, c.y - a.y };
+		float edgeB[3] = { b.x - a.x, c.x - b.x, a.x - c.x };
+		float edgeC[3] = { -(edgeA[0] * a.x + edgeB[0] * a.y), -(edgeA[1] * b.x + edgeB[1] * b.y), -(edgeA[2] * c.x + edgeB[2] * c.y) };
+		// window depth is linear in screen space
+		float depthX = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+		float depthY = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+		float depthC = a.z - depthX * a.x - depthY * a.y;
+
+		std::vector<float>& depth = levels[0];
+		int firstX = minX & ~3;
+#ifdef TRANSFORMS_SSE
+		__m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), zero = _mm_setzero_ps();
+		__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]), dx = _mm_set1_ps(depthX);
+		for (int y = minY; y <= maxY; y++)
+		{
+			float py = y + 0.5f;
+			__m128 row0 = _mm_set1_ps(edgeB[0] * py + edgeC[0]), row1 = _mm_set1_ps(edgeB[1] * py + edgeC[1]), row2 = _mm_set1_ps(edgeB[2] * py + edgeC[2]);
+			__m128 rowDepth = _mm_set1_ps(depthY * py + depthC);
+			float* texels = &depth[(size_t)y * widths[0]];
+			for (int x = firstX; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero), _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+				if (_mm_movemask_ps(inside) == 0) continue;
+				__m128 current = _mm_loadu_ps(texels + x);
+				__m128 nearer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(dx, px), rowDepth));
+				_mm_storeu_ps(texels + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+			}
+		}
+#else
+		for (int y = minY; y <= maxY; y++)
+		{
+			float py = y + 0.5f;
+			float* texels = &depth[(size_t)y * widths[0]];
+			for (int x = firstX; x <= maxX; x++)
+			{
+				float px = x + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; e++) inside = inside && edgeA[e] * px + edgeB[e] * py + edgeC[e] >= 0.0f;
+				if (inside) texels[x] = std::min(texels[x], depthX * px + depthY * py + depthC);
+			}
+		}
+#endif
+	}
+};
+
+/// <summary>
+/// Gets the main pass's depth buffer to the CPU for OCCLUSION_HIZ without stalling: each frame's
+/// depths are copied, reduced to the farthest depth per occlusion texel and read into a pixel buffer,
+/// which is mapped once its fence has passed, usually a frame or two later
+/// </summary>
+class DepthReadback
+{
+public:
+	std::vector<float> depth;		// the newest depths read back, width x height
+	glm::mat4 viewProjection = glm::mat4(1.0f);	// the camera they were rendered with
+	std::vector<AABB> dynamicBounds;	// where the objects that move were in that frame, left out when reprojecting
+	unsigned int width = 0, height = 0;
+	bool failed = false;			// the driver couldn't copy the depth buffer, nothing will be read back
+
+	// reduces the bound framebuffer's depth after the main pass; skipped while every buffer is in flight.
+	// frameDynamicBounds are the world bounds the frame drew its moving objects at.
+	void capture(unsigned int sourceFBO, unsigned int sourceWidth, unsigned int sourceHeight, const glm::mat4& frameViewProjection,
+		const std::vector<AABB>& frameDynamicBounds, Shader& reduceShader)
+	{
+		if (failed) return;
+		if (sourceWidth != copyWidth || sourceHeight != copyHeight) resize(sourceWidth, sourceHeight);
+		if (failed || pending == OCCLUSION_READBACKS) return;
+
+		// the source's depth format has to match the copy's, which is the default framebuffer's usual one
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO);
+		glBlitFramebuffer(0, 0, copyWidth, copyHeight, 0, 0, copyWidth, copyHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		if (!checked)
+		{
+			checked = true;
+			if (glGetError() != GL_NO_ERROR)
+			{
+				std::cout << "ERROR::OCCLUSION::DEPTH_COPY_FAILED" << std::endl;
+				failed = true;
+				glBindFramebuffer(GL_FRAMEBUFFER, sourceFBO);
+				return;
+			}
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+		glViewport(0, 0, reducedWidth, reducedHeight);
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(fullscreenVAO);
+		reduceShader.use();
+		glUniform2i(reduceShader.getUniformLocation("targetSize"), (int)reducedWidth, (int)reducedHeight);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, copyTexture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glEnable(GL_DEPTH_TEST);
+
+		unsigned int slot = (first + pending) % OCCLUSION_READBACKS;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+		glReadPixels(0, 0, reducedWidth, reducedHeight, GL_RED, GL_FLOAT, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slotViewProjection[slot] = frameViewProjection;
+		slotDynamicBounds[slot] = frameDynamicBounds;
+		pending++;
+		glBindFramebuffer(GL_FRAMEBUFFER, sourceFBO);
+		glViewport(0, 0, sourceWidth, sourceHeight);
+	}
+
+	// takes the newest finished readback, if one finished since the last call; never waits
+	bool collect()
+	{
+		bool collected = false;
+		while (pending > 0 && glClientWaitSync(fences[first], GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED)
+		{
+			glDeleteSync(fences[first]);
+			fences[first] = 0;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[first]);
+			const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)reducedWidth * reducedHeight * sizeof(float), GL_MAP_READ_BIT);
+			if (mapped)
+			{
+				depth.resize((size_t)reducedWidth * reducedHeight);
+				std::memcpy(depth.data(), mapped, depth.size() * sizeof(float));
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				width = reducedWidth;
+				height = reducedHeight;
+				viewProjection = slotViewProjection[first];
+				dynamicBounds.swap(slotDynamicBounds[first]);
+				collected = true;
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			first = (first + 1) % OCCLUSION_READBACKS;
+			pending--;
+		}
+		return collected;
+	}
+
+	void destroy()
+	{
+		for (unsigned int i = 0; i < OCCLUSION_READBACKS; i++)
+		{
+			if (fences[i]) glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		pending = 0;
+		if (copyFBO)
+		{
+			glDeleteFramebuffers(1, &copyFBO);
+			glDeleteFramebuffers(1, &reduceFBO);
+			glDeleteTextures(1, &copyTexture);
+			glDeleteTextures(1, &reducedTexture);
+			glDeleteBuffers(OCCLUSION_READBACKS, pixelBuffers);
+			glDeleteVertexArrays(1, &fullscreenVAO);
+			copyFBO = 0;
+		}
+		copyWidth = copyHeight = 0;
+	}
+
+private:
+	unsigned int copyTexture = 0, copyFBO = 0, reducedTexture = 0, reduceFBO = 0, fullscreenVAO = 0;
+	unsigned int pixelBuffers[OCCLUSION_READBACKS] = {};
+	GLsync fences[OCCLUSION_READBACKS] = {};
+	glm::mat4 slotViewProjection[OCCLUSION_READBACKS];
+	std::vector<AABB> slotDynamicBounds[OCCLUSION_READBACKS];
+	unsigned int first = 0, pending = 0;	// oldest readback in flight and how many are
+	unsigned int copyWidth = 0, copyHeight = 0, reducedWidth = 0, reducedHeight = 0;
+	bool checked = false;
+
+	// (re)creates the targets for a source size; readbacks in flight are dropped
+	void resize(unsigned int sourceWidth, unsigned int sourceHeight)
+	{
+		destroy();
+		copyWidth = sourceWidth;
+		copyHeight = sourceHeight;
+		reducedWidth = std::min(OCCLUSION_WIDTH, sourceWidth);
+		reducedHeight = std::max(1u, (unsigned int)std::lround((double)reducedWidth * sourceHeight / sourceWidth));
+
+		// full-size copy of the depth buffer, the default framebuffer's can't be sampled
+		glGenTextures(1, &copyTexture);
+		glBindTexture(GL_TEXTURE_2D, copyTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, copyWidth, copyHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenFramebuffers(1, &copyFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, copyFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, copyTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+		glGenTextures(1, &reducedTexture);
+		glBindTexture(GL_TEXTURE_2D, reducedTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, reducedWidth, reducedHeight, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenFramebuffers(1, &reduceFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reducedTexture, 0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if (!complete)
+		{
+			std::cout << "ERROR::OCCLUSION::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+			failed = true;
+		}
+
+		glGenBuffers(OCCLUSION_READBACKS, pixelBuffers);
+		for (unsigned int i = 0; i < OCCLUSION_READBACKS; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)reducedWidth * reducedHeight * sizeof(float), NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glGenVertexArrays(1, &fullscreenVAO);
+		first = 0;
+	}
+};
+
+#endif
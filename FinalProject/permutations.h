@@ -0,0 +1,93 @@
+#ifndef PERMUTATIONS_H
+#define PERMUTATIONS_H
+
+#include "shader.h"
+#include "shadows.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// feature bits of a shader variant; each one turns into #defines in front of the sources
+enum ShaderFeature : uint32_t
+{
+	FEATURE_POINT_LIGHT = 1u << 0,			// POINT_LIGHTS 1
+	FEATURE_DIRECTIONAL_LIGHT = 1u << 1,	// DIRECTIONAL_LIGHTS 1
+	FEATURE_SHADOWS = 1u << 2,				// SHADOWS
+	FEATURE_SPECULAR = 1u << 3,				// SPECULAR
+	FEATURE_INSTANCED = 1u << 4				// INSTANCED, per-instance matrices instead of uniforms
+};
+// the shadow filter and kernel size are packed above the flags
+const uint32_t FEATURE_SHADOW_FILTER_SHIFT = 5;	// 2 bits, ShadowFilter
+const uint32_t FEATURE_SHADOW_KERNEL_SHIFT = 7;	// 2 bits, kernel - 1
+
+inline uint32_t shadowFilterFeatures(ShadowFilter filter, unsigned int kernel)
+{
+	return ((uint32_t)filter << FEATURE_SHADOW_FILTER_SHIFT) | ((kernel - 1) << FEATURE_SHADOW_KERNEL_SHIFT);
+}
+
+// the #define block for a feature mask
+inline std::string featureDefines(uint32_t features)
+{
+	std::string defines;
+	defines += std::string("#define POINT_LIGHTS ") + (features & FEATURE_POINT_LIGHT ? "1" : "0") + "\n";
+	defines += std::string("#define DIRECTIONAL_LIGHTS ") + (features & FEATURE_DIRECTIONAL_LIGHT ? "1" : "0") + "\n";
+	if (features & FEATURE_SHADOWS) defines += "#define SHADOWS\n";
+	if (features & FEATURE_SPECULAR) defines += "#define SPECULAR\n";
+	if (features & FEATURE_INSTANCED) defines += "#define INSTANCED\n";
+	defines += "#define SHADOW_FILTER " + std::to_string((features >> FEATURE_SHADOW_FILTER_SHIFT) & 3) + "\n";
+	defines += "#define SHADOW_KERNEL " + std::to_string(((features >> FEATURE_SHADOW_KERNEL_SHIFT) & 3) + 1) + "\n";
+	return defines;
+}
+
+/// <summary>
+/// Compile-time specialised variants of one vertex/fragment pair, keyed by a ShaderFeature mask.
+/// Variants are built on first use or up front with prewarm(); every one of them goes through
+/// the program binary cache like any other Shader.
+/// </summary>
+class ShaderPermutations
+{
+public:
+	// runs once for every new variant, e.g. to bind blocks and samplers and watch it for hot reload
+	std::function<void(Shader&)> onCreate;
+
+	ShaderPermutations(const char* vertexPath, const char* fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+	Shader& get(uint32_t features)
+	{
+		auto it = variants.find(features);
+		if (it != variants.end()) return *it->second;
+
+		std::unique_ptr<Shader>& variant = variants[features];
+		variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), featureDefines(features)));
+		if (onCreate) onCreate(*variant);
+		return *variant;
+	}
+
+	void prewarm(const std::vector<uint32_t>& featureSets)
+	{
+		for (uint32_t features : featureSets) get(features);
+	}
+
+	size_t size() const
+	{
+		return variants.size();
+	}
+
+	// every variant built so far
+	std::vector<Shader*> all() const
+	{
+		std::vector<Shader*> shaders;
+		for (const auto& variant : variants) shaders.push_back(variant.second.get());
+		return shaders;
+	}
+
+private:
+	std::string vertexPath, fragmentPath;
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// GPU timings are read back this many frames after they were issued, by which point they're done
+const unsigned int PROFILER_FRAMES_IN_FLIGHT = 3;
+const unsigned int PROFILER_MAX_GPU_SCOPES = 16;	// per frame, later ones aren't timed
+
+/// <summary>
+/// Frame profiler: RAII CPU scopes from any thread, GL_TIME_ELAPSED queries around render passes
+/// kept in a ring of PROFILER_FRAMES_IN_FLIGHT frames so reading them never waits on the GPU, and
+/// on-demand capture of a few frames into a Chrome trace_event file (chrome://tracing, Perfetto).
+/// CPU scopes cost one atomic load unless a capture is running; beginGpu()/endGpu() one branch unless
+/// enabled. Define PROFILER_DISABLED to compile every CPU scope out.
+/// </summary>
+class Profiler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	bool enabled = false;	// times GPU scopes; captures turn it on
+
+	static Profiler& get()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	bool capturing() const
+	{
+		return captureActive.load(std::memory_order_relaxed);
+	}
+
+	// records the next frames into a trace file, written once their GPU timings are in
+	void requestCapture(const std::string& path, unsigned int frames)
+	{
+		if (captureFramesLeft > 0 || framesUntilWrite > 0 || frames == 0) return;
+		enabled = true;
+		capturePath = path;
+		captureFramesLeft = frames;
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		events.clear();
+	}
+
+	// call on the render thread before anything else in the frame
+	void beginFrame()
+	{
+		if (!enabled) return;
+		renderThread = threadIndex();
+		frameIndex++;
+		FrameQueries& frame = frames[frameIndex % PROFILER_FRAMES_IN_FLIGHT];
+		collect(frame, false);
+		frame.captured = captureFramesLeft > 0;
+		captureActive = frame.captured;
+		frameStart = Clock::now();
+	}
+
+	void endFrame()
+	{
+		if (!enabled) return;
+		if (captureActive)
+		{
+			cpuEvent("frame", frameStart, Clock::now());
+			if (--captureFramesLeft == 0)
+			{
+				captureActive = false;
+				framesUntilWrite = PROFILER_FRAMES_IN_FLIGHT;
+			}
+		}
+		else if (framesUntilWrite > 0 && --framesUntilWrite == 0)
+		{
+			writeCapture();
+		}
+	}
+
+	// times a block on the GPU, and on the CPU while capturing; GL_TIME_ELAPSED queries can't nest,
+	// so only the outermost GPU scope counts and only its endGpu() ends the query
+	void beginGpu(const char* name)
+	{
+		if (!enabled) return;
+		if (gpuDepth++ > 0) return;
+		FrameQueries& frame = frames[frameIndex % PROFILER_FRAMES_IN_FLIGHT];
+		if (frame.scopes.size() >= PROFILER_MAX_GPU_SCOPES) return;
+		if (queries.empty())
+		{
+			queries.resize(PROFILER_FRAMES_IN_FLIGHT * PROFILER_MAX_GPU_SCOPES);
+			glGenQueries((GLsizei)queries.size(), queries.data());
+		}
+		unsigned int query = queries[(frameIndex % PROFILER_FRAMES_IN_FLIGHT) * PROFILER_MAX_GPU_SCOPES + frame.scopes.size()];
+		gpuScopeStart = Clock::now();
+		frame.scopes.push_back({ name, query, microseconds(gpuScopeStart) });
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		gpuOpen = true;
+	}
+	void endGpu()
+	{
+		if (gpuDepth == 0 || --gpuDepth > 0 || !gpuOpen) return;
+		glEndQuery(GL_TIME_ELAPSED);
+		gpuOpen = false;
+		if (capturing()) cpuEvent(frames[frameIndex % PROFILER_FRAMES_IN_FLIGHT].scopes.back().name, gpuScopeStart, Clock::now());
+	}
+
+	// called by ProfileScope, from any thread
+	void cpuEvent(const char* name, Clock::time_point start, Clock::time_point end)
+	{
+		double startUs = microseconds(start);
+		TraceEvent event = { name, startUs, microseconds(end) - startUs, threadIndex() };
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		events.push_back(event);
+	}
+
+	// mean GPU milliseconds per frame of every scope name, over every frame read back
+	std::vector<std::pair<std::string, double>> gpuAverages() const
+	{
+		std::vector<std::pair<std::string, double>> averages;
+		for (const GpuTotal& total : gpuTotals) averages.push_back(std::make_pair(std::string(total.name), total.count ? total.ms / total.count : 0.0));
+		return averages;
+	}
+	unsigned int droppedGpuResults() const
+	{
+		return dropped;
+	}
+	// starts the averages over, e.g. once warm-up frames are done
+	void resetTotals()
+	{
+		gpuTotals.clear();
+		dropped = 0;
+	}
+
+	// waits for the timings still in flight and writes a capture that was cut short
+	void flush()
+	{
+		for (FrameQueries& frame : frames) collect(frame, true);
+		captureActive = false;
+		captureFramesLeft = framesUntilWrite = 0;
+		if (!events.empty() && !capturePath.empty()) writeCapture();
+	}
+
+	void destroy()
+	{
+		flush();
+		if (!queries.empty()) glDeleteQueries((GLsizei)queries.size(), queries.data());
+		queries.clear();
+	}
+
+private:
+	struct GpuScope
+	{
+		const char* name;
+		unsigned int query;
+		double issuedUs;	// CPU time the query began, where the trace places the GPU work at the earliest
+	};
+	struct FrameQueries
+	{
+		std::vector<GpuScope> scopes;
+		bool captured = false;
+	};
+	struct TraceEvent
+	{
+		const char* name;
+		double startUs, durationUs;
+		unsigned int thread;
+	};
+	struct GpuTotal
+	{
+		const char* name;
+		double ms;
+		unsigned int count;
+	};
+	static const unsigned int GPU_THREAD = 1000;	// trace track of the GPU timings
+
+	Clock::time_point epoch = Clock::now();
+	Clock::time_point frameStart;
+	unsigned int frameIndex = 0;
+	FrameQueries frames[PROFILER_FRAMES_IN_FLIGHT];
+	std::vector<unsigned int> queries;
+	bool gpuOpen = false;
+	unsigned int gpuDepth = 0;	// beginGpu() calls not yet ended, nested ones included
+	Clock::time_point gpuScopeStart;
+	std::vector<GpuTotal> gpuTotals;
+	unsigned int dropped = 0;
+
+	std::atomic<bool> captureActive{ false };
+	unsigned int captureFramesLeft = 0, framesUntilWrite = 0;
+	std::string capturePath;
+	unsigned int renderThread = 0;
+	std::mutex eventsMutex;
+	std::vector<TraceEvent> events;
+	double gpuTrackEnd = 0.0;
+
+	double microseconds(Clock::time_point time) const
+	{
+		return std::chrono::duration<double, std::micro>(time - epoch).count();
+	}
+
+	static unsigned int threadIndex()
+	{
+		static std::atomic<unsigned int> next{ 0 };
+		thread_local unsigned int index = next++;
+		return index;
+	}
+
+	// reads a finished frame's timings; without wait, results that aren't ready yet are dropped
+	// rather than stalling the pipeline
+	void collect(FrameQueries& frame, bool wait)
+	{
+		for (const GpuScope& scope : frame.scopes)
+		{
+			GLint available = GL_TRUE;
+			if (!wait) glGetQueryObjectiv(scope.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+			{
+				dropped++;
+				continue;
+			}
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(scope.query, GL_QUERY_RESULT, &nanoseconds);
+			double ms = nanoseconds / 1.0e6;
+
+			GpuTotal* total = NULL;
+			for (GpuTotal& existing : gpuTotals)
+			{
+				if (std::strcmp(existing.name, scope.name) == 0) total = &existing;
+			}
+			if (!total)
+			{
+				gpuTotals.push_back({ scope.name, 0.0, 0 });
+				total = &gpuTotals.back();
+			}
+			total->ms += ms;
+			total->count++;
+
+			if (frame.captured)
+			{
+				// only durations are known, so GPU work is laid end to end from when it was issued
+				double start = std::max(scope.issuedUs, gpuTrackEnd);
+				gpuTrackEnd = start + ms * 1000.0;
+				std::lock_guard<std::mutex> lock(eventsMutex);
+				events.push_back({ scope.name, start, ms * 1000.0, GPU_THREAD });
+			}
+		}
+		frame.scopes.clear();
+		frame.captured = false;
+	}
+
+	void writeCapture()
+	{
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		std::ofstream out(capturePath);
+		if (!out)
+		{
+			std::cout << "ERROR::PROFILER::TRACE_NOT_WRITABLE " << capturePath << std::endl;
+			events.clear();
+			return;
+		}
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"FinalProject\"}},\n";
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << renderThread << ",\"args\":{\"name\":\"render\"}},\n";
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"gpu\"}}";
+		for (const TraceEvent& event : events)
+		{
+			out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu")
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+		}
+		out << "\n]}\n";
+		std::cout << "Trace: " << events.size() << " events written to " << capturePath << std::endl;
+		events.clear();
+		capturePath.clear();
+	}
+};
+
+/// <summary>
+/// Times the enclosing block into the current capture, if there is one
+/// </summary>
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) : name(name), active(Profiler::get().capturing())
+	{
+		if (active) start = Profiler::Clock::now();
+	}
+	~ProfileScope()
+	{
+		if (active) Profiler::get().cpuEvent(name, start, Profiler::Clock::now());
+	}
+
+private:
+	const char* name;
+	bool active;
+	Profiler::Clock::time_point start;
+};
+
+// names have to be string literals, the profiler keeps the pointers
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#endif
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+#include "instancing.h"
+#include "mesh.h"
+#include "shader.h"
+#include "streambuffer.h"
+#include "uniforms.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// passes in the order they run; a packet's pass sits in the top bits of its sort key
+enum RenderPass
+{
+	RENDER_PASS_SHADOW = 0,		// depth only, into a shadow cascade
+	RENDER_PASS_DEPTH_PREPASS,	// depth only, so the opaque pass shades every pixel once
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_SKYBOX,			// behind everything, after the scene has filled the depth buffer
+	RENDER_PASS_COUNT
+};
+
+/// <summary>
+/// Counters of one frame's draws and the state changes that reached GL
+/// </summary>
+struct RenderStats
+{
+	unsigned int draws = 0;		// draw calls, a multi-draw counts once
+	unsigned int commands = 0;	// meshes drawn by them
+	unsigned int triangles = 0;	// instances included
+	unsigned int stateChanges = 0, redundantChanges = 0;
+};
+
+/// <summary>
+/// Last value of every piece of GL state the render queue sets, so setting it again is a no-op.
+/// Anything that changes the same state behind its back (Shader::use(), Mesh::draw(), ...) must be
+/// followed by invalidate().
+/// </summary>
+class GLStateCache
+{
+public:
+	RenderStats stats;
+
+	// forget everything, the next call of each kind goes through
+	void invalidate()
+	{
+		program = vertexArray = 0xFFFFFFFFu;
+		for (unsigned int& texture : textures) texture = 0xFFFFFFFFu;
+		depthFunc = GL_NONE;
+		depthMask = colorMask = -1;
+		objectBuffer = 0xFFFFFFFFu;
+		objectOffset = -1;
+	}
+
+	void useProgram(unsigned int id)
+	{
+		if (changed(program, id)) glUseProgram(id);
+	}
+	void bindVertexArray(unsigned int id)
+	{
+		if (changed(vertexArray, id)) glBindVertexArray(id);
+	}
+	// binds on unit 0
+	void bindTexture(GLenum target, unsigned int id)
+	{
+		unsigned int& bound = textures[target == GL_TEXTURE_CUBE_MAP ? 1 : 0];
+		if (!changed(bound, id)) return;
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(target, id);
+	}
+	void setDepthFunc(GLenum func)
+	{
+		if (changed(depthFunc, func)) glDepthFunc(func);
+	}
+	void setDepthMask(bool write)
+	{
+		if (changed(depthMask, (int)write)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+	void setColorMask(bool write)
+	{
+		GLboolean mask = write ? GL_TRUE : GL_FALSE;
+		if (changed(colorMask, (int)write)) glColorMask(mask, mask, mask, mask);
+	}
+	// an object's uniforms, somewhere in a stream buffer
+	void bindObjectRange(unsigned int buffer, GLintptr offset)
+	{
+		if (buffer == objectBuffer && offset == objectOffset)
+		{
+			stats.redundantChanges++;
+			return;
+		}
+		objectBuffer = buffer;
+		objectOffset = offset;
+		stats.stateChanges++;
+		glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, buffer, offset, sizeof(ObjectUniforms));
+	}
+
+private:
+	unsigned int program = 0xFFFFFFFFu, vertexArray = 0xFFFFFFFFu;
+	unsigned int textures[2] = { 0xFFFFFFFFu, 0xFFFFFFFFu };	// 2D and cube map on unit 0
+	GLenum depthFunc = GL_NONE;
+	int depthMask = -1, colorMask = -1;
+	unsigned int objectBuffer = 0xFFFFFFFFu;
+	GLintptr objectOffset = -1;
+
+	template <typename T>
+	bool changed(T& current, T value)
+	{
+		if (current == value)
+		{
+			stats.redundantChanges++;
+			return false;
+		}
+		current = value;
+		stats.stateChanges++;
+		return true;
+	}
+};
+
+/// <summary>
+/// One draw: what to draw, with which program and texture, and where it sorts
+/// </summary>
+struct DrawPacket
+{
+	uint64_t key;
+	Shader* shader;
+	const Mesh* mesh;
+	GLenum textureTarget;				// GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP, bound on unit 0
+	unsigned int texture;				// 0 leaves unit 0 alone
+	const glm::mat4* model;				// NULL for instanced draws and programs without a model matrix
+	const glm::mat3* normalMatrix;		// NULL when the program doesn't take one
+	GLsizei instances;					// 0 for a plain draw
+	const InstanceData* instanceData;	// the instances' matrices for an instanced draw, NULL otherwise
+};
+
+// 64-bit sort key: pass (4 bits), program (10), vertex array (10), texture (10), then depth (30) so
+// state changes are grouped first and every state group is drawn front to back. GL names are
+// masked, names that alias only cost a state change, never a wrong draw.
+inline uint64_t makeSortKey(RenderPass pass, unsigned int program, unsigned int vertexArray, unsigned int texture, float depth)
+{
+	// a non-negative float's bits sort like the float itself
+	uint32_t depthBits = 0;
+	if (depth > 0.0f) std::memcpy(&depthBits, &depth, sizeof(depthBits));
+	return ((uint64_t)pass << 60) | ((uint64_t)(program & 0x3FF) << 50) | ((uint64_t)(vertexArray & 0x3FF) << 40)
+		| ((uint64_t)(texture & 0x3FF) << 30) | (depthBits >> 1);
+}
+
+inline RenderPass sortKeyPass(uint64_t key)
+{
+	return (RenderPass)(key >> 60);
+}
+
+/// <summary>
+/// Draw packets collected over a frame, sorted by key with an LSD radix sort and submitted through
+/// a GLStateCache so runs of packets sharing a program, vertex array or texture set it once.
+/// With multiDraw set every run goes out as one glMultiDrawElementsIndirect, its commands and all
+/// per-object matrices written into a StreamBuffer; the matrices are then instance attributes, so
+/// programs need their INSTANCED variant. Without it each packet is a base-vertex draw of its own
+/// and per-object matrices are bound as a stream buffer range per draw, no uniform calls either way.
+/// </summary>
+class RenderQueue
+{
+public:
+	bool depthPrepass = false;	// the opaque pass only shades what the pre-pass left in the depth buffer
+	MultiDrawElementsIndirectProc multiDraw = NULL;	// see loadMultiDrawIndirect()
+
+	void clear()
+	{
+		packets.clear();
+	}
+
+	void submit(const DrawPacket& packet)
+	{
+		packets.push_back(packet);
+	}
+
+	// adds count packets for the caller to fill in, e.g. from several threads at once, each its own range
+	DrawPacket* append(size_t count)
+	{
+		size_t first = packets.size();
+		packets.resize(first + count);
+		return packets.data() + first;
+	}
+
+	size_t size() const
+	{
+		return packets.size();
+	}
+
+	// sorts the packets by key: 8 passes over 8-bit digits, skipping digits every key shares
+	void sort()
+	{
+		size_t count = packets.size();
+		keys.resize(count);
+		order.resize(count);
+		keyScratch.resize(count);
+		orderScratch.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			keys[i] = packets[i].key;
+			order[i] = (uint32_t)i;
+		}
+
+		for (unsigned int shift = 0; shift < 64; shift += 8)
+		{
+			size_t histogram[256] = {};
+			for (uint64_t key : keys) histogram[(key >> shift) & 0xFF]++;
+			if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count) continue;
+
+			size_t offset = 0;
+			for (size_t& bucket : histogram)
+			{
+				size_t size = bucket;
+				bucket = offset;
+				offset += size;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+				keyScratch[destination] = keys[i];
+				orderScratch[destination] = order[i];
+			}
+			keys.swap(keyScratch);
+			order.swap(orderScratch);
+		}
+	}
+
+	// stream buffer bytes taken by one packet's matrices
+	static GLsizeiptr objectStride(const StreamBuffer& stream)
+	{
+		GLsizeiptr alignment = stream.offsetAlignment();
+		return (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+	}
+
+	// stream buffer bytes the matrices of that many objects (instances included) can take when drawn
+	// over that many execute() calls, on either path; each call makes at most two allocations and may
+	// draw one packet without matrices, the skybox
+	static GLsizeiptr frameStreamBytes(const StreamBuffer& stream, size_t objects, unsigned int executes)
+	{
+		GLsizeiptr perObject = std::max<GLsizeiptr>(objectStride(stream), sizeof(InstanceData) + sizeof(DrawElementsIndirectCommand));
+		return objects * perObject + executes * (3 * stream.offsetAlignment() + sizeof(DrawElementsIndirectCommand));
+	}
+
+	// draws the sorted packets of passes first to last; the state the passes change is put back to
+	// depth test LESS with every mask on afterwards
+	void execute(GLStateCache& state, StreamBuffer& stream, RenderPass first = RENDER_PASS_SHADOW, RenderPass last = RENDER_PASS_SKYBOX)
+	{
+		selected.clear();
+		for (uint32_t index : order)
+		{
+			RenderPass pass = sortKeyPass(packets[index].key);
+			if (pass >= first && pass <= last) selected.push_back(index);
+		}
+		if (!selected.empty())
+		{
+			if (multiDraw) executeIndirect(state, stream);
+			else executeDirect(state, stream);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		state.setDepthFunc(GL_LESS);
+		state.setDepthMask(true);
+		state.setColorMask(true);
+	}
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<uint64_t> keys, keyScratch;
+	std::vector<uint32_t> order, orderScratch;	// packet indices in sorted order
+	std::vector<uint32_t> selected;				// the ones execute() draws
+	std::vector<unsigned int> pointedArrays;	// vertex arrays whose instance attributes point at this execute's matrices
+
+	static bool streamed(const DrawPacket& packet)
+	{
+		return packet.model || packet.instanceData;
+	}
+
+	void bindPacketState(GLStateCache& state, const DrawPacket& packet)
+	{
+		state.useProgram(packet.shader->ID);
+		if (packet.texture) state.bindTexture(packet.textureTarget, packet.texture);
+		state.bindVertexArray(packet.mesh->vao);
+	}
+
+	// one base-vertex draw per packet: objects get their matrices as a uniform buffer range, instanced
+	// draws as instance attributes pointed at their part of the stream
+	void executeDirect(GLStateCache& state, StreamBuffer& stream)
+	{
+		// all matrices go into the stream buffer first, in draw order, so without persistent mapping
+		// it's unmapped once before the draws rather than around each of them
+		GLsizeiptr stride = objectStride(stream);
+		size_t objects = 0, instances = 0;
+		for (uint32_t index : selected)
+		{
+			const DrawPacket& packet = packets[index];
+			if (packet.instanceData) instances += packet.instances;
+			else if (packet.model) objects++;
+		}
+		GLintptr objectOffset = 0, instanceOffset = 0;
+		uint8_t* objectData = objects ? (uint8_t*)stream.allocate(objects * stride, objectOffset) : NULL;
+		InstanceData* instanceData = instances ? (InstanceData*)stream.allocate(instances * sizeof(InstanceData), instanceOffset) : NULL;
+		bool streamFull = (objects && !objectData) || (instances && !instanceData);
+		if (streamFull) std::cout << "ERROR::RENDER_QUEUE::STREAM_BUFFER_FULL " << objects + instances << " objects not drawn" << std::endl;
+		for (uint32_t index : selected)
+		{
+			const DrawPacket& packet = packets[index];
+			if (streamFull) break;
+			if (packet.instanceData)
+			{
+				std::memcpy(instanceData, packet.instanceData, packet.instances * sizeof(InstanceData));
+				instanceData += packet.instances;
+			}
+			else if (packet.model)
+			{
+				ObjectUniforms* object = (ObjectUniforms*)objectData;
+				object->model = *packet.model;
+				if (packet.normalMatrix)
+				{
+					for (int column = 0; column < 3; column++) object->normalMatrix[column] = glm::vec4((*packet.normalMatrix)[column], 0.0f);
+				}
+				objectData += stride;
+			}
+		}
+		stream.flush();
+
+		if (instances) glBindBuffer(GL_ARRAY_BUFFER, stream.ID);
+		RenderPass currentPass = RENDER_PASS_COUNT;
+		for (uint32_t index : selected)
+		{
+			const DrawPacket& packet = packets[index];
+			if (streamFull && streamed(packet)) continue;
+			RenderPass pass = sortKeyPass(packet.key);
+			if (pass != currentPass)
+			{
+				applyPassState(state, pass);
+				currentPass = pass;
+			}
+			bindPacketState(state, packet);
+
+			const Mesh& mesh = *packet.mesh;
+			if (packet.instanceData)
+			{
+				// the vertex array is shared with the other meshes of the layout, so it's pointed at
+				// these instances right before their draw
+				pointInstanceAttributes(instanceOffset);
+				instanceOffset += packet.instances * sizeof(InstanceData);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, mesh.indexOffset(), packet.instances, mesh.baseVertex);
+			}
+			else
+			{
+				if (packet.model)
+				{
+					state.bindObjectRange(stream.ID, objectOffset);
+					objectOffset += stride;
+				}
+				glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, mesh.indexOffset(), mesh.baseVertex);
+			}
+			state.stats.draws++;
+			state.stats.commands++;
+			state.stats.triangles += mesh.indexCount / 3 * (packet.instanceData ? packet.instances : 1);
+		}
+	}
+
+	// one indirect command per packet and one multi-draw per run of packets with the same pass,
+	// program, texture and vertex array; every packet's matrices are instances in one array, each
+	// command's baseInstance pointing at its own
+	void executeIndirect(GLStateCache& state, StreamBuffer& stream)
+	{
+		size_t instances = 0;
+		for (uint32_t index : selected)
+		{
+			const DrawPacket& packet = packets[index];
+			instances += packet.instanceData ? packet.instances : packet.model ? 1 : 0;
+		}
+		GLintptr instanceOffset = 0, commandOffset = 0;
+		InstanceData* instanceData = instances ? (InstanceData*)stream.allocate(instances * sizeof(InstanceData), instanceOffset) : NULL;
+		DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)stream.allocate(selected.size() * sizeof(DrawElementsIndirectCommand), commandOffset);
+		if ((instances && !instanceData) || !commands)
+		{
+			std::cout << "ERROR::RENDER_QUEUE::STREAM_BUFFER_FULL " << selected.size() << " packets not drawn" << std::endl;
+			stream.flush();
+			return;
+		}
+
+		GLuint baseInstance = 0;
+		for (size_t i = 0; i < selected.size(); i++)
+		{
+			const DrawPacket& packet = packets[selected[i]];
+			GLuint count = 1;
+			if (packet.instanceData)
+			{
+				count = (GLuint)packet.instances;
+				std::memcpy(instanceData + baseInstance, packet.instanceData, count * sizeof(InstanceData));
+			}
+			else if (packet.model)
+			{
+				instanceData[baseInstance].model = *packet.model;
+				instanceData[baseInstance].normalMatrix = packet.normalMatrix ? *packet.normalMatrix : glm::mat3(1.0f);
+			}
+			const Mesh& mesh = *packet.mesh;
+			commands[i] = { (GLuint)mesh.indexCount, count, mesh.firstIndex, mesh.baseVertex, baseInstance };
+			state.stats.triangles += mesh.indexCount / 3 * count;
+			if (streamed(packet)) baseInstance += count;
+		}
+		stream.flush();
+
+		glBindBuffer(GL_ARRAY_BUFFER, stream.ID);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.ID);
+		pointedArrays.clear();
+		RenderPass currentPass = RENDER_PASS_COUNT;
+		size_t end = 0;
+		for (size_t begin = 0; begin < selected.size(); begin = end)
+		{
+			const DrawPacket& packet = packets[selected[begin]];
+			bool hasInstances = streamed(packet);
+			for (end = begin + 1; end < selected.size() && sameState(packet, packets[selected[end]]); end++) hasInstances |= streamed(packets[selected[end]]);
+
+			RenderPass pass = sortKeyPass(packet.key);
+			if (pass != currentPass)
+			{
+				applyPassState(state, pass);
+				currentPass = pass;
+			}
+			bindPacketState(state, packet);
+			// the matrices are somewhere new every execute, each vertex array reading them is pointed there once
+			if (hasInstances && std::find(pointedArrays.begin(), pointedArrays.end(), packet.mesh->vao) == pointedArrays.end())
+			{
+				pointInstanceAttributes(instanceOffset);
+				pointedArrays.push_back(packet.mesh->vao);
+			}
+
+			multiDraw(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(commandOffset + begin * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - begin), 0);
+			state.stats.draws++;
+			state.stats.commands += (unsigned int)(end - begin);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	static bool sameState(const DrawPacket& a, const DrawPacket& b)
+	{
+		return sortKeyPass(a.key) == sortKeyPass(b.key) && a.shader == b.shader && a.mesh->vao == b.mesh->vao
+			&& a.textureTarget == b.textureTarget && a.texture == b.texture;
+	}
+
+	void applyPassState(GLStateCache& state, RenderPass pass)
+	{
+		switch (pass)
+		{
+		case RENDER_PASS_DEPTH_PREPASS:
+			state.setColorMask(false);
+			state.setDepthMask(true);
+			state.setDepthFunc(GL_LESS);
+			break;
+		case RENDER_PASS_OPAQUE:
+			// the pre-pass wrote the same depths (source.vsh declares gl_Position invariant), so only
+			// the nearest surface passes LEQUAL
+			state.setColorMask(true);
+			state.setDepthMask(!depthPrepass);
+			state.setDepthFunc(depthPrepass ? GL_LEQUAL : GL_LESS);
+			break;
+		case RENDER_PASS_SKYBOX:
+			// the skybox sits at depth 1, which the cleared depth buffer has to let through
+			state.setColorMask(true);
+			state.setDepthMask(true);
+			state.setDepthFunc(GL_LEQUAL);
+			break;
+		default:
+			state.setDepthMask(true);
+			state.setDepthFunc(GL_LESS);
+			break;
+		}
+	}
+};
+
+#endif
@@ -3,100 +3,377 @@
 
 #include <glad/glad.h>
 
+#include "glcaps.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+// ARB_get_program_binary / GL 4.1, not in every loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
 
 class Shader
 {
 public:
+	typedef void* (*LoadProc)(const char* name);
+	typedef void (APIENTRY* ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+	typedef void (APIENTRY* ProgramBinaryProc)(GLuint program, GLenum format, const void* binary, GLsizei length);
+	typedef void (APIENTRY* GetProgramBinaryProc)(GLuint program, GLsizei size, GLsizei* length, GLenum* format, void* binary);
+
 	unsigned int ID;
-	Shader(const char* vertexPath, const char* fragmentPath)
+
+	// directory for linked program binaries, empty disables the cache
+	static inline std::string cacheDirectory = "shadercache";
+	// programs loaded from the cache / compiled from source since startup; neither counts while the
+	// cache is unavailable
+	static inline unsigned int cacheHits = 0, cacheMisses = 0;
+	// set by initBinaryCache() when the context can hand out program binaries
+	static inline bool cacheAvailable = false;
+	static inline ProgramParameteriProc programParameteri = NULL;
+	static inline ProgramBinaryProc programBinary = NULL;
+	static inline GetProgramBinaryProc getProgramBinary = NULL;
+
+	// loads the program binary entry points; the cache stays off unless the context is 4.1 or has
+	// ARB_get_program_binary and the driver offers at least one binary format
+	static void initBinaryCache(LoadProc loader)
+	{
+		cacheAvailable = false;
+		if (!hasGLVersion(4, 1) && !hasGLExtension("GL_ARB_get_program_binary")) return;
+		programParameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+		programBinary = (ProgramBinaryProc)loader("glProgramBinary");
+		getProgramBinary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		cacheAvailable = programParameteri && programBinary && getProgramBinary && formats > 0;
+	}
+	static bool cacheEnabled()
+	{
+		return cacheAvailable && !cacheDirectory.empty();
+	}
+
+	// source files, and every file they #include, that the program was built from
+	std::string vertexPath, fragmentPath;
+	std::vector<std::string> sourceFiles;
+	std::string defines; // "#define X\n" lines put in front of both stages, see permutations.h
+
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
+		: vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines)
 	{
 		std::string vertexCode;
 		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		loadSource(vertexPath, vertexCode, sourceFiles);
+		loadSource(fragmentPath, fragmentCode, sourceFiles);
+		injectDefines(vertexCode, defines);
+		injectDefines(fragmentCode, defines);
+
+		ID = glCreateProgram();
+		uint64_t key = cacheKey(vertexCode, fragmentCode);
+		if (!cacheEnabled())
+		{
+			compileAndLink(vertexCode, fragmentCode);
+		}
+		else if (loadBinary(key))
+		{
+			cacheHits++;
+		}
+		else
+		{
+			cacheMisses++;
+			if (compileAndLink(vertexCode, fragmentCode)) saveBinary(key);
+		}
+
+		reflect();
+	}
+
+	void use()
+	{
+		glUseProgram(ID);
+	}
+
+	// reads a shader file and splices in #include "file" lines (relative to the including file);
+	// every file read is appended to files
+	static bool loadSource(const std::string& path, std::string& code, std::vector<std::string>& files, int depth = 0)
+	{
+		std::ifstream file(path);
+		if (!file || depth > 16)
 		{
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			vShaderFile.close();
-			fShaderFile.close();
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+			return false;
 		}
-		catch (std::ifstream::failure e)
+		files.push_back(path);
+		std::string directory = std::filesystem::path(path).parent_path().string();
+		if (!directory.empty()) directory += "/";
+
+		std::string line;
+		bool success = true;
+		while (std::getline(file, line))
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			size_t start = line.find_first_not_of(" \t");
+			if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+			{
+				size_t open = line.find('"', start), close = line.rfind('"');
+				if (open != std::string::npos && close > open)
+				{
+					success = loadSource(directory + line.substr(open + 1, close - open - 1), code, files, depth + 1) && success;
+					continue;
+				}
+			}
+			code += line;
+			code += '\n';
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-
-		unsigned int vertexShader, fragmentShader;
-		int success;
-		char infoLog[512];
-		// creating vertex shader
-		vertexShader = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertexShader, 1, &vShaderCode, NULL); // attach shader source code to vertex shader object
-		glCompileShader(vertexShader);
-		// check if vertex shader works
-		glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+		return success;
+	}
+
+	// inserts defines after the #version line, which has to stay first
+	static void injectDefines(std::string& code, const std::string& defines)
+	{
+		if (defines.empty()) return;
+		size_t version = code.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+		code.insert(lineEnd == std::string::npos ? 0 : lineEnd + 1, defines);
+	}
+
+	// creates and starts compiling one stage; the result is checked separately with checkStage
+	static unsigned int compileStage(GLenum type, const std::string& code)
+	{
+		const char* source = code.c_str();
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL); // attach shader source code to shader object
+		glCompileShader(shader);
+		return shader;
+	}
+
+	// prints the complete info log of a stage that failed to compile
+	static bool checkStage(unsigned int shader, const char* stageName)
+	{
+		int success = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+			int length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+			std::string infoLog(length > 0 ? length : 1, '\0');
+			glGetShaderInfoLog(shader, (GLsizei)infoLog.size(), NULL, &infoLog[0]);
+			std::cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" << infoLog.c_str() << std::endl;
 		}
+		return success != 0;
+	}
 
-		// creating fragment shader
-		fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
-		glCompileShader(fragmentShader);
-		// check if fragment shader works
-		glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	// prints the complete info log of a program that failed to link
+	static bool checkProgram(unsigned int program)
+	{
+		int success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+			int length = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+			std::string infoLog(length > 0 ? length : 1, '\0');
+			glGetProgramInfoLog(program, (GLsizei)infoLog.size(), NULL, &infoLog[0]);
+			std::cout << "ERROR::PROGRAM::SHADER::LINK_FAILED\n" << infoLog.c_str() << std::endl;
+		}
+		return success != 0;
+	}
+
+	// replaces the program with one that linked successfully elsewhere, e.g. by the hot reloader;
+	// uniform locations are re-reflected, block bindings and sampler units have to be set again
+	void adoptProgram(unsigned int program, uint64_t key, const std::vector<std::string>& files)
+	{
+		glDeleteProgram(ID);
+		ID = program;
+		sourceFiles = files;
+		saveBinary(key);
+		uniformLocations.clear();
+		uniformBlocks.clear();
+		reflect();
+	}
+
+	// FNV-1a over both sources and the driver identity, so a driver update invalidates old binaries
+	static uint64_t cacheKey(const std::string& vertexCode, const std::string& fragmentCode)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const std::string* parts[] = { &vertexCode, &fragmentCode };
+		std::string identity = driverIdentity();
+		for (const std::string* part : parts)
+		{
+			for (unsigned char c : *part) hash = (hash ^ c) * 1099511628211ull;
+			hash = (hash ^ 0xFF) * 1099511628211ull; // separator so moving text between stages changes the key
 		}
+		for (unsigned char c : identity) hash = (hash ^ c) * 1099511628211ull;
+		return hash;
+	}
+
+private:
+	bool compileAndLink(const std::string& vertexCode, const std::string& fragmentCode)
+	{
+		unsigned int vertexShader = compileStage(GL_VERTEX_SHADER, vertexCode);
+		unsigned int fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentCode);
+		checkStage(vertexShader, "VERTEX");
+		checkStage(fragmentShader, "FRAGMENT");
 
 		// creating shader program
-		ID = glCreateProgram();
+		if (cacheEnabled()) programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glAttachShader(ID, vertexShader);
 		glAttachShader(ID, fragmentShader);
 		glLinkProgram(ID);
-		// check if shader program works
+		bool success = checkProgram(ID);
+		glDetachShader(ID, vertexShader);
+		glDetachShader(ID, fragmentShader);
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return success;
+	}
+
+	static std::string cachePath(uint64_t key)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+		return cacheDirectory + "/" + name;
+	}
+
+	// cache file: magic, key, binary format, blob size, blob
+	struct BinaryHeader
+	{
+		uint32_t magic;
+		uint32_t format;
+		uint64_t key;
+		uint64_t size;
+	};
+	static const uint32_t BINARY_MAGIC = 0x43425053; // "SPBC"
+
+	bool loadBinary(uint64_t key)
+	{
+		if (!cacheEnabled()) return false;
+		std::ifstream in(cachePath(key), std::ios::binary | std::ios::ate);
+		std::streamoff fileSize = in.tellg();
+		in.seekg(0);
+		BinaryHeader header = {};
+		if (!in || !in.read((char*)&header, sizeof(header)) || header.magic != BINARY_MAGIC || header.key != key) return false;
+		// a damaged or truncated file mustn't size the allocation
+		if (header.size == 0 || header.size != (uint64_t)(fileSize - (std::streamoff)sizeof(header)) || header.size > 0x7FFFFFFF)
+		{
+			std::cout << "Shader cache: " << cachePath(key) << " is damaged, recompiling" << std::endl;
+			return false;
+		}
+		std::vector<char> blob((size_t)header.size);
+		if (!in.read(blob.data(), blob.size())) return false;
+
+		programBinary(ID, header.format, blob.data(), (GLsizei)blob.size());
+		int success = 0;
 		glGetProgramiv(ID, GL_LINK_STATUS, &success);
 		if (!success)
 		{
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
-			std::cout << "ERROR::PROGRAM::SHADER::LINK_FAILED" << infoLog << std::endl;
+			// the driver rejected the blob; start over with a clean program and rebuild from source
+			std::cout << "Shader cache: driver rejected " << cachePath(key) << ", recompiling" << std::endl;
+			glDeleteProgram(ID);
+			ID = glCreateProgram();
+			return false;
 		}
-		glDeleteShader(vertexShader);
-		glDeleteShader(fragmentShader);
+		return true;
 	}
 
-	void use()
+	void saveBinary(uint64_t key) const
 	{
-		glUseProgram(ID);
+		if (!cacheEnabled()) return;
+		int formats = 0, length = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (formats == 0 || length <= 0) return;
+
+		std::vector<char> blob(length);
+		GLenum format = 0;
+		getProgramBinary(ID, length, &length, &format, blob.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory, error);
+		std::ofstream out(cachePath(key), std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			std::cout << "ERROR::SHADER::CACHE_NOT_WRITABLE " << cachePath(key) << std::endl;
+			return;
+		}
+		BinaryHeader header = { BINARY_MAGIC, format, key, (uint64_t)length };
+		out.write((const char*)&header, sizeof(header));
+		out.write(blob.data(), length);
+	}
+
+public:
+	// cached location of an active uniform, -1 if the program doesn't use it
+	int getUniformLocation(const std::string& name) const
+	{
+		auto it = uniformLocations.find(name);
+		return it != uniformLocations.end() ? it->second : -1;
+	}
+	// binds a uniform block to a binding point; returns false if the program doesn't use the block
+	bool bindUniformBlock(const std::string& name, unsigned int binding) const
+	{
+		auto it = uniformBlocks.find(name);
+		if (it == uniformBlocks.end()) return false;
+		glUniformBlockBinding(ID, it->second, binding);
+		return true;
 	}
 	void setBool(const std::string& name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(getUniformLocation(name), (int)value);
 	}
 	void setInt(const std::string& name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(getUniformLocation(name), value);
 	}
 	void setFloat(const std::string& name, float value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(getUniformLocation(name), value);
+	}
+
+private:
+	std::unordered_map<std::string, int> uniformLocations;
+	std::unordered_map<std::string, unsigned int> uniformBlocks;
+
+	// looks up every active uniform and uniform block once so the render loop never queries by string
+	void reflect()
+	{
+		int count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::string name(maxLength > 0 ? maxLength : 1, '\0');
+		for (int i = 0; i < count; i++)
+		{
+			int length = 0, size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+			std::string uniformName = name.substr(0, length);
+			int location = glGetUniformLocation(ID, uniformName.c_str());
+			if (location < 0) continue; // members of uniform blocks have no location
+			uniformLocations[uniformName] = location;
+			// arrays are reported as "name[0]", also allow plain "name"
+			size_t bracket = uniformName.find('[');
+			if (bracket != std::string::npos) uniformLocations[uniformName.substr(0, bracket)] = location;
+		}
+
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+		name.assign(maxLength > 0 ? maxLength : 1, '\0');
+		for (int i = 0; i < count; i++)
+		{
+			int length = 0;
+			glGetActiveUniformBlockName(ID, (GLuint)i, maxLength, &length, &name[0]);
+			uniformBlocks[name.substr(0, length)] = (unsigned int)i;
+		}
 	}
 };
 
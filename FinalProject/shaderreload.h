@@ -0,0 +1,368 @@
+#ifndef SHADERRELOAD_H
+#define SHADERRELOAD_H
+
+#include <glad/glad.h>
+
+#include "glcaps.h"
+#include "shader.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile, not in every loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/// <summary>
+/// Watches the source files of registered shaders on a background thread and hot-swaps the programs.
+/// The watcher thread (inotify on Linux, timestamp polling elsewhere) reads and preprocesses changed
+/// sources; the render thread compiles and links them in poll(), in parallel with rendering when the
+/// driver supports parallel shader compile, and only swaps a program in after it linked. The watcher
+/// never touches a Shader: it works from copies of the paths, defines and file lists kept here.
+/// </summary>
+class ShaderReloader
+{
+public:
+	typedef void* (*LoadProc)(const char* name);
+
+	explicit ShaderReloader(LoadProc loader)
+	{
+		if (hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile"))
+		{
+			// let the driver pick how many compiler threads to use
+			typedef void (APIENTRY* MaxThreadsProc)(GLuint count);
+			MaxThreadsProc maxThreads = (MaxThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+			if (!maxThreads) maxThreads = (MaxThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+			if (maxThreads) maxThreads(0xFFFFFFFFu);
+			parallelCompile = true;
+		}
+	}
+	~ShaderReloader()
+	{
+		stop();
+	}
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	// may be called after start(), e.g. for shader variants compiled on first use
+	void watch(Shader* shader)
+	{
+		std::lock_guard<std::mutex> lock(shadersMutex);
+		shaders.push_back({ shader, shader->vertexPath, shader->fragmentPath, shader->defines, shader->sourceFiles });
+		filesVersion++;
+	}
+
+	void start()
+	{
+		if (running) return;
+		running = true;
+		watcher = std::thread(&ShaderReloader::watchLoop, this);
+		std::cout << "Shader hot reload: watching " << shaders.size() << " programs"
+			<< (parallelCompile ? " (parallel compile)" : "") << std::endl;
+	}
+	void stop()
+	{
+		running = false;
+		if (watcher.joinable()) watcher.join();
+	}
+
+	// render thread: starts compiling fresh sources and swaps in programs that finished linking;
+	// returns true if any program was replaced, so the caller can rebind blocks and samplers
+	bool poll()
+	{
+		std::vector<ReadSources> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.swap(readSources);
+		}
+		for (ReadSources& sources : ready) startBuild(sources);
+
+		bool swapped = false;
+		for (size_t i = 0; i < building.size();)
+		{
+			Build& build = building[i];
+			if (parallelCompile)
+			{
+				int complete = 0;
+				glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+				if (!complete)
+				{
+					i++;
+					continue;
+				}
+			}
+			swapped = finishBuild(build) || swapped;
+			building.erase(building.begin() + i);
+		}
+		return swapped;
+	}
+
+private:
+	// what the watcher needs of a shader, so it never reads one the render thread is changing
+	struct Watched
+	{
+		Shader* shader;
+		std::string vertexPath, fragmentPath, defines;
+		std::vector<std::string> files;
+	};
+	struct ReadSources
+	{
+		Shader* shader;
+		std::string vertexCode, fragmentCode;
+		std::vector<std::string> files;
+	};
+	struct Build
+	{
+		Shader* shader;
+		unsigned int program, vertexShader, fragmentShader;
+		uint64_t key;
+		std::vector<std::string> files;
+	};
+
+	std::vector<Watched> shaders;
+	unsigned int filesVersion = 0;			// bumped whenever a file list changes; both guarded by shadersMutex
+	std::mutex shadersMutex;
+	std::thread watcher;
+	std::atomic<bool> running{ false };
+	std::mutex mutex;
+	std::vector<ReadSources> readSources;	// filled by the watcher, drained by poll()
+	std::vector<Build> building;			// render thread only
+	bool parallelCompile = false;
+
+	void startBuild(ReadSources& sources)
+	{
+		// a newer edit supersedes a build that is still in flight
+		for (size_t i = 0; i < building.size(); i++)
+		{
+			if (building[i].shader != sources.shader) continue;
+			discard(building[i]);
+			building.erase(building.begin() + i);
+			break;
+		}
+
+		Build build;
+		build.shader = sources.shader;
+		build.key = Shader::cacheKey(sources.vertexCode, sources.fragmentCode);
+		build.files = sources.files;
+		build.vertexShader = Shader::compileStage(GL_VERTEX_SHADER, sources.vertexCode);
+		build.fragmentShader = Shader::compileStage(GL_FRAGMENT_SHADER, sources.fragmentCode);
+		build.program = glCreateProgram();
+		if (Shader::cacheEnabled()) Shader::programParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glAttachShader(build.program, build.vertexShader);
+		glAttachShader(build.program, build.fragmentShader);
+		glLinkProgram(build.program); // with parallel compile this returns before the link is done
+		building.push_back(build);
+	}
+
+	bool finishBuild(Build& build)
+	{
+		std::cout << "Shader hot reload: " << build.shader->vertexPath << " + " << build.shader->fragmentPath << std::endl;
+		bool compiled = Shader::checkStage(build.vertexShader, "VERTEX");
+		compiled = Shader::checkStage(build.fragmentShader, "FRAGMENT") && compiled;
+		if (!compiled || !Shader::checkProgram(build.program))
+		{
+			std::cout << "Shader hot reload: keeping the previous program" << std::endl;
+			discard(build);
+			return false;
+		}
+		glDetachShader(build.program, build.vertexShader);
+		glDetachShader(build.program, build.fragmentShader);
+		glDeleteShader(build.vertexShader);
+		glDeleteShader(build.fragmentShader);
+		build.shader->adoptProgram(build.program, build.key, build.files);
+
+		// the edit may have added or dropped #includes, the watcher picks the new list up
+		std::lock_guard<std::mutex> lock(shadersMutex);
+		for (Watched& watched : shaders)
+		{
+			if (watched.shader != build.shader || watched.files == build.files) continue;
+			watched.files = build.files;
+			filesVersion++;
+		}
+		return true;
+	}
+
+	static void discard(Build& build)
+	{
+		glDeleteProgram(build.program);
+		glDeleteShader(build.vertexShader);
+		glDeleteShader(build.fragmentShader);
+	}
+
+	// watcher thread: re-reads every shader that depends on one of the changed files
+	void reload(const std::set<std::string>& changedFiles)
+	{
+		std::vector<Watched> watched;
+		{
+			std::lock_guard<std::mutex> lock(shadersMutex);
+			watched = shaders;
+		}
+		for (const Watched& shader : watched)
+		{
+			bool affected = false;
+			for (const std::string& file : shader.files)
+			{
+				if (changedFiles.count(std::filesystem::path(file).lexically_normal().string())) affected = true;
+			}
+			if (!affected) continue;
+
+			ReadSources sources;
+			sources.shader = shader.shader;
+			bool read = Shader::loadSource(shader.vertexPath, sources.vertexCode, sources.files);
+			read = Shader::loadSource(shader.fragmentPath, sources.fragmentCode, sources.files) && read;
+			if (!read) continue;
+			Shader::injectDefines(sources.vertexCode, shader.defines);
+			Shader::injectDefines(sources.fragmentCode, shader.defines);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			readSources.push_back(std::move(sources));
+		}
+	}
+
+	// every file a watched program was built from; false if nothing changed since version
+	bool watchedFiles(unsigned int& version, std::set<std::string>& files)
+	{
+		std::lock_guard<std::mutex> lock(shadersMutex);
+		if (version == filesVersion) return false;
+		version = filesVersion;
+		files.clear();
+		for (const Watched& shader : shaders)
+		{
+			for (const std::string& file : shader.files) files.insert(std::filesystem::path(file).lexically_normal().string());
+		}
+		return true;
+	}
+	std::set<std::string> watchedDirectories(const std::set<std::string>& files)
+	{
+		std::set<std::string> directories;
+		for (const std::string& file : files)
+		{
+			std::string directory = std::filesystem::path(file).parent_path().string();
+			directories.insert(directory.empty() ? "." : directory);
+		}
+		return directories;
+	}
+
+#ifdef __linux__
+	void watchLoop()
+	{
+		int fd = inotify_init1(IN_NONBLOCK);
+		if (fd < 0)
+		{
+			std::cout << "ERROR::SHADER_RELOAD::INOTIFY_UNAVAILABLE" << std::endl;
+			return;
+		}
+		std::map<int, std::string> watches;
+		std::set<std::string> files;
+		unsigned int version = 0;
+
+		alignas(struct inotify_event) char buffer[4096];
+		std::set<std::string> changed;
+		while (running)
+		{
+			// programs registered later and reloads that pulled in new #includes can need new directories
+			if (watchedFiles(version, files))
+			{
+				std::set<std::string> directories = watchedDirectories(files);
+				for (auto it = watches.begin(); it != watches.end();)
+				{
+					if (directories.erase(it->second)) it++;
+					else
+					{
+						inotify_rm_watch(fd, it->first);
+						it = watches.erase(it);
+					}
+				}
+				for (const std::string& directory : directories)
+				{
+					// editors either rewrite in place or save to a temporary file and rename it over the original
+					int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+					if (wd >= 0) watches[wd] = directory;
+				}
+			}
+
+			pollfd descriptor = { fd, POLLIN, 0 };
+			int events = ::poll(&descriptor, 1, changed.empty() ? 200 : 50);
+			if (events > 0)
+			{
+				ssize_t length;
+				while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+				{
+					for (char* p = buffer; p < buffer + length;)
+					{
+						struct inotify_event* event = (struct inotify_event*)p;
+						auto watched = watches.find(event->wd);
+						if (watched != watches.end() && event->len != 0)
+						{
+							std::string path = watched->second == "." ? event->name : watched->second + "/" + event->name;
+							changed.insert(std::filesystem::path(path).lexically_normal().string());
+						}
+						p += sizeof(struct inotify_event) + event->len;
+					}
+				}
+			}
+			else if (!changed.empty())
+			{
+				// quiet for 50 ms after the last event, editors often write a file more than once
+				reload(changed);
+				changed.clear();
+			}
+		}
+		close(fd);
+	}
+#else
+	void watchLoop()
+	{
+		// no inotify: poll the modification times of every source file
+		std::map<std::string, std::filesystem::file_time_type> files;
+		std::set<std::string> watched;
+		unsigned int version = 0;
+		while (running)
+		{
+			// files that joined the set start from their current time, ones that left it are dropped
+			if (watchedFiles(version, watched))
+			{
+				std::map<std::string, std::filesystem::file_time_type> current;
+				for (const std::string& file : watched)
+				{
+					auto known = files.find(file);
+					std::error_code error;
+					current[file] = known != files.end() ? known->second : std::filesystem::last_write_time(file, error);
+				}
+				files.swap(current);
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			std::set<std::string> changed;
+			for (auto& file : files)
+			{
+				std::error_code error;
+				std::filesystem::file_time_type time = std::filesystem::last_write_time(file.first, error);
+				if (!error && time != file.second)
+				{
+					file.second = time;
+					changed.insert(file.first);
+				}
+			}
+			if (!changed.empty()) reload(changed);
+		}
+	}
+#endif
+};
+
+#endif
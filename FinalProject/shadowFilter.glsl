@@ -0,0 +1,7 @@
+// shadow filtering modes, match ShadowFilter in shadows.h; macros so variants can select one with #if
+#define SHADOW_FILTER_PCF 0		// grid of hardware-compared taps
+#define SHADOW_FILTER_POISSON 1	// rotated Poisson disk of hardware-compared taps
+#define SHADOW_FILTER_VSM 2		// variance shadow map: blurred depth and depth squared
+#define SHADOW_FILTER_ESM 3		// exponential shadow map: blurred exp(c * depth)
+
+const float SHADOW_ESM_EXPONENT = 80.0f;
\ No newline at end of file
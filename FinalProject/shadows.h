@@ -0,0 +1,312 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "culling.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// upper bound on cascades, sized into the ShadowData block
+const unsigned int MAX_SHADOW_CASCADES = 4;
+
+// how source.fsh filters the shadow map, mirrored in shadowFilter.glsl
+enum ShadowFilter
+{
+	SHADOW_FILTER_PCF = 0,	// kernel x kernel grid of hardware-compared, bilinear-filtered taps
+	SHADOW_FILTER_POISSON,	// kernel * kernel taps of a per-pixel rotated Poisson disk
+	SHADOW_FILTER_VSM,		// variance shadow map, moments blurred with a 2 * kernel + 1 wide Gaussian
+	SHADOW_FILTER_ESM,		// exponential shadow map, blurred the same way
+	SHADOW_FILTER_COUNT
+};
+static const char* shadowFilterNames[SHADOW_FILTER_COUNT] = { "pcf", "poisson", "vsm", "esm" };
+const unsigned int MAX_SHADOW_KERNEL = 4;	// the Poisson disk has MAX_SHADOW_KERNEL^2 points
+
+/// <summary>
+/// Cascaded shadow map for the directional light: one layer of a depth texture array per slice of
+/// the camera's depth range, each with an orthographic projection fitted to its slice.
+/// Cascades are only re-rendered when their projection or the casters in them changed; once the
+/// scene has moving casters, the static ones are cached in a second array that is copied in
+/// before the moving ones are drawn on top.
+/// </summary>
+class CascadedShadowMap
+{
+public:
+	unsigned int texture = 0, fbo = 0;
+	unsigned int staticTexture = 0, staticFBO = 0;	// static casters only, created by createStaticLayer()
+	unsigned int momentTexture = 0;					// blurred moments per cascade, VSM and ESM only
+	ShadowFilter filter = SHADOW_FILTER_PCF;		// set before create()
+	unsigned int kernel = 3;
+	unsigned int cascadeCount = 0;
+	unsigned int resolution = 0;
+	float splitLambda = 0.75f;		// 0 splits the range uniformly, 1 logarithmically
+	float shadowDistance = 50.0f;	// nothing further from the camera than this casts or receives shadows
+
+	// outputs of update()
+	glm::mat4 viewProjection[MAX_SHADOW_CASCADES];
+	float splitDepths[MAX_SHADOW_CASCADES] = {};	// view-space distance where each cascade ends
+
+	bool caching = true;	// false re-renders every cascade every frame
+
+	void create(unsigned int cascades, unsigned int size)
+	{
+		cascadeCount = std::min(std::max(cascades, 1u), MAX_SHADOW_CASCADES);
+		resolution = size;
+
+		// PCF and Poisson read through a shadow sampler, every tap is a bilinear blend of four depth comparisons
+		bool compared = usesComparison();
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compared ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compared ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, compared ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		const float farDepth[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // outside the map counts as lit
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, farDepth);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::SHADOWS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		if (!compared)
+		{
+			// ESM only needs one channel
+			GLenum format = filter == SHADOW_FILTER_VSM ? GL_RG32F : GL_R32F;
+			glGenTextures(1, &momentTexture);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, momentTexture);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, resolution, resolution, cascadeCount, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+			// horizontally blurred moments of one cascade on their way to the vertical pass
+			glGenTextures(1, &blurTexture);
+			glBindTexture(GL_TEXTURE_2D, blurTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, resolution, resolution, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+			glGenFramebuffers(1, &momentFBO);
+			glGenVertexArrays(1, &fullscreenVAO);
+		}
+		std::cout << "Shadows: " << cascadeCount << " cascades of " << resolution << "x" << resolution << ", "
+			<< shadowFilterNames[filter] << " filter, kernel " << kernel << std::endl;
+	}
+
+	bool usesComparison() const
+	{
+		return filter == SHADOW_FILTER_PCF || filter == SHADOW_FILTER_POISSON;
+	}
+
+	// VSM and ESM: rebuilds a rendered cascade's moments with a separable Gaussian, horizontally while
+	// converting from depth, then vertically into the cascade's layer
+	void filterCascade(unsigned int cascade, Shader& momentsShader, Shader& blurShader) const
+	{
+		if (usesComparison()) return;
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, momentFBO);
+		glViewport(0, 0, resolution, resolution);
+		glBindVertexArray(fullscreenVAO);
+		glActiveTexture(GL_TEXTURE0);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		momentsShader.use();
+		momentsShader.setInt("layer", (int)cascade);
+		momentsShader.setInt("radius", (int)kernel);
+		momentsShader.setInt("shadowFilter", (int)filter);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentTexture, 0, cascade);
+		blurShader.use();
+		blurShader.setInt("radius", (int)kernel);
+		glBindTexture(GL_TEXTURE_2D, blurTexture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		glBindVertexArray(0);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	// splits the camera's depth range and fits a light projection around each slice; casters between
+	// a slice and the light are kept by stretching the depth range over the whole scene's bounds.
+	// Touches no GL or render state, so the next frame's cascades can be fit while this one is drawn;
+	// they take effect once copied into viewProjection and splitDepths.
+	void fit(const glm::vec3& cameraPos, const glm::vec3& cameraFront, const glm::vec3& cameraUp, float fovy, float aspect,
+		float nearPlane, const glm::vec3& lightDirection, const AABB& sceneBounds,
+		glm::mat4 outViewProjection[MAX_SHADOW_CASCADES], float outSplitDepths[MAX_SHADOW_CASCADES]) const
+	{
+		float farPlane = shadowDistance;
+		glm::vec3 forward = glm::normalize(cameraFront);
+		glm::vec3 right = glm::normalize(glm::cross(forward, cameraUp));
+		glm::vec3 up = glm::cross(right, forward);
+		float tanY = std::tan(fovy * 0.5f), tanX = tanY * aspect;
+
+		// the light's rotation is fixed, only the ortho window moves, so snapping in light space stays stable
+		glm::vec3 direction = glm::normalize(lightDirection);
+		glm::vec3 lightUp = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, lightUp);
+
+		// depth range of the whole scene as seen by the light
+		float sceneNear = 1e30f, sceneFar = -1e30f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? sceneBounds.max.x : sceneBounds.min.x, (corner & 2) ? sceneBounds.max.y : sceneBounds.min.y,
+				(corner & 4) ? sceneBounds.max.z : sceneBounds.min.z);
+			float depth = -(lightView * glm::vec4(point, 1.0f)).z;
+			sceneNear = std::min(sceneNear, depth);
+			sceneFar = std::max(sceneFar, depth);
+		}
+
+		float sliceStart = nearPlane;
+		for (unsigned int i = 0; i < cascadeCount; i++)
+		{
+			// practical split scheme: a blend of logarithmic and uniform splits
+			float t = (float)(i + 1) / cascadeCount;
+			float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+			float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+			float sliceEnd = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+			outSplitDepths[i] = sliceEnd;
+
+			// bounding sphere of the slice; its size doesn't change as the camera turns, so neither does the texel size
+			glm::vec3 corners[8];
+			glm::vec3 center(0.0f);
+			for (int corner = 0; corner < 8; corner++)
+			{
+				float depth = (corner & 4) ? sliceEnd : sliceStart;
+				corners[corner] = cameraPos + forward * depth + right * (((corner & 1) ? 1.0f : -1.0f) * depth * tanX)
+					+ up * (((corner & 2) ? 1.0f : -1.0f) * depth * tanY);
+				center += corners[corner];
+			}
+			center /= 8.0f;
+			float radius = 0.0f;
+			for (const glm::vec3& corner : corners) radius = std::max(radius, glm::length(corner - center));
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+
+			// snap the window to whole texels so shadow edges don't crawl when the camera moves
+			glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+			float texel = 2.0f * radius / resolution;
+			lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+			lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+
+			float zNear = std::min(sceneNear, -lightCenter.z - radius);
+			float zFar = std::max(std::min(sceneFar, -lightCenter.z + radius), zNear + 1.0f);
+			glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius, zNear, zFar);
+			outViewProjection[i] = projection * lightView;
+			sliceStart = sliceEnd;
+		}
+	}
+
+	// targets one layer; the caller clears depth and draws
+	void bindCascade(unsigned int cascade) const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+		glViewport(0, 0, resolution, resolution);
+	}
+
+	bool hasStaticLayer() const
+	{
+		return staticTexture != 0;
+	}
+
+	// second array for the static casters, made the first time something in the scene moves
+	void createStaticLayer()
+	{
+		if (hasStaticLayer()) return;
+		glGenTextures(1, &staticTexture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, staticTexture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenFramebuffers(1, &staticFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::SHADOWS::STATIC_FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		invalidate();
+	}
+
+	// targets one layer of the static array
+	void bindStaticCascade(unsigned int cascade) const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+		glViewport(0, 0, resolution, resolution);
+	}
+
+	// starts a cascade from its cached static casters and leaves it bound for the moving ones
+	void copyStaticCascade(unsigned int cascade) const
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+		glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, resolution, resolution);
+	}
+
+	// true if the cascade's projection moved since it was last rendered
+	bool cascadeMoved(unsigned int cascade) const
+	{
+		return !caching || !rendered[cascade] || viewProjection[cascade] != renderedViewProjection[cascade];
+	}
+	void markRendered(unsigned int cascade)
+	{
+		rendered[cascade] = true;
+		renderedViewProjection[cascade] = viewProjection[cascade];
+	}
+	// forces every cascade to be rendered again, e.g. after the static casters changed
+	void invalidate()
+	{
+		for (bool& cascade : rendered) cascade = false;
+	}
+
+	void destroy()
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &texture);
+		if (hasStaticLayer())
+		{
+			glDeleteFramebuffers(1, &staticFBO);
+			glDeleteTextures(1, &staticTexture);
+		}
+		if (momentTexture)
+		{
+			glDeleteFramebuffers(1, &momentFBO);
+			glDeleteVertexArrays(1, &fullscreenVAO);
+			glDeleteTextures(1, &momentTexture);
+			glDeleteTextures(1, &blurTexture);
+		}
+	}
+
+private:
+	unsigned int blurTexture = 0, momentFBO = 0, fullscreenVAO = 0;
+	bool rendered[MAX_SHADOW_CASCADES] = {};
+	glm::mat4 renderedViewProjection[MAX_SHADOW_CASCADES];
+};
+
+#endif
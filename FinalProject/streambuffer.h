@@ -0,0 +1,230 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <glad/glad.h>
+
+#include "glcaps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// ARB_buffer_storage isn't part of the 3.3 core headers
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+const unsigned int MAX_STREAM_FRAMES = 4;
+
+/// <summary>
+/// Ring buffer for data the CPU writes every frame and the GPU reads that frame: per-object
+/// uniforms, instance attributes, ... Each frame in flight owns one region of the ring and a fence;
+/// a region is written again only once the GPU is past the frame that used it last.
+/// With ARB_buffer_storage (or GL 4.4) the ring is mapped once, persistently and coherently, and
+/// writes land straight in the buffer. Plain 3.3 maps the part of the region being written with
+/// GL_MAP_UNSYNCHRONIZED_BIT instead, the fences standing in for the synchronisation the driver skips,
+/// and unmaps it in flush(), before anything is drawn from it.
+/// </summary>
+class StreamBuffer
+{
+public:
+	typedef void* (*LoadProc)(const char* name);
+
+	unsigned int ID = 0;
+	bool persistent = false;
+
+	// time beginFrame() spent waiting for the GPU; more frames in flight or a faster GPU bring it down
+	double fenceWaitMs = 0.0;
+	unsigned int framesWaited = 0;
+
+	// frames is how many regions the ring has, frameSize their starting size
+	void create(unsigned int frames, GLsizeiptr frameSize, bool allowPersistent, LoadProc loader)
+	{
+		frameCount = std::min(std::max(frames, 2u), MAX_STREAM_FRAMES);
+		regionSize = frameSize;
+		GLint uniformAlignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		alignment = std::max<GLsizeiptr>(uniformAlignment, 16);
+		regionSize = alignUp(regionSize);
+
+		if (allowPersistent && (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage")))
+		{
+			bufferStorage = (BufferStorageProc)loader("glBufferStorage");
+		}
+		persistent = bufferStorage != NULL;
+		createStorage();
+	}
+
+	// call before the frame's first allocate(); waits until the GPU is done with the region, and grows
+	// the ring first if the frame needs more than a region holds
+	void beginFrame(GLsizeiptr needed)
+	{
+		frameNumber++;
+		if (alignUp(needed) > regionSize)
+		{
+			waitAll();
+			destroyStorage();
+			while (regionSize < alignUp(needed)) regionSize *= 2;
+			createStorage();
+			std::cout << "Stream buffer: grown to " << regionSize / (1024.0 * 1024.0) << " MB per frame" << std::endl;
+		}
+
+		region = frameNumber % frameCount;
+		if (fences[region])
+		{
+			// flushing makes sure the fence gets to the GPU at all, so the wait can't last forever
+			GLenum status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+			{
+				auto start = std::chrono::steady_clock::now();
+				while (status == GL_TIMEOUT_EXPIRED) status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+				fenceWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				framesWaited++;
+			}
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+		head = region * regionSize;
+	}
+
+	// size bytes of this frame's region, aligned for uniform buffer ranges and attribute offsets;
+	// returns where to write them, NULL once the region is full. The memory is write-only and valid
+	// until the next flush().
+	void* allocate(GLsizeiptr size, GLintptr& offset)
+	{
+		GLintptr start = alignUp(head);
+		if (start + size > (region + 1) * regionSize) return NULL;
+		if (!mapped)
+		{
+			// unsynchronised: nothing the GPU may still read lies past head
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, start, (region + 1) * regionSize - start,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			if (!mapped) return NULL;
+			mapStart = start;
+		}
+		offset = start;
+		head = start + size;
+		return mapped + (start - mapStart);
+	}
+
+	// makes what was allocated so far visible to the draws that follow; a no-op when persistent,
+	// coherent writes are visible to every command issued after them
+	void flush()
+	{
+		if (persistent || !mapped) return;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+		glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, head - mapStart);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = NULL;
+	}
+
+	// call once the frame's last draw reading the ring is issued
+	void endFrame()
+	{
+		flush();
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	unsigned int frame() const
+	{
+		return frameNumber;
+	}
+	unsigned int frames() const
+	{
+		return frameCount;
+	}
+	GLsizeiptr frameSize() const
+	{
+		return regionSize;
+	}
+	GLsizeiptr offsetAlignment() const
+	{
+		return alignment;
+	}
+
+	void destroy()
+	{
+		waitAll();
+		destroyStorage();
+	}
+
+private:
+	typedef void (APIENTRY* BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	BufferStorageProc bufferStorage = NULL;
+
+	unsigned int frameCount = 3;
+	GLsizeiptr regionSize = 0, alignment = 256;
+	unsigned int frameNumber = 0, region = 0;
+	GLintptr head = 0, mapStart = 0;
+	uint8_t* mapped = NULL;			// the whole ring when persistent, the part being written otherwise
+	GLsync fences[MAX_STREAM_FRAMES] = {};
+
+	GLsizeiptr alignUp(GLsizeiptr value) const
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void createStorage()
+	{
+		GLsizeiptr size = regionSize * frameCount;
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+			mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+			mapStart = 0;
+			if (!mapped)
+			{
+				// immutable storage can't be respecified, so the fallback needs a new buffer
+				std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED, falling back to unsynchronized mapping" << std::endl;
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				glDeleteBuffers(1, &ID);
+				persistent = false;
+				createStorage();
+				return;
+			}
+		}
+		else
+		{
+			glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	void destroyStorage()
+	{
+		if (!ID) return;
+		if (mapped)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			mapped = NULL;
+		}
+		glDeleteBuffers(1, &ID);
+		ID = 0;
+	}
+
+	void waitAll()
+	{
+		for (GLsync& fence : fences)
+		{
+			if (!fence) continue;
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// pixel formats a cooked texture can be stored in; all of them upload without conversion
+enum TextureFileFormat
+{
+	TEXTURE_FORMAT_RGBA8 = 0,
+	TEXTURE_FORMAT_BC1,		// 4x4 blocks of 8 bytes, RGB
+	TEXTURE_FORMAT_BC7,		// 4x4 blocks of 16 bytes, RGBA
+	TEXTURE_FORMAT_COUNT
+};
+
+/// <summary>
+/// Start of a cooked texture file, followed by faces * mipCount TextureFileLevel entries (face-major)
+/// and the image data, each level starting on a TEXTURE_FILE_ALIGNMENT boundary
+/// </summary>
+struct TextureFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;	// TextureFileFormat
+	uint32_t width, height;
+	uint32_t faces;		// 1 for 2D textures, 6 for cube maps in +x, -x, +y, -y, +z, -z order
+	uint32_t mipCount;
+	uint32_t reserved;
+};
+
+/// <summary>
+/// Where one face of one mip level lives in the file
+/// </summary>
+struct TextureFileLevel
+{
+	uint64_t offset;	// from the start of the file
+	uint64_t size;
+};
+
+const uint32_t TEXTURE_FILE_MAGIC = 0x58455443; // "CTEX"
+const uint32_t TEXTURE_FILE_VERSION = 1;
+const uint32_t TEXTURE_FILE_ALIGNMENT = 16;
+
+// bytes taken by one level of the given size, block formats round up to whole 4x4 blocks
+inline uint64_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+	if (format == TEXTURE_FORMAT_RGBA8) return (uint64_t)width * height * 4;
+	uint64_t blocks = (uint64_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == TEXTURE_FORMAT_BC1 ? 8 : 16);
+}
+
+inline uint32_t textureMipDimension(uint32_t size, uint32_t mip)
+{
+	size >>= mip;
+	return size ? size : 1;
+}
+
+// levels in a full chain down to 1x1, floor(log2(max(width, height))) + 1
+inline uint32_t textureMaxMipCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	for (uint32_t size = width > height ? width : height; size > 1; size >>= 1) count++;
+	return count;
+}
+
+/// <summary>
+/// Read-only memory mapping of a whole file
+/// </summary>
+class MappedFile
+{
+public:
+	const unsigned char* data = NULL;
+	size_t size = 0;
+
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)fileSize.QuadPart;
+#else
+		descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+		{
+			close();
+			return false;
+		}
+		void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (mapped != MAP_FAILED)
+		{
+			data = (const unsigned char*)mapped;
+			// the whole file is about to be read front to back by the upload
+			madvise(mapped, (size_t)info.st_size, MADV_SEQUENTIAL);
+			madvise(mapped, (size_t)info.st_size, MADV_WILLNEED);
+		}
+		size = (size_t)info.st_size;
+#endif
+		if (!data)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data) munmap((void*)data, size);
+		if (descriptor >= 0) ::close(descriptor);
+		descriptor = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int descriptor = -1;
+#endif
+};
+
+/// <summary>
+/// Cooked texture opened straight from a file mapping; level() points into the mapping
+/// </summary>
+class TextureFile
+{
+public:
+	MappedFile file;
+	const TextureFileHeader* header = NULL;
+
+	bool open(const std::string& path)
+	{
+		header = NULL;
+		if (!file.open(path)) return false;
+
+		const TextureFileHeader* candidate = (const TextureFileHeader*)file.data;
+		if (file.size < sizeof(TextureFileHeader) || candidate->magic != TEXTURE_FILE_MAGIC || candidate->version != TEXTURE_FILE_VERSION
+			|| candidate->format >= TEXTURE_FORMAT_COUNT || (candidate->faces != 1 && candidate->faces != 6) || candidate->width == 0 || candidate->height == 0
+			|| candidate->mipCount == 0 || candidate->mipCount > textureMaxMipCount(candidate->width, candidate->height)
+			|| file.size < sizeof(TextureFileHeader) + (size_t)candidate->faces * candidate->mipCount * sizeof(TextureFileLevel))
+		{
+			std::cout << "ERROR::TEXTUREFILE::FILE_NOT_VALID " << path << std::endl;
+			file.close();
+			return false;
+		}
+		levels = (const TextureFileLevel*)(file.data + sizeof(TextureFileHeader));
+		for (uint32_t i = 0; i < candidate->faces * candidate->mipCount; i++)
+		{
+			uint32_t mip = i % candidate->mipCount;
+			uint64_t expected = textureLevelSize(candidate->format, textureMipDimension(candidate->width, mip), textureMipDimension(candidate->height, mip));
+			if (levels[i].size != expected || levels[i].offset > file.size || levels[i].size > file.size - levels[i].offset)
+			{
+				std::cout << "ERROR::TEXTUREFILE::FILE_TRUNCATED " << path << std::endl;
+				file.close();
+				return false;
+			}
+		}
+		header = candidate;
+		return true;
+	}
+
+	const TextureFileLevel& level(uint32_t face, uint32_t mip) const
+	{
+		return levels[face * header->mipCount + mip];
+	}
+	const unsigned char* levelData(uint32_t face, uint32_t mip) const
+	{
+		return file.data + level(face, mip).offset;
+	}
+
+private:
+	const TextureFileLevel* levels = NULL;
+};
+
+#endif
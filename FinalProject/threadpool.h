@@ -0,0 +1,217 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Number of jobs still to finish out of those submitted with it; ThreadPool::wait() returns once
+/// it reaches zero. Must outlive its jobs.
+/// </summary>
+class JobCounter
+{
+public:
+	bool done() const
+	{
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class ThreadPool;
+	std::atomic<unsigned int> pending{ 0 };
+};
+
+/// <summary>
+/// Work-stealing job system: every worker has its own deque, runs the newest job it queued itself
+/// first and steals the oldest job of another worker when its own runs dry. Jobs queued from outside
+/// are dealt out round-robin. A thread waiting on jobs runs queued ones meanwhile, so jobs can wait
+/// on jobs they submitted without tying up a worker.
+/// </summary>
+class ThreadPool
+{
+public:
+	// threadCount 0 uses every hardware thread except the one the render loop runs on
+	explicit ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+		{
+			// hardware_concurrency() is 0 when it can't tell
+			unsigned int hw = std::thread::hardware_concurrency();
+			threadCount = hw > 1 ? hw - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threadCount; i++) queues.emplace_back(new Queue());
+		for (unsigned int i = 0; i < threadCount; i++) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// the job gets the index of the thread running it: a worker's, or size() for a thread helping
+	// out while it waits; counter, if given, counts the job until it has run
+	void submit(std::function<void(unsigned int)> job, JobCounter* counter = NULL)
+	{
+		if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+		unsigned int self = workerIndex();
+		Queue& queue = *queues[self < size() ? self : nextQueue.fetch_add(1, std::memory_order_relaxed) % size()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back({ std::move(job), counter });
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			queued++;
+		}
+		wake.notify_one();
+		finished.notify_all();	// threads in wait() help out too
+	}
+
+	// runs queued jobs on the calling thread until every job of the counter is done
+	void wait(JobCounter& counter)
+	{
+		unsigned int self = workerIndex();
+		while (!counter.done())
+		{
+			if (runOne(self)) continue;
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			finished.wait(lock, [this, &counter]() { return counter.done() || queued > 0; });
+		}
+	}
+
+	unsigned int size() const
+	{
+		return (unsigned int)queues.size();	// set before any worker starts, unlike workers
+	}
+
+	// runs body(begin, end) over [0, count) in chunks of up to chunkSize, on the workers and on the
+	// calling thread, and returns once every chunk is done; can be called from inside a job
+	void parallelFor(unsigned int count, unsigned int chunkSize, const std::function<void(unsigned int, unsigned int)>& body)
+	{
+		if (count == 0) return;
+		chunkSize = std::max(chunkSize, 1u);
+
+		// helpers claim chunks until there are none left; wait() keeps this frame alive until they've all returned
+		std::atomic<unsigned int> next{ 0 };
+		auto run = [&next, count, chunkSize, &body]()
+		{
+			for (;;)
+			{
+				unsigned int begin = next.fetch_add(chunkSize);
+				if (begin >= count) return;
+				body(begin, std::min(begin + chunkSize, count));
+			}
+		};
+
+		unsigned int chunks = (count + chunkSize - 1) / chunkSize;
+		unsigned int helpers = std::min(size(), chunks - 1);
+		JobCounter counter;
+		for (unsigned int i = 0; i < helpers; i++) submit([&run](unsigned int) { run(); }, &counter);
+		run();
+		wait(counter);
+	}
+
+private:
+	struct Job
+	{
+		std::function<void(unsigned int)> run;
+		JobCounter* counter;
+	};
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;	// the owner works at the back, thieves take from the front
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::atomic<unsigned int> nextQueue{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake, finished;	// workers sleep on wake, waiting threads on finished
+	unsigned int queued = 0;					// jobs in any deque, guarded by sleepMutex
+	bool stopping = false;
+
+	struct CurrentThread
+	{
+		const ThreadPool* pool;
+		unsigned int index;
+	};
+	static CurrentThread& currentThread()
+	{
+		thread_local CurrentThread current = { NULL, 0 };
+		return current;
+	}
+	unsigned int workerIndex() const
+	{
+		const CurrentThread& current = currentThread();
+		return current.pool == this ? current.index : size();
+	}
+
+	// own deque newest first, then the others oldest first
+	bool take(unsigned int self, Job& job)
+	{
+		for (unsigned int i = 0; i < size(); i++)
+		{
+			bool own = self < size() && i == 0;
+			Queue& queue = *queues[(self + i) % size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) continue;
+			if (own)
+			{
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			}
+			else
+			{
+				job = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	bool runOne(unsigned int self)
+	{
+		Job job;
+		if (!take(self, job)) return false;
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			queued--;
+		}
+		job.run(self);
+		if (job.counter && job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			finished.notify_all();
+		}
+		return true;
+	}
+
+	void workerLoop(unsigned int index)
+	{
+		currentThread() = { this, index };
+		for (;;)
+		{
+			if (runOne(index)) continue;
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() { return stopping || queued > 0; });
+			if (stopping && queued == 0) return; // stopping and drained
+		}
+	}
+};
+
+#endif
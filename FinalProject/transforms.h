@@ -0,0 +1,173 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORMS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+/// <summary>
+/// Structure-of-arrays store for object transforms. Positions, rotations and scales are kept in
+/// separate arrays so world and normal matrices can be built four objects at a time;
+/// objects whose transform didn't change since the last update are skipped.
+/// </summary>
+class TransformStore
+{
+public:
+	// inputs, one entry per object (padded to a multiple of 4 with identity transforms)
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ, rotW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<uint8_t> dirty;
+
+	// outputs, valid after update()
+	std::vector<glm::mat4> world;		// model matrix
+	std::vector<glm::mat3> normal;		// cofactor of the model's upper 3x3, shaders normalize the result
+	std::vector<unsigned int> rebuilt;	// objects whose world matrix the last update() rebuilt
+
+	unsigned int size() const
+	{
+		return count;
+	}
+
+	unsigned int add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		unsigned int index = count++;
+		if (count > posX.size()) grow();
+		set(index, position, rotation, scale);
+		return index;
+	}
+
+	void set(unsigned int index, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		posX[index] = position.x; posY[index] = position.y; posZ[index] = position.z;
+		rotX[index] = rotation.x; rotY[index] = rotation.y; rotZ[index] = rotation.z; rotW[index] = rotation.w;
+		scaleX[index] = scale.x; scaleY[index] = scale.y; scaleZ[index] = scale.z;
+		dirty[index] = 1;
+	}
+	void setPosition(unsigned int index, const glm::vec3& position)
+	{
+		posX[index] = position.x; posY[index] = position.y; posZ[index] = position.z;
+		dirty[index] = 1;
+	}
+
+	// rebuilds the matrices of every dirty object, returns true if any matrix changed
+	bool update()
+	{
+		rebuilt.clear();
+		for (unsigned int i = 0; i < count; i += 4)
+		{
+			uint32_t batchDirty;
+			std::memcpy(&batchDirty, &dirty[i], sizeof(batchDirty));
+			if (batchDirty == 0) continue;
+
+			buildBatch(i);
+			for (unsigned int j = i; j < i + 4 && j < count; j++)
+			{
+				if (dirty[j]) rebuilt.push_back(j);
+			}
+			std::memset(&dirty[i], 0, 4);
+		}
+		return !rebuilt.empty();
+	}
+
+private:
+	unsigned int count = 0;
+
+	void grow()
+	{
+		size_t capacity = posX.empty() ? 4 : posX.size() * 2;
+		std::vector<float>* zeros[] = { &posX, &posY, &posZ, &rotX, &rotY, &rotZ };
+		for (std::vector<float>* v : zeros) v->resize(capacity, 0.0f);
+		std::vector<float>* ones[] = { &rotW, &scaleX, &scaleY, &scaleZ };
+		for (std::vector<float>* v : ones) v->resize(capacity, 1.0f);
+		dirty.resize(capacity, 0);
+		world.resize(capacity, glm::mat4(1.0f));
+		normal.resize(capacity, glm::mat3(1.0f));
+	}
+
+	// world = T * R * S and normal = cofactor(R * S) = R * diag(sy*sz, sx*sz, sx*sy) for objects i..i+3;
+	// the cofactor stays finite for flattened objects like the plane where the inverse-transpose doesn't exist
+	void buildBatch(unsigned int i)
+	{
+#ifdef TRANSFORMS_SSE
+		__m128 x = _mm_loadu_ps(&rotX[i]), y = _mm_loadu_ps(&rotY[i]), z = _mm_loadu_ps(&rotZ[i]), w = _mm_loadu_ps(&rotW[i]);
+		__m128 sx = _mm_loadu_ps(&scaleX[i]), sy = _mm_loadu_ps(&scaleY[i]), sz = _mm_loadu_ps(&scaleZ[i]);
+		__m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		// rotation matrix, r[column][row], one object per lane
+		__m128 r[3][3];
+		r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		r[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		r[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		r[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		r[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		r[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		r[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		__m128 columnScale[3] = { sx, sy, sz };
+		__m128 normalScale[3] = { _mm_mul_ps(sy, sz), _mm_mul_ps(sx, sz), _mm_mul_ps(sx, sy) };
+		for (int c = 0; c < 3; c++)
+		{
+			// world column c, transposed from one-object-per-lane to one-object-per-register
+			__m128 m0 = _mm_mul_ps(r[c][0], columnScale[c]);
+			__m128 m1 = _mm_mul_ps(r[c][1], columnScale[c]);
+			__m128 m2 = _mm_mul_ps(r[c][2], columnScale[c]);
+			__m128 m3 = zero;
+			_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+			_mm_storeu_ps(&world[i + 0][c][0], m0);
+			_mm_storeu_ps(&world[i + 1][c][0], m1);
+			_mm_storeu_ps(&world[i + 2][c][0], m2);
+			_mm_storeu_ps(&world[i + 3][c][0], m3);
+
+			__m128 n0 = _mm_mul_ps(r[c][0], normalScale[c]);
+			__m128 n1 = _mm_mul_ps(r[c][1], normalScale[c]);
+			__m128 n2 = _mm_mul_ps(r[c][2], normalScale[c]);
+			__m128 n3 = zero;
+			_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+			__m128 columns[4] = { n0, n1, n2, n3 };
+			for (int k = 0; k < 4; k++)
+			{
+				float column[4];
+				_mm_storeu_ps(column, columns[k]);
+				std::memcpy(&normal[i + k][c][0], column, 3 * sizeof(float));
+			}
+		}
+
+		__m128 t0 = _mm_loadu_ps(&posX[i]), t1 = _mm_loadu_ps(&posY[i]), t2 = _mm_loadu_ps(&posZ[i]), t3 = one;
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+		_mm_storeu_ps(&world[i + 0][3][0], t0);
+		_mm_storeu_ps(&world[i + 1][3][0], t1);
+		_mm_storeu_ps(&world[i + 2][3][0], t2);
+		_mm_storeu_ps(&world[i + 3][3][0], t3);
+#else
+		for (unsigned int j = i; j < i + 4; j++)
+		{
+			glm::mat3 rotation = glm::mat3_cast(glm::quat(rotW[j], rotX[j], rotY[j], rotZ[j]));
+			glm::vec3 columnScale(scaleX[j], scaleY[j], scaleZ[j]);
+			glm::vec3 normalScale(scaleY[j] * scaleZ[j], scaleX[j] * scaleZ[j], scaleX[j] * scaleY[j]);
+			for (int c = 0; c < 3; c++)
+			{
+				world[j][c] = glm::vec4(rotation[c] * columnScale[c], 0.0f);
+				normal[j][c] = rotation[c] * normalScale[c];
+			}
+			world[j][3] = glm::vec4(posX[j], posY[j], posZ[j], 1.0f);
+		}
+#endif
+	}
+};
+
+#endif
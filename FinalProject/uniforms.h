@@ -0,0 +1,106 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// binding points shared by every program that declares the block
+enum UniformBlockBinding
+{
+	FRAME_BLOCK_BINDING = 0,
+	LIGHT_BLOCK_BINDING = 1,
+	SHADOW_BLOCK_BINDING = 2,
+	CLUSTER_BLOCK_BINDING = 3,
+	OBJECT_BLOCK_BINDING = 4	// a range of the stream buffer, rebound per draw
+};
+
+/// <summary>
+/// Per-frame constants, mirrors the std140 FrameData block in frameData.glsl
+/// </summary>
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 eyePos;
+	float time;
+};
+static_assert(sizeof(FrameUniforms) == 144, "FrameUniforms must match the std140 layout of FrameData");
+
+/// <summary>
+/// Light parameters, mirrors the std140 LightData block in source.fsh;
+/// every vec3 is followed by a float so the struct packs like std140.
+/// The point lights themselves live in ClusteredLights (clusters.h).
+/// </summary>
+struct LightUniforms
+{
+	glm::vec3 lightColor;							float padding0;
+	glm::vec3 pointLightAmbientIntensity;			float padding1;	// shared by all point lights
+	glm::vec3 directionalLightPos;					float padding2;
+	glm::vec3 directionalLightAmbientIntensity;		float padding3;
+	glm::vec3 directionalLightDiffuseIntensity;		float padding4;
+	glm::vec3 directionalLightSpecularIntensity;	float padding5;
+};
+static_assert(sizeof(LightUniforms) == 96, "LightUniforms must match the std140 layout of LightData");
+
+/// <summary>
+/// Shadow cascades, mirrors the std140 ShadowData block in source.fsh
+/// </summary>
+struct ShadowUniforms
+{
+	glm::mat4 cascadeViewProjection[4];
+	glm::vec4 cascadeSplits;	// view-space distance where each cascade ends
+	int cascadeCount;
+	float padding0, padding1, padding2;
+};
+static_assert(sizeof(ShadowUniforms) == 288, "ShadowUniforms must match the std140 layout of ShadowData");
+
+/// <summary>
+/// Light cluster grid, mirrors the std140 ClusterData block in source.fsh
+/// </summary>
+struct ClusterUniforms
+{
+	glm::uvec4 gridSize;	// tiles across, tiles down, depth slices, point light count
+	glm::vec4 screen;		// width, height, slice scale, slice bias
+};
+static_assert(sizeof(ClusterUniforms) == 32, "ClusterUniforms must match the std140 layout of ClusterData");
+
+/// <summary>
+/// Matrices of one object, mirrors the std140 ObjectData block in objectData.glsl;
+/// a mat3 is three vec4 columns in std140
+/// </summary>
+struct ObjectUniforms
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];
+};
+static_assert(sizeof(ObjectUniforms) == 112, "ObjectUniforms must match the std140 layout of ObjectData");
+
+/// <summary>
+/// Uniform buffer object attached to a fixed binding point
+/// </summary>
+class UniformBuffer
+{
+public:
+	unsigned int ID = 0;
+
+	UniformBuffer(unsigned int binding, GLsizeiptr size) : size(size)
+	{
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	// replaces the whole buffer contents
+	void update(const void* data)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+private:
+	GLsizeiptr size;
+};
+
+#endif